@@ -0,0 +1,159 @@
+#include <iostream>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "src/virtual_machine.hpp"
+#include "src/function.hpp"
+#include "src/errors/virtual_machine_error.hpp"
+#include "src/assembler/assembler.hpp"
+#include "src/assembler/bytecode.hpp"
+#include "src/standard_library/standard_library.hpp"
+#include "src/values/array_value.hpp"
+
+using namespace lysithea_vm;
+
+const char *source = R"(
+(function sumTo (n)
+    (define total 0)
+    (define i 0)
+    (loop (< i n)
+        (set total (+ total i))
+        (++ i)
+    )
+    (return total)
+)
+
+(function describe (input)
+    (define total 0)
+    (define i 0)
+    (loop (< i input.values.length)
+        (+= total (array.get input.values i))
+        (++ i)
+    )
+    (return (string.join input.name total))
+)
+
+(define obj { "name" "lys" "values" [1 2 3] })
+(define size (if (> (sumTo 5) 9) "big" "small"))
+(define result (array.join (sumTo 100) (describe obj) (array.length obj.values) (string.length obj.name) size))
+)";
+
+int failures = 0;
+
+void check(bool condition, const std::string &name)
+{
+    if (!condition)
+    {
+        std::cout << "Failed: " << name << '\n';
+        failures++;
+    }
+}
+
+std::string run_script(std::shared_ptr<script> input)
+{
+    virtual_machine vm(virtual_machine::stack_size_for(*input, 16));
+    vm.execute(input);
+
+    value result;
+    vm.global_scope->try_get_key("result", result);
+    return result.to_string();
+}
+
+bool load_throws(const std::vector<std::uint8_t> &data, const scope &builtin_scope)
+{
+    try
+    {
+        bytecode::load_script(data.data(), data.size(), builtin_scope);
+    }
+    catch (const bytecode_error &)
+    {
+        return true;
+    }
+    return false;
+}
+
+// Bytecode for a script with just the given code, as a corrupt or hand written file could have.
+std::vector<std::uint8_t> save_code(const std::vector<code_line> &code, const std::vector<std::string> &locals, const std::vector<std::string> &parameters = std::vector<std::string>())
+{
+    auto symbols = std::make_shared<debug_symbols>("test", nullptr, std::vector<code_location>());
+    auto func = std::make_shared<function>(code, parameters, locals, std::unordered_map<std::string, int>(), "test", symbols, 4);
+    script input(std::make_shared<scope>(), std::make_shared<scope>(), func, 4);
+    return bytecode::save_script(input, false);
+}
+
+int main()
+{
+    assembler assembler;
+    standard_library::add_to_scope(assembler.builtin_scope);
+    auto script = assembler.parse_from_text("bytecodeTest", source);
+
+    try
+    {
+        auto data = bytecode::save_script(*script);
+        auto loaded = bytecode::load_script(data.data(), data.size(), assembler.builtin_scope);
+
+        auto expected = run_script(script);
+        auto actual = run_script(loaded);
+        std::cout << "Result: " << actual << '\n';
+        check(expected == actual, "Loaded script gives the same result");
+        check(bytecode::save_script(*loaded) == data, "Loaded script saves the same bytecode");
+
+        auto truncated_throws = true;
+        for (auto size = 0u; size < data.size(); size++)
+        {
+            std::vector<std::uint8_t> truncated(data.begin(), data.begin() + size);
+            truncated_throws = truncated_throws && load_throws(truncated, assembler.builtin_scope);
+        }
+        check(truncated_throws, "Truncated bytecode throws");
+
+        // Changing any single byte has to either load or throw a bytecode_error, never crash.
+        for (auto i = 0u; i < data.size(); i++)
+        {
+            auto corrupt = data;
+            corrupt[i] ^= 0xFF;
+            load_throws(corrupt, assembler.builtin_scope);
+        }
+
+        std::vector<std::string> locals { "x" };
+        check(load_throws(save_code({ code_line(vm_operator::push, value(1)), code_line(vm_operator::set_local, value("x"), 1000000) }, locals), assembler.builtin_scope), "Local out of range throws");
+        check(load_throws(save_code({ code_line(vm_operator::get_local, value("x"), -2) }, locals), assembler.builtin_scope), "Negative local throws");
+        check(load_throws(save_code({ code_line(vm_operator::jump, value(), 1000) }, locals), assembler.builtin_scope), "Jump out of range throws");
+        check(load_throws(save_code({ code_line(vm_operator::push, value(1)), code_line(vm_operator::less_than_jump_false, value(2)) }, locals), assembler.builtin_scope), "Compare jump without a jump throws");
+        check(load_throws(save_code({ code_line(vm_operator::add_local, value("x"), 0) }, locals), assembler.builtin_scope), "Add local without the math lines throws");
+        check(load_throws(save_code({ code_line(vm_operator::get_property_call, value(1)), code_line(vm_operator::call, value(0)) }, locals), assembler.builtin_scope), "Property call without an array throws");
+
+        check(load_throws(save_code({ code_line(vm_operator::push, value(1)) }, locals, { "x", "y" }), assembler.builtin_scope), "More parameters than locals throws");
+        check(load_throws(save_code({ code_line(vm_operator::call, value(-1)) }, locals), assembler.builtin_scope), "Negative call count throws");
+        check(load_throws(save_code({ code_line(vm_operator::make_array, value(-2)) }, locals), assembler.builtin_scope), "Negative array count throws");
+        check(load_throws(save_code({ code_line(vm_operator::make_object, value(-2)) }, locals), assembler.builtin_scope), "Negative object count throws");
+        check(load_throws(save_code({ code_line(vm_operator::string_concat, value(-1)) }, locals), assembler.builtin_scope), "Negative concat count throws");
+        check(!load_throws(save_code({ code_line(vm_operator::push, value(1)), code_line(vm_operator::make_array, value(1)) }, { "x", "y" }, locals), assembler.builtin_scope), "Valid counts and parameters load");
+
+        value nested(1);
+        for (auto i = 0; i < 2000; i++)
+        {
+            nested = array_value::make_value(array_vector { nested }, false);
+        }
+        check(load_throws(save_code({ code_line(vm_operator::push, nested) }, locals), assembler.builtin_scope), "Deeply nested value throws");
+    }
+    catch (const virtual_machine_error &exp)
+    {
+        std::cerr << "Error: " << exp.message << '\n';
+        return -1;
+    }
+    catch (const bytecode_error &exp)
+    {
+        std::cerr << "Bytecode error: " << exp.message << '\n';
+        return -1;
+    }
+
+    if (failures > 0)
+    {
+        return -1;
+    }
+
+    std::cout << "Bytecode tests passed!\n";
+    return 0;
+}
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "src/values/values.hpp"
 #include "src/virtual_machine.hpp"
 #include "src/assembler/assembler.hpp"
+#include "src/async_builtin.hpp"
 #include "src/standard_library/standard_array_library.hpp"
 
 using namespace lysithea_vm;
@@ -15,6 +16,8 @@ std::mt19937 _rand(_rd());
 
 bool is_shop_enabled = false;
 std::vector<value> choice_buffer;
+// Set while the script is waiting for the player to choose.
+std::shared_ptr<async_operation> pending_choice;
 
 void say(const value &input)
 {
@@ -34,7 +37,7 @@ void say_choice(const value &input)
     std::cout << "- " << choice_buffer.size() << ": " << input.to_string() << "\n";
 }
 
-bool do_choice(int index, virtual_machine &vm)
+bool do_choice(int index)
 {
     if (index < 1 || index > choice_buffer.size())
     {
@@ -45,7 +48,12 @@ bool do_choice(int index, virtual_machine &vm)
 
     auto choice = choice_buffer[index];
     choice_buffer.clear();
-    vm.call_function(*choice.get_complex(), 0, false);
+
+    auto operation = std::move(pending_choice);
+    operation->complete_with([choice](virtual_machine &vm)
+    {
+        vm.call_function(*choice.get_complex(), 0, false);
+    });
     return true;
 }
 
@@ -53,29 +61,29 @@ std::shared_ptr<scope> create_dialogue_scope()
 {
     auto result = std::make_shared<scope>();
 
-    result->try_set_constant("say", [](virtual_machine &vm, const array_value &args) -> void
+    result->try_set_constant("say", [](virtual_machine &vm, const arguments_view &args) -> void
     {
         say(args.get_index(0));
     });
 
-    result->try_set_constant("getPlayerName", [](virtual_machine &vm, const array_value &args) -> void
+    result->try_set_constant("getPlayerName", [](virtual_machine &vm, const arguments_view &args) -> void
     {
         std::string player_name;
         std::cin >> player_name;
         vm.global_scope->try_define("playerName", value(player_name));
     });
 
-    result->try_set_constant("randomSay", [](virtual_machine &vm, const array_value &args) -> void
+    result->try_set_constant("randomSay", [](virtual_machine &vm, const arguments_view &args) -> void
     {
         random_say(*args.get_index<const array_value>(0));
     });
 
-    result->try_set_constant("isShopEnabled", [](virtual_machine &vm, const array_value &args) -> void
+    result->try_set_constant("isShopEnabled", [](virtual_machine &vm, const arguments_view &args) -> void
     {
         vm.push_stack(is_shop_enabled);
     });
 
-    result->try_set_constant("moveTo", [](virtual_machine &vm, const array_value &args) -> void
+    result->try_set_constant("moveTo", [](virtual_machine &vm, const arguments_view &args) -> void
     {
         auto proc = args.get_index(0).get_complex();
         auto label = args.get_index(1);
@@ -84,7 +92,7 @@ std::shared_ptr<scope> create_dialogue_scope()
         vm.jump(label.to_string());
     });
 
-    result->try_set_constant("choice", [](virtual_machine &vm, const array_value &args) -> void
+    result->try_set_constant("choice", [](virtual_machine &vm, const arguments_view &args) -> void
     {
         auto choice_text = args.get_index(0);
         auto choice_jump = args.get_index(1);
@@ -92,38 +100,23 @@ std::shared_ptr<scope> create_dialogue_scope()
         say_choice(choice_text);
     });
 
-    result->try_set_constant("waitForChoice", [](virtual_machine &vm, const array_value &args) -> void
+    // The VM is paused until the main loop gets a choice from the player.
+    result->try_set_constant("waitForChoice", make_async_builtin([](virtual_machine &vm, const arguments_view &args, std::shared_ptr<async_operation> operation) -> void
     {
         if (choice_buffer.size() == 0)
         {
             throw std::runtime_error("No choices to wait for!");
         }
 
-        auto choice_valid = false;
-        do
-        {
-            std::cout << "Enter choice: ";
-            std::string choice_text;
-            std::cin >> choice_text;
-
-            auto choice_index = std::stoi(choice_text);
-            if (do_choice(choice_index, vm))
-            {
-                choice_valid = true;
-            }
-            else
-            {
-                std::cout << "Invalid choice\n";
-            }
-        } while (!choice_valid);
-    });
+        pending_choice = operation;
+    }));
 
-    result->try_set_constant("openTheShop", [](virtual_machine &vm, const array_value &args) -> void
+    result->try_set_constant("openTheShop", [](virtual_machine &vm, const arguments_view &args) -> void
     {
         is_shop_enabled = true;
     });
 
-    result->try_set_constant("openShop", [](virtual_machine &vm, const array_value &args) -> void
+    result->try_set_constant("openShop", [](virtual_machine &vm, const arguments_view &args) -> void
     {
         std::cout << "Opening the shop to the player and quitting dialogue\n";
     });
@@ -151,8 +144,25 @@ int main()
 
     auto script = assembler.parse_from_stream(filename, input_file);
 
-    lysithea_vm::virtual_machine vm(16);
+    lysithea_vm::virtual_machine vm(lysithea_vm::virtual_machine::stack_size_for(*script, 16));
     vm.execute(script);
 
+    while (pending_choice)
+    {
+        std::cout << "Enter choice: ";
+        std::string choice_text;
+        std::cin >> choice_text;
+
+        auto choice_index = std::stoi(choice_text);
+        if (do_choice(choice_index))
+        {
+            vm.run();
+        }
+        else
+        {
+            std::cout << "Invalid choice\n";
+        }
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include <iostream>
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "src/virtual_machine.hpp"
+#include "src/errors/virtual_machine_error.hpp"
+#include "src/assembler/assembler.hpp"
+#include "src/standard_library/standard_library.hpp"
+#include "src/standard_library/standard_assert_library.hpp"
+
+using namespace lysithea_vm;
+
+const char *filename = "../../examples/testFusedCode.lys";
+
+int failures = 0;
+
+void check(bool condition, const std::string &name)
+{
+    if (!condition)
+    {
+        std::cout << "Failed: " << name << '\n';
+        failures++;
+    }
+}
+
+// Runs the test script and returns the error it ends with, the script only sets completed if all of its asserts passed.
+std::string run_script(bool fused, bool &completed)
+{
+    std::ifstream input_file(filename);
+    if (!input_file)
+    {
+        throw std::runtime_error("Could not find file to open!");
+    }
+
+    assembler assembler;
+    standard_library::add_to_scope(assembler.builtin_scope);
+    assembler.builtin_scope.combine_scope(*standard_assert_library::library_scope);
+    assembler.peephole.set_enabled(fused);
+
+    auto script = assembler.parse_from_stream(filename, input_file);
+    check(assembler.peephole.fusion_counts.empty() == !fused, fused ? "Script uses superinstructions" : "Script has no superinstructions");
+    if (fused)
+    {
+        check(assembler.peephole.fusion_counts[vm_operator::less_than_jump_false] > 0, "Compare jumps are fused");
+        check(assembler.peephole.fusion_counts[vm_operator::add_local] > 0, "Local math is fused");
+        check(assembler.peephole.fusion_counts[vm_operator::get_property_call] > 0, "Property calls are fused");
+    }
+
+    virtual_machine vm(virtual_machine::stack_size_for(*script, 32));
+    std::string error;
+    try
+    {
+        vm.execute(script);
+    }
+    catch (const virtual_machine_error &exp)
+    {
+        error = exp.message;
+    }
+
+    value result;
+    completed = vm.global_scope->try_get_key("completed", result) && result.is_true();
+    return error;
+}
+
+int main()
+{
+    try
+    {
+        auto fused_completed = false;
+        auto unfused_completed = false;
+        auto fused_error = run_script(true, fused_completed);
+        auto unfused_error = run_script(false, unfused_completed);
+
+        check(fused_completed, "Fused script passes its asserts");
+        check(unfused_completed, "Unfused script passes its asserts");
+        check(unfused_error.find("Unable to get property") == 0, "Unfused script fails on the missing property");
+        check(fused_error == unfused_error, "Fused script fails the same way");
+    }
+    catch (const std::exception &exp)
+    {
+        std::cerr << "Error: " << exp.what() << '\n';
+        return -1;
+    }
+
+    if (failures > 0)
+    {
+        return -1;
+    }
+
+    std::cout << "Fused code tests passed!\n";
+    return 0;
+}
\ No newline at end of file
@@ -17,14 +17,14 @@ std::shared_ptr<lysithea_vm::scope> create_custom_scope()
 {
     auto result = std::make_shared<lysithea_vm::scope>();
 
-    result->try_set_constant("rand", [](lysithea_vm::virtual_machine &vm, const lysithea_vm::array_value &args) -> void
+    result->try_set_constant("rand", [](lysithea_vm::virtual_machine &vm, const lysithea_vm::arguments_view &args) -> void
     {
         vm.push_stack(dist(_rand));
     });
 
-    result->try_set_constant("print", [](lysithea_vm::virtual_machine &vm, const lysithea_vm::array_value &args) -> void
+    result->try_set_constant("print", [](lysithea_vm::virtual_machine &vm, const lysithea_vm::arguments_view &args) -> void
     {
-        for (auto iter : args.data)
+        for (auto iter : args)
         {
             std::cout << iter.to_string();
         }
@@ -53,7 +53,7 @@ int main()
 
     auto script = assembler.parse_from_stream(filename, input_file);
 
-    lysithea_vm::virtual_machine vm(16);
+    lysithea_vm::virtual_machine vm(lysithea_vm::virtual_machine::stack_size_for(*script, 16));
 
     try
     {
@@ -0,0 +1,160 @@
+#include <iostream>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "src/assembler/assembler.hpp"
+#include "src/errors/virtual_machine_error.hpp"
+#include "src/values/values.hpp"
+#include "src/virtual_machine.hpp"
+#include "src/scheduler.hpp"
+
+// A short version of the perfTest script, each instance waits for a host event half way through.
+const char *script_text =
+    "(function step ()\n"
+    "    (return (+ (rand) (rand)))\n"
+    ")\n"
+    "(function main ()\n"
+    "    (define total 0)\n"
+    "    (define counter 0)\n"
+    "    (loop (< counter 500)\n"
+    "        (+= total (step))\n"
+    "        (++ counter)\n"
+    "        (if (== counter 250)\n"
+    "            (waitForEvent)\n"
+    "        )\n"
+    "    )\n"
+    "    (result total)\n"
+    ")\n"
+    "(main)\n";
+
+const int num_instances = 100000;
+const int num_running = 10000;
+
+// VMs waiting on an event, the main thread wakes them in batches as if something had happened in the game.
+std::mutex events_lock;
+std::condition_variable events_ready;
+std::vector<std::shared_ptr<lysithea_vm::scheduled_vm>> waiting;
+
+std::atomic<double> result_total(0);
+std::atomic<int> num_finished(0);
+
+std::shared_ptr<lysithea_vm::scope> create_custom_scope()
+{
+    auto result = std::make_shared<lysithea_vm::scope>();
+
+    result->try_set_constant("rand", [](lysithea_vm::virtual_machine &vm, const lysithea_vm::arguments_view &args) -> void
+    {
+        thread_local std::mt19937 random(std::random_device{}());
+        thread_local std::uniform_real_distribution<double> dist(0.0, 1.0);
+        vm.push_stack(dist(random));
+    });
+
+    result->try_set_constant("waitForEvent", [](lysithea_vm::virtual_machine &vm, const lysithea_vm::arguments_view &args) -> void
+    {
+        vm.paused = true;
+        {
+            std::lock_guard<std::mutex> guard(events_lock);
+            waiting.push_back(lysithea_vm::scheduler::current_task());
+        }
+        events_ready.notify_one();
+    });
+
+    result->try_set_constant("result", [](lysithea_vm::virtual_machine &vm, const lysithea_vm::arguments_view &args) -> void
+    {
+        auto current = result_total.load(std::memory_order_relaxed);
+        while (!result_total.compare_exchange_weak(current, current + args.get_number(0), std::memory_order_relaxed)) { }
+    });
+
+    return result;
+}
+
+int main()
+{
+    lysithea_vm::assembler assembler;
+    assembler.builtin_scope.combine_scope(*create_custom_scope());
+
+    std::stringstream input(script_text);
+    auto script = assembler.parse_from_stream("schedulerBenchmark", input);
+
+    std::atomic<int> num_started(0);
+    auto num_workers = std::max(1u, std::thread::hardware_concurrency());
+
+    // Each VM is started again with a new instance when it finishes, until all of the instances have run.
+    lysithea_vm::scheduler scheduler(num_workers, 10000, [&](lysithea_vm::scheduled_vm &task, lysithea_vm::run_status status)
+    {
+        if (status == lysithea_vm::run_status::error)
+        {
+            try
+            {
+                std::rethrow_exception(task.vm->last_error);
+            }
+            catch (const std::exception &exp)
+            {
+                std::cerr << exp.what() << "\n";
+            }
+        }
+
+        num_finished++;
+        if (num_started++ < num_instances)
+        {
+            task.vm->reset();
+            task.vm->start(script);
+            scheduler.spawn(task.vm);
+        }
+        else
+        {
+            events_ready.notify_one();
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < num_running; i++)
+    {
+        num_started++;
+        auto vm = std::make_shared<lysithea_vm::virtual_machine>(lysithea_vm::virtual_machine::stack_size_for(*script, 8));
+        vm->start(script);
+        scheduler.spawn(vm);
+    }
+
+    std::vector<std::shared_ptr<lysithea_vm::scheduled_vm>> to_wake;
+    while (num_finished.load() < num_instances)
+    {
+        {
+            std::unique_lock<std::mutex> guard(events_lock);
+            events_ready.wait_for(guard, std::chrono::milliseconds(1), []() { return !waiting.empty(); });
+            to_wake.swap(waiting);
+        }
+
+        for (const auto &task : to_wake)
+        {
+            scheduler.wake(task);
+        }
+        to_wake.clear();
+    }
+    scheduler.wait_idle();
+    auto end = std::chrono::steady_clock::now();
+    auto seconds = std::chrono::duration<double>(end - start).count();
+
+    std::cout << "Instances: " << num_instances << ", running at once: " << num_running << ", workers: " << num_workers << "\n";
+    std::cout << "Time taken: " << static_cast<int>(seconds * 1000) << "ms, " << static_cast<int>(num_instances / seconds)
+        << " instances/s, average result " << result_total.load() / num_instances << "\n";
+
+    auto stats = scheduler.stats();
+    for (std::size_t i = 0; i < stats.size(); i++)
+    {
+        const auto &worker = stats[i];
+        auto busy_seconds = std::chrono::duration<double>(worker.busy_time).count();
+        std::cout << "Worker " << i << ": " << worker.completed << " completed, " << worker.slices << " slices, "
+            << worker.parked << " parked, " << worker.steals << " steals, " << worker.failed_steals << " failed steals, "
+            << static_cast<int>(busy_seconds > 0 ? worker.completed / busy_seconds : 0) << " instances/s while busy\n";
+    }
+
+    return 0;
+}
\ No newline at end of file
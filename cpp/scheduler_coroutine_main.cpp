@@ -0,0 +1,173 @@
+#include <iostream>
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "src/assembler/assembler.hpp"
+#include "src/values/values.hpp"
+#include "src/virtual_machine.hpp"
+#include "src/async_coroutine.hpp"
+#include "src/scheduler.hpp"
+
+using namespace lysithea_vm;
+
+const char *script_text =
+    "(define value (waitForValue))\n"
+    "(waitForNothing)\n"
+    "(result (+ value (readyValue)))\n";
+
+const char *failing_text =
+    "(failNow)\n"
+    "(result 1)\n";
+
+// The coroutine waiting on the host, resumed by the main thread.
+std::mutex pending_lock;
+std::condition_variable pending_ready;
+std::coroutine_handle<> pending;
+int pending_value = 0;
+
+int result_value = 0;
+int failures = 0;
+
+void check(bool condition, const std::string &name)
+{
+    if (!condition)
+    {
+        std::cout << "Failed: " << name << '\n';
+        failures++;
+    }
+}
+
+// Hands the coroutine over to the main thread and gives back the number it resumed it with.
+class wait_for_host
+{
+    public:
+        // Methods
+        inline bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            {
+                std::lock_guard<std::mutex> guard(pending_lock);
+                pending = handle;
+            }
+            pending_ready.notify_one();
+        }
+
+        inline int await_resume() const noexcept { return pending_value; }
+};
+
+std::shared_ptr<scope> create_custom_scope()
+{
+    auto result = std::make_shared<scope>();
+
+    result->try_set_constant("waitForValue", make_coroutine_builtin([](virtual_machine &, std::vector<value>) -> async_builtin_task
+    {
+        auto input = co_await wait_for_host();
+        co_return value(input);
+    }));
+
+    result->try_set_constant("waitForNothing", make_coroutine_builtin([](virtual_machine &, std::vector<value>) -> async_builtin_task
+    {
+        co_await wait_for_host();
+        co_return value();
+    }));
+
+    // Finishes without waiting, the VM doesn't have to pause for it.
+    result->try_set_constant("readyValue", make_coroutine_builtin([](virtual_machine &, std::vector<value>) -> async_builtin_task
+    {
+        co_return value(1);
+    }));
+
+    result->try_set_constant("failNow", make_coroutine_builtin([](virtual_machine &, std::vector<value>) -> async_builtin_task
+    {
+        throw std::runtime_error("Coroutine failed");
+        co_return value();
+    }));
+
+    result->try_set_constant("result", [](virtual_machine &, const arguments_view &args) -> void
+    {
+        result_value = args.get_int(0);
+    });
+
+    return result;
+}
+
+void resume_pending(int input)
+{
+    std::coroutine_handle<> handle;
+    {
+        std::unique_lock<std::mutex> guard(pending_lock);
+        pending_ready.wait(guard, []() { return pending != nullptr; });
+        std::swap(handle, pending);
+    }
+
+    pending_value = input;
+    handle.resume();
+}
+
+std::shared_ptr<virtual_machine> create_vm(std::shared_ptr<script> input)
+{
+    auto result = std::make_shared<virtual_machine>(virtual_machine::stack_size_for(*input, 16));
+    result->start(input);
+    return result;
+}
+
+int main()
+{
+    assembler assembler;
+    assembler.builtin_scope.combine_scope(*create_custom_scope());
+    auto script = assembler.parse_from_text("schedulerCoroutineTest", script_text);
+
+    {
+        std::mutex finished_lock;
+        std::condition_variable finished;
+        auto num_completed = 0;
+        scheduler runner(2, 1000, [&](scheduled_vm &, run_status status)
+        {
+            {
+                std::lock_guard<std::mutex> guard(finished_lock);
+                num_completed += status == run_status::completed ? 1 : 0;
+            }
+            finished.notify_one();
+        });
+
+        runner.spawn(create_vm(script));
+        resume_pending(41);
+        resume_pending(0);
+        {
+            std::unique_lock<std::mutex> guard(finished_lock);
+            finished.wait_for(guard, std::chrono::seconds(10), [&num_completed]() { return num_completed > 0; });
+            check(num_completed == 1, "Finishing the coroutines finishes the VM");
+        }
+        check(result_value == 42, "VM carries on with the coroutines' results");
+    }
+
+    // An exception from the coroutine is thrown from the VM.
+    result_value = 0;
+    std::string error;
+    try
+    {
+        auto failing = assembler.parse_from_text("failingCoroutine", failing_text);
+        virtual_machine vm(virtual_machine::stack_size_for(*failing, 16));
+        vm.execute(failing);
+    }
+    catch (const std::runtime_error &exp)
+    {
+        error = exp.what();
+    }
+    check(error == "Coroutine failed", "Coroutine exception is thrown from the VM");
+    check(result_value == 0, "VM stops at the failed coroutine");
+
+    if (failures > 0)
+    {
+        return -1;
+    }
+
+    std::cout << "Scheduler coroutine tests passed!\n";
+    return 0;
+}
\ No newline at end of file
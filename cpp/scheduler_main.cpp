@@ -0,0 +1,134 @@
+#include <iostream>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include "src/assembler/assembler.hpp"
+#include "src/values/values.hpp"
+#include "src/virtual_machine.hpp"
+#include "src/async_builtin.hpp"
+#include "src/scheduler.hpp"
+
+using namespace lysithea_vm;
+
+const char *script_text =
+    "(define value (waitForValue))\n"
+    "(result (+ value 1))\n";
+
+// The operation the script is waiting on, completed by the main thread.
+std::mutex pending_lock;
+std::condition_variable pending_ready;
+std::shared_ptr<async_operation> pending;
+
+std::atomic<int> result_value(0);
+int failures = 0;
+
+void check(bool condition, const std::string &name)
+{
+    if (!condition)
+    {
+        std::cout << "Failed: " << name << '\n';
+        failures++;
+    }
+}
+
+std::shared_ptr<scope> create_custom_scope()
+{
+    auto result = std::make_shared<scope>();
+
+    result->try_set_constant("waitForValue", make_async_builtin([](virtual_machine &vm, const arguments_view &args, std::shared_ptr<async_operation> operation) -> void
+    {
+        {
+            std::lock_guard<std::mutex> guard(pending_lock);
+            pending = operation;
+        }
+        pending_ready.notify_one();
+    }));
+
+    result->try_set_constant("result", [](virtual_machine &vm, const arguments_view &args) -> void
+    {
+        result_value = args.get_int(0);
+    });
+
+    return result;
+}
+
+std::shared_ptr<async_operation> wait_for_pending()
+{
+    std::unique_lock<std::mutex> guard(pending_lock);
+    pending_ready.wait(guard, []() { return pending != nullptr; });
+
+    std::shared_ptr<async_operation> result;
+    result.swap(pending);
+    return result;
+}
+
+std::shared_ptr<virtual_machine> create_vm(std::shared_ptr<script> input)
+{
+    auto result = std::make_shared<virtual_machine>(virtual_machine::stack_size_for(*input, 16));
+    result->start(input);
+    return result;
+}
+
+int main()
+{
+    assembler assembler;
+    assembler.builtin_scope.combine_scope(*create_custom_scope());
+    auto script = assembler.parse_from_text("schedulerTest", script_text);
+
+    {
+        std::mutex finished_lock;
+        std::condition_variable finished;
+        auto num_completed = 0;
+        scheduler runner(2, 1000, [&](scheduled_vm &task, run_status status)
+        {
+            {
+                std::lock_guard<std::mutex> guard(finished_lock);
+                num_completed += status == run_status::completed ? 1 : 0;
+            }
+            finished.notify_one();
+        });
+
+        runner.spawn(create_vm(script));
+        auto operation = wait_for_pending();
+        runner.wait_idle();
+        check(runner.num_parked() == 1, "VM is parked while waiting");
+
+        // The operation can be completed before the worker has finished parking the VM, it is woken either way.
+        operation->complete(value(41));
+        {
+            std::unique_lock<std::mutex> guard(finished_lock);
+            finished.wait_for(guard, std::chrono::seconds(10), [&num_completed]() { return num_completed > 0; });
+            check(num_completed == 1, "Completing the operation finishes the VM");
+        }
+        check(result_value.load() == 42, "VM carries on with the operation's result");
+    }
+
+    // The operation outlives the scheduler, completing it must not touch the scheduler or keep the VM alive.
+    std::shared_ptr<async_operation> operation;
+    std::weak_ptr<virtual_machine> weak_vm;
+    {
+        scheduler runner(2, 1000);
+        auto vm = create_vm(script);
+        weak_vm = vm;
+        runner.spawn(vm);
+        vm.reset();
+
+        operation = wait_for_pending();
+        runner.wait_idle();
+    }
+
+    check(weak_vm.expired(), "Scheduler lets go of waiting VMs when destroyed");
+    operation->complete(value(1));
+
+    if (failures > 0)
+    {
+        return -1;
+    }
+
+    std::cout << "Scheduler tests passed!\n";
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include <iostream>
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "src/virtual_machine.hpp"
+#include "src/function.hpp"
+#include "src/symbol.hpp"
+#include "src/errors/virtual_machine_error.hpp"
+#include "src/assembler/assembler.hpp"
+#include "src/standard_library/standard_library.hpp"
+#include "src/standard_library/standard_assert_library.hpp"
+#include "src/values/function_value.hpp"
+
+using namespace lysithea_vm;
+
+const char *filename = "../../examples/testScoping.lys";
+
+int failures = 0;
+
+void check(bool condition, const std::string &name)
+{
+    if (!condition)
+    {
+        std::cout << "Failed: " << name << '\n';
+        failures++;
+    }
+}
+
+std::string get_global(virtual_machine &vm, const std::string &key)
+{
+    value result;
+    vm.global_scope->try_get_key(key, result);
+    return result.to_string();
+}
+
+void run_script_file()
+{
+    std::ifstream input_file(filename);
+    if (!input_file)
+    {
+        throw std::runtime_error("Could not find file to open!");
+    }
+
+    assembler assembler;
+    standard_library::add_to_scope(assembler.builtin_scope);
+    assembler.builtin_scope.combine_scope(*standard_assert_library::library_scope);
+
+    auto script = assembler.parse_from_stream(filename, input_file);
+    virtual_machine vm(virtual_machine::stack_size_for(*script, 32));
+    vm.execute(script);
+
+    check(get_global(vm, "completed") == "true", "Scoping script passes its asserts");
+}
+
+std::shared_ptr<function> make_function(const std::string &name, const std::vector<code_line> &code, const std::vector<std::string> &locals)
+{
+    auto symbols = std::make_shared<debug_symbols>(name, nullptr, std::vector<code_location>());
+    return std::make_shared<function>(code, std::vector<std::string>(), locals, std::unordered_map<std::string, int>(), name, symbols, 4);
+}
+
+// The assembler turns every define in a function into a local, but a function that still has a name based define
+// (like one loaded from bytecode) gets its own scope for each call. That scope has to shadow the callers' locals.
+void run_call_scope()
+{
+    auto x = symbol::intern("x").id;
+    auto reader = make_function("reader", {
+        code_line(vm_operator::get, value("x"), x),
+        code_line(vm_operator::call_return)
+    }, {});
+    auto with_scope = make_function("withScope", {
+        code_line(vm_operator::push, value("scope")),
+        code_line(vm_operator::define, value("x"), x),
+        code_line(vm_operator::push, value(make_complex<function_value>(reader))),
+        code_line(vm_operator::call, value(0)),
+        code_line(vm_operator::call_return)
+    }, {});
+    auto with_local = make_function("withLocal", {
+        code_line(vm_operator::push, value("local")),
+        code_line(vm_operator::define_local, value("x"), 0),
+        code_line(vm_operator::push, value(make_complex<function_value>(with_scope))),
+        code_line(vm_operator::call, value(0)),
+        code_line(vm_operator::call_return)
+    }, { "x" });
+    auto main = make_function("global", {
+        code_line(vm_operator::push, value(make_complex<function_value>(with_local))),
+        code_line(vm_operator::call, value(0)),
+        code_line(vm_operator::define, value("result"), symbol::intern("result").id)
+    }, {});
+
+    auto input = std::make_shared<script>(std::make_shared<scope>(), std::make_shared<scope>(), main, 4);
+    virtual_machine vm(virtual_machine::stack_size_for(*input, 16));
+    vm.execute(input);
+
+    check(get_global(vm, "result") == "scope", "A call's own scope shadows its caller's locals");
+}
+
+// A get line that has already found a builtin has to see a global defined with the same name afterwards.
+void run_shadowed_builtin()
+{
+    auto shadowed = symbol::intern("shadowed").id;
+    auto reader = make_function("reader", {
+        code_line(vm_operator::get, value("shadowed"), shadowed),
+        code_line(vm_operator::call_return)
+    }, {});
+    auto main = make_function("global", {
+        code_line(vm_operator::push, value(make_complex<function_value>(reader))),
+        code_line(vm_operator::call, value(0)),
+        code_line(vm_operator::define, value("before"), symbol::intern("before").id),
+        code_line(vm_operator::push, value("global")),
+        code_line(vm_operator::define, value("shadowed"), shadowed),
+        code_line(vm_operator::push, value(make_complex<function_value>(reader))),
+        code_line(vm_operator::call, value(0)),
+        code_line(vm_operator::define, value("after"), symbol::intern("after").id)
+    }, {});
+
+    auto builtins = std::make_shared<scope>();
+    builtins->try_set_constant("shadowed", value("builtin"));
+    auto input = std::make_shared<script>(builtins, std::make_shared<scope>(), main, 4);
+    virtual_machine vm(virtual_machine::stack_size_for(*input, 16));
+    vm.execute(input);
+
+    check(get_global(vm, "before") == "builtin", "Get finds the builtin");
+    check(get_global(vm, "after") == "global", "A global defined later shadows the builtin");
+}
+
+int main()
+{
+    try
+    {
+        run_script_file();
+        run_call_scope();
+        run_shadowed_builtin();
+    }
+    catch (const virtual_machine_error &exp)
+    {
+        std::cerr << "Error: " << exp.message << '\n';
+        return -1;
+    }
+    catch (const std::exception &exp)
+    {
+        std::cerr << "Error: " << exp.what() << '\n';
+        return -1;
+    }
+
+    if (failures > 0)
+    {
+        return -1;
+    }
+
+    std::cout << "Scoping tests passed!\n";
+    return 0;
+}
\ No newline at end of file
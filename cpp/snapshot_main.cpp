@@ -0,0 +1,93 @@
+#include <iostream>
+
+#include <fstream>
+
+#include "src/virtual_machine.hpp"
+#include "src/vm_snapshot.hpp"
+#include "src/errors/virtual_machine_error.hpp"
+#include "src/assembler/assembler.hpp"
+#include "src/standard_library/standard_library.hpp"
+
+using namespace lysithea_vm;
+
+const char *filename = "../../examples/testSnapshot.lys";
+bool snapshot_requested = false;
+
+std::shared_ptr<scope> create_snapshot_scope()
+{
+    auto result = std::make_shared<scope>();
+
+    // The snapshot is taken by the host once the VM has stopped, so the VM is between instructions.
+    result->try_set_constant("make-snapshot", [](virtual_machine &vm, const arguments_view &args) -> void
+    {
+        snapshot_requested = true;
+        vm.paused = true;
+    });
+
+    return result;
+}
+
+std::shared_ptr<script> load_script()
+{
+    std::ifstream input_file;
+    input_file.open(filename);
+    if (!input_file)
+    {
+        return nullptr;
+    }
+
+    lysithea_vm::assembler assembler;
+    lysithea_vm::standard_library::add_to_scope(assembler.builtin_scope);
+    assembler.builtin_scope.combine_scope(*create_snapshot_scope());
+
+    return assembler.parse_from_stream(filename, input_file);
+}
+
+int main()
+{
+    auto script = load_script();
+    if (!script)
+    {
+        std::cout << "Could not find file to open!\n";
+        return -1;
+    }
+
+    std::vector<std::uint8_t> snapshot;
+    try
+    {
+        lysithea_vm::virtual_machine vm(lysithea_vm::virtual_machine::stack_size_for(*script, 16));
+        vm.execute(script);
+
+        if (!snapshot_requested)
+        {
+            std::cout << "Script did not make a snapshot\n";
+            return -1;
+        }
+
+        snapshot = lysithea_vm::vm_snapshot::save(vm, *script);
+        std::cout << "Made snapshot: " << snapshot.size() << " bytes\n";
+        std::cout << "Stopped after creating snapshot\n";
+
+        // As if the snapshot had been loaded by another process, the script is parsed again and run in a new VM.
+        auto restored_script = load_script();
+        lysithea_vm::virtual_machine restored(lysithea_vm::virtual_machine::stack_size_for(*restored_script, 16));
+        lysithea_vm::vm_snapshot::restore(restored, restored_script, snapshot.data(), snapshot.size());
+
+        restored.paused = false;
+        restored.run();
+    }
+    catch (lysithea_vm::virtual_machine_error exp)
+    {
+        std::cerr << "Error: " << exp.message << "\nVM Stack:\n";
+        for (const auto &line : exp.stack_trace)
+        {
+            std::cerr << "- " << line << '\n';
+        }
+    }
+    catch (const lysithea_vm::snapshot_error &exp)
+    {
+        std::cerr << "Snapshot error: " << exp.message << "\n";
+    }
+
+    return 0;
+}
\ No newline at end of file
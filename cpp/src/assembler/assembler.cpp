@@ -1,5 +1,7 @@
 #include "assembler.hpp"
 
+#include <algorithm>
+#include <limits>
 #include <iostream>
 #include <sstream>
 #include <unordered_map>
@@ -30,7 +32,7 @@ namespace lysithea_vm
     const std::string assembler::keyword_jump("jump");
     const std::string assembler::keyword_return("return");
 
-    assembler::assembler() : label_count(0), const_scope(std::make_shared<scope>())
+    assembler::assembler() : label_count(0), script_max_stack_depth(0), const_scope(std::make_shared<scope>())
     {
 
     }
@@ -53,13 +55,20 @@ namespace lysithea_vm
 
     std::shared_ptr<script> assembler::parse_from_value(const token &input)
     {
+        // Labels only need to be unique within a script, starting again means the same source always assembles the same way.
+        label_count = 0;
+        script_max_stack_depth = 0;
+        peephole.reset_counts();
         auto code = parse_global_function(input);
 
         auto script_scope = std::make_shared<scope>();
         script_scope->combine_scope(builtin_scope);
-        script_scope->combine_scope(const_scope);
+        script_scope->combine_scope(*const_scope);
 
-        return std::make_shared<script>(script_scope, code);
+        auto constants = std::make_shared<scope>(*const_scope);
+        constants->parent = nullptr;
+
+        return std::make_shared<script>(script_scope, constants, code, script_max_stack_depth);
     }
 
     std::shared_ptr<function> assembler::parse_global_function(const token &input)
@@ -72,7 +81,7 @@ namespace lysithea_vm
         }
 
         std::vector<std::string> empty_parameters;
-        auto code = process_temp_function(empty_parameters, temp_code_lines, "global");
+        auto code = process_temp_function(empty_parameters, temp_code_lines, "global", false);
 
         return code;
     }
@@ -283,11 +292,11 @@ namespace lysithea_vm
         auto loop_label_num = label_count++;
         std::stringstream ss_label_start(":LoopStart");
         ss_label_start << loop_label_num;
-        auto label_start = std::make_shared<string_value>(ss_label_start.str());
+        auto label_start = make_complex<string_value>(ss_label_start.str());
 
         std::stringstream ss_label_end(":LoopEnd");
         ss_label_end << loop_label_num;
-        auto label_end = std::make_shared<string_value>(ss_label_end.str());
+        auto label_end = make_complex<string_value>(ss_label_end.str());
 
         loop_stack.emplace_back(label_start, label_end);
 
@@ -451,7 +460,7 @@ namespace lysithea_vm
             auto name_string_check = input.list_data[1]->token_value.get_complex<const string_value>();
             if (name_string_check)
             {
-                name = name_string_check->data;
+                name = name_string_check->to_string();
                 offset = 1;
             }
         }
@@ -469,7 +478,7 @@ namespace lysithea_vm
             push_range(temp_code_lines, parse(*input.list_data[i]));
         }
 
-        auto result = process_temp_function(parameters, temp_code_lines, name);
+        auto result = process_temp_function(parameters, temp_code_lines, name, true);
         if (!const_scope->parent)
         {
             throw make_error(input, "Internal exception, const scope parent lost");
@@ -511,7 +520,7 @@ namespace lysithea_vm
     assembler::code_line_list assembler::parse_function_keyword(const token &input)
     {
         auto function = parse_function(input);
-        auto function_value = std::make_shared<lysithea_vm::function_value>(function);
+        auto function_value = make_complex<lysithea_vm::function_value>(function);
         code_line_list result;
 
         if (keyword_parsing_stack.size() == 1 && function->has_name)
@@ -641,11 +650,11 @@ namespace lysithea_vm
 
         auto var_name = get_value(*input.list_data[1]).to_string();
         std::vector<token_ptr> new_code(input.list_data);
-        new_code[0] = std::make_shared<token>(input.list_data[0]->keep_location(value(std::make_shared<variable_value>(op_code))));
+        new_code[0] = std::make_shared<token>(input.list_data[0]->keep_location(value(make_complex<variable_value>(op_code))));
 
         std::vector<token_ptr> wrapped_code;
-        wrapped_code.emplace_back(std::make_shared<token>(input.keep_location(value(std::make_shared<variable_value>("set")))));
-        wrapped_code.emplace_back(std::make_shared<token>(input.list_data[1]->keep_location(value(std::make_shared<variable_value>(var_name)))));
+        wrapped_code.emplace_back(std::make_shared<token>(input.keep_location(value(make_complex<variable_value>("set")))));
+        wrapped_code.emplace_back(std::make_shared<token>(input.list_data[1]->keep_location(value(make_complex<variable_value>(var_name)))));
         wrapped_code.emplace_back(std::make_shared<token>(input.location, token_type::expression, new_code));
 
         token wrapped_code_value(input.location, token_type::expression, wrapped_code);
@@ -718,7 +727,7 @@ namespace lysithea_vm
             call_vector.emplace_back(get_value(result[0].argument));
             call_vector.emplace_back(num_arg_value);
 
-            auto call_value = std::make_shared<array_value>(call_vector, false);
+            auto call_value = make_complex<array_value>(call_vector, false);
 
             code_line_list direct_result;
             direct_result.emplace_back(vm_operator::call_direct, input.keep_location(call_value));
@@ -765,13 +774,13 @@ namespace lysithea_vm
             return result;
         }
 
-        std::shared_ptr<string_value> parent_key;
-        std::shared_ptr<array_value> property;
+        complex_ref<string_value> parent_key;
+        complex_ref<array_value> property;
         auto is_property = is_get_property_request(variable, parent_key, property);
 
         value found_parent;
         // Check if we know about the parent object? (eg: string.length, the parent is the string object)
-        if (builtin_scope.try_get_key(parent_key->data, found_parent))
+        if (builtin_scope.try_get_key(parent_key->to_string(), found_parent))
         {
             // If the get is for a property? (eg: string.length, length is the property)
             if (is_property)
@@ -810,29 +819,29 @@ namespace lysithea_vm
         return result;
     }
 
-    bool assembler::is_get_property_request(const std::string &input, std::shared_ptr<string_value> &parent_key, std::shared_ptr<array_value> &property)
+    bool assembler::is_get_property_request(const std::string &input, complex_ref<string_value> &parent_key, complex_ref<array_value> &property)
     {
         auto find = input.find('.');
         if (find != input.npos)
         {
             auto split = string_split(input, ".");
-            parent_key = std::make_shared<string_value>(split[0]);
+            parent_key = string_value::make(split[0]);
 
             array_vector property_vector;
             for (auto i = 1; i < split.size(); i++)
             {
-                property_vector.emplace_back(std::make_shared<string_value>(split[i]));
+                property_vector.emplace_back(string_value::make(split[i]));
             }
-            property = std::make_shared<array_value>(property_vector, false);
+            property = make_complex<array_value>(property_vector, false);
 
             return true;
         }
 
-        parent_key = std::make_shared<string_value>(input);
+        parent_key = string_value::make(input);
         return false;
     }
 
-    std::shared_ptr<function> assembler::process_temp_function(const std::vector<std::string> &parameters, const assembler::code_line_list &temp_code_lines, const std::string &name)
+    std::shared_ptr<function> assembler::process_temp_function(const std::vector<std::string> &parameters, const assembler::code_line_list &temp_code_lines, const std::string &name, bool resolve_locals)
     {
         std::unordered_map<std::string, int> labels;
         std::vector<code_line> code;
@@ -851,9 +860,226 @@ namespace lysithea_vm
             }
         }
 
+        // The global function's variables live in the global scope so the host can see them.
+        std::vector<std::string> locals;
+        if (resolve_locals)
+        {
+            locals = resolve_local_variables(parameters, code);
+        }
+
+        // Resolve any jumps to labels within this function so they don't need a lookup at runtime,
+        // and intern the names of variables that are still looked up by name.
+        for (auto &line : code)
+        {
+            if (is_jump_operator(line.op) && line.has_value())
+            {
+                auto find = labels.find(line.value.to_string());
+                if (find != labels.end())
+                {
+                    line.index = find->second;
+                }
+            }
+            else if (has_symbol_index(line.op) && line.has_value())
+            {
+                line.index = symbol::intern(line.value.to_string()).id;
+            }
+        }
+
+        auto max_stack_depth = calculate_max_stack_depth(code, labels);
+        script_max_stack_depth = std::max(script_max_stack_depth, max_stack_depth);
+
+        // Superinstructions never need more stack than the lines they replace, so this is done after the depth is known.
+        peephole.optimise(code);
+
         auto symbols = std::make_shared<debug_symbols>(source_name, source_text, locations);
 
-        return std::make_shared<function>(code, parameters, labels, name, symbols);
+        return std::make_shared<function>(code, parameters, locals, labels, name, symbols, max_stack_depth);
+    }
+
+    int assembler::calculate_max_stack_depth(const std::vector<code_line> &code, const std::unordered_map<std::string, int> &labels)
+    {
+        // Depths are relative to the last point the VM checks the stack has enough space:
+        // the start of the function, after calls, after jumps to a label by name and after backward jumps.
+        // Because of that any label could be reached with an empty relative stack.
+        const auto unvisited = std::numeric_limits<int>::min();
+        std::vector<int> depths(code.size() + 1, unvisited);
+        std::vector<int> to_visit;
+
+        auto max_depth = 0;
+        auto visit = [&](int line, int depth)
+        {
+            if (depth > depths[line])
+            {
+                depths[line] = depth;
+                to_visit.push_back(line);
+            }
+        };
+
+        visit(0, 0);
+        for (const auto &iter : labels)
+        {
+            visit(iter.second, 0);
+        }
+
+        while (!to_visit.empty())
+        {
+            auto line = to_visit.back();
+            to_visit.pop_back();
+            if (line >= static_cast<int>(code.size()))
+            {
+                continue;
+            }
+
+            const auto &code_line = code[line];
+            auto depth = depths[line];
+            auto has_value = code_line.has_value();
+            auto num_args = code_line.value.is_number() ? code_line.value.get_int() : 0;
+
+            auto pops = 0;
+            auto pushes = 0;
+            switch (code_line.op)
+            {
+                default: break;
+                case vm_operator::push:
+                case vm_operator::get_local:
+                case vm_operator::add_local:
+                    pushes = 1;
+                    break;
+                case vm_operator::to_argument:
+                case vm_operator::get:
+                    pops = has_value ? 0 : 1;
+                    pushes = 1;
+                    break;
+                case vm_operator::get_property:
+                case vm_operator::add:
+                case vm_operator::sub:
+                case vm_operator::multiply:
+                case vm_operator::divide:
+                case vm_operator::less_than:
+                case vm_operator::less_than_equals:
+                case vm_operator::equals:
+                case vm_operator::not_equals:
+                case vm_operator::greater_than:
+                case vm_operator::greater_than_equals:
+                case vm_operator::less_than_jump_false:
+                case vm_operator::less_than_equals_jump_false:
+                case vm_operator::equals_jump_false:
+                case vm_operator::not_equals_jump_false:
+                case vm_operator::greater_than_jump_false:
+                case vm_operator::greater_than_equals_jump_false:
+                case vm_operator::op_and:
+                case vm_operator::op_or:
+                    pops = has_value ? 1 : 2;
+                    pushes = 1;
+                    break;
+                case vm_operator::op_not:
+                case vm_operator::unary_negative:
+                    pops = 1;
+                    pushes = 1;
+                    break;
+                case vm_operator::set:
+                case vm_operator::define:
+                    pops = has_value ? 1 : 2;
+                    break;
+                case vm_operator::set_local:
+                case vm_operator::define_local:
+                    pops = 1;
+                    break;
+                case vm_operator::jump:
+                case vm_operator::jump_true:
+                case vm_operator::jump_false:
+                    pops = (code_line.op == vm_operator::jump ? 0 : 1) + (has_value ? 0 : 1);
+                    break;
+                case vm_operator::string_concat:
+                case vm_operator::make_array:
+                case vm_operator::make_object:
+                    pops = num_args;
+                    pushes = 1;
+                    break;
+            }
+
+            auto next_depth = depth - pops + pushes;
+            max_depth = std::max(max_depth, next_depth);
+
+            switch (code_line.op)
+            {
+                case vm_operator::call_return:
+                    break;
+                case vm_operator::call:
+                case vm_operator::call_direct:
+                    visit(line + 1, 0);
+                    break;
+                case vm_operator::jump:
+                    if (code_line.index >= 0)
+                    {
+                        visit(code_line.index, code_line.index <= line ? 0 : next_depth);
+                    }
+                    break;
+                case vm_operator::jump_true:
+                case vm_operator::jump_false:
+                    if (code_line.index >= 0)
+                    {
+                        visit(code_line.index, code_line.index <= line ? 0 : next_depth);
+                    }
+                    visit(line + 1, next_depth);
+                    break;
+                default:
+                    visit(line + 1, next_depth);
+                    break;
+            }
+        }
+
+        return max_depth;
+    }
+
+    std::vector<std::string> assembler::resolve_local_variables(const std::vector<std::string> &parameters, std::vector<code_line> &code)
+    {
+        std::vector<std::string> locals;
+        for (const auto &parameter : parameters)
+        {
+            locals.emplace_back(starts_with_unpack(parameter) ? parameter.substr(3) : parameter);
+        }
+
+        for (const auto &line : code)
+        {
+            if (line.op == vm_operator::define && line.has_value())
+            {
+                auto key = line.value.to_string();
+                if (std::find(locals.cbegin(), locals.cend(), key) == locals.cend())
+                {
+                    locals.emplace_back(key);
+                }
+            }
+        }
+
+        // Anything that isn't a parameter or defined in this function is still looked up by name at runtime.
+        for (auto &line : code)
+        {
+            if (!line.has_value())
+            {
+                continue;
+            }
+
+            vm_operator local_op;
+            switch (line.op)
+            {
+                case vm_operator::get: local_op = vm_operator::get_local; break;
+                case vm_operator::set: local_op = vm_operator::set_local; break;
+                case vm_operator::define: local_op = vm_operator::define_local; break;
+                case vm_operator::inc: local_op = vm_operator::inc_local; break;
+                case vm_operator::dec: local_op = vm_operator::dec_local; break;
+                default: continue;
+            }
+
+            auto find = std::find(locals.cbegin(), locals.cend(), line.value.to_string());
+            if (find != locals.cend())
+            {
+                line.op = local_op;
+                line.index = static_cast<int>(find - locals.cbegin());
+            }
+        }
+
+        return locals;
     }
 
     std::string assembler::make_cond_label(int index, int label_num)
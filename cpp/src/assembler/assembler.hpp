@@ -4,9 +4,11 @@
 #include <istream>
 #include <memory>
 #include <vector>
+#include <unordered_map>
 
 #include "./temp_code_line.hpp"
 #include "./token.hpp"
+#include "./peephole_optimiser.hpp"
 
 #include "../values/value.hpp"
 #include "../values/complex_value.hpp"
@@ -41,6 +43,8 @@ namespace lysithea_vm
             static const std::string keyword_return;
 
             scope builtin_scope;
+            // Fusion counts are reset for each script that is parsed.
+            peephole_optimiser peephole;
 
             // Constructor
             assembler();
@@ -75,21 +79,24 @@ namespace lysithea_vm
             code_line_list optimise_get_symbol_value(const token &input, const std::string &variable);
             code_line_list optimise_get(const token &input, const std::string &variable);
 
-            static bool is_get_property_request(const std::string &variable, std::shared_ptr<string_value> &parent_key, std::shared_ptr<array_value> &property);
+            static bool is_get_property_request(const std::string &variable, complex_ref<string_value> &parent_key, complex_ref<array_value> &property);
+            // Also used when loading bytecode, so a corrupt file can't give a function less stack than its code needs.
+            static int calculate_max_stack_depth(const std::vector<code_line> &code, const std::unordered_map<std::string, int> &labels);
 
         private:
             struct loop_labels
             {
                 // Fields
-                std::shared_ptr<string_value> start;
-                std::shared_ptr<string_value> end;
+                complex_ref<string_value> start;
+                complex_ref<string_value> end;
 
                 // Constructor
-                loop_labels(std::shared_ptr<string_value> start, std::shared_ptr<string_value> end): start(start), end(end) { }
+                loop_labels(complex_ref<string_value> start, complex_ref<string_value> end): start(start), end(end) { }
             };
 
             // Fields
             int label_count;
+            int script_max_stack_depth;
             std::vector<loop_labels> loop_stack;
             std::vector<std::string> keyword_parsing_stack;
             std::shared_ptr<scope> const_scope;
@@ -100,7 +107,9 @@ namespace lysithea_vm
             // Methods
             std::shared_ptr<script> parse_from_value(const token &input);
 
-            std::shared_ptr<function> process_temp_function(const std::vector<std::string> &parameters, const code_line_list &temp_code_lines, const std::string &name);
+            std::shared_ptr<function> process_temp_function(const std::vector<std::string> &parameters, const code_line_list &temp_code_lines, const std::string &name, bool resolve_locals);
+
+            static std::vector<std::string> resolve_local_variables(const std::vector<std::string> &parameters, std::vector<code_line> &code);
 
             std::string make_cond_label(int index, int label_num);
 
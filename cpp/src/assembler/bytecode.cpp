@@ -0,0 +1,678 @@
+#include "bytecode.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <unordered_map>
+
+#include "./assembler.hpp"
+#include "../binary_io.hpp"
+#include "../function.hpp"
+#include "../utils.hpp"
+#include "../debug_symbols.hpp"
+#include "../values/array_value.hpp"
+#include "../values/object_value.hpp"
+#include "../values/string_value.hpp"
+#include "../values/variable_value.hpp"
+#include "../values/function_value.hpp"
+#include "../values/builtin_function_value.hpp"
+
+namespace lysithea_vm
+{
+    const std::uint32_t bytecode::version = 1;
+
+    static const char bytecode_magic[4] = { 'L', 'Y', 'S', 'B' };
+    static const std::uint32_t flag_debug_symbols = 1;
+
+    enum class bytecode_value_type : std::uint8_t
+    {
+        undefined, null, is_true, is_false, number, string, variable, array, object, function, builtin
+    };
+
+    static std::vector<std::string> sorted_keys(const std::unordered_map<std::string, int> &input)
+    {
+        std::vector<std::string> result;
+        for (const auto &iter : input)
+        {
+            result.push_back(iter.first);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    class bytecode_writer : public binary_writer
+    {
+        public:
+            // Constructor
+            bytecode_writer(const script &input, bool include_debug_symbols) : input(input), include_debug_symbols(include_debug_symbols) { }
+
+            // Methods
+            void write_script()
+            {
+                builtin_paths = find_builtin_paths(*input.builtin_scope);
+                collect_function(*input.code);
+
+                auto constants = sorted_scope_values(*input.constants);
+                for (const auto &iter : constants)
+                {
+                    collect_value(iter.second);
+                }
+
+                output.insert(output.end(), bytecode_magic, bytecode_magic + sizeof(bytecode_magic));
+                write_u32(bytecode::version);
+                write_u32(include_debug_symbols ? flag_debug_symbols : 0);
+
+                if (include_debug_symbols)
+                {
+                    write_u32(static_cast<std::uint32_t>(source_texts.size()));
+                    for (auto text : source_texts)
+                    {
+                        write_u32(static_cast<std::uint32_t>(text->size()));
+                        for (const auto &line : *text)
+                        {
+                            write_string(line);
+                        }
+                    }
+                }
+
+                write_u32(static_cast<std::uint32_t>(functions.size()));
+                for (auto func : functions)
+                {
+                    write_function(*func);
+                }
+
+                write_u32(static_cast<std::uint32_t>(constants.size()));
+                for (const auto &iter : constants)
+                {
+                    write_string(iter.first);
+                    write_value(iter.second);
+                }
+
+                write_i32(function_ids.at(input.code.get()));
+                write_i32(input.max_stack_depth);
+            }
+
+        private:
+            // Fields
+            const script &input;
+            bool include_debug_symbols;
+
+            std::vector<const function *> functions;
+            std::unordered_map<const function *, int> function_ids;
+            std::vector<const std::vector<std::string> *> source_texts;
+            std::unordered_map<const std::vector<std::string> *, int> source_text_ids;
+            std::unordered_map<const complex_value *, std::string> builtin_paths;
+
+            // Methods
+            void collect_function(const function &input)
+            {
+                if (function_ids.find(&input) != function_ids.end())
+                {
+                    return;
+                }
+
+                function_ids[&input] = static_cast<int>(functions.size());
+                functions.push_back(&input);
+
+                auto text = input.symbols ? input.symbols->full_text.get() : nullptr;
+                if (text && source_text_ids.find(text) == source_text_ids.end())
+                {
+                    source_text_ids[text] = static_cast<int>(source_texts.size());
+                    source_texts.push_back(text);
+                }
+
+                for (const auto &line : input.code)
+                {
+                    collect_value(line.value);
+                }
+            }
+
+            void collect_value(const value &input)
+            {
+                auto func = input.get_complex<const function_value>();
+                if (func)
+                {
+                    collect_function(*func->data);
+                    return;
+                }
+
+                auto array = input.get_complex<const array_value>();
+                if (array)
+                {
+                    for (const auto &iter : array->data)
+                    {
+                        collect_value(iter);
+                    }
+                    return;
+                }
+
+                auto object = input.get_complex<const object_value>();
+                if (object)
+                {
+                    object->for_each([&](const std::string &key, const value &item)
+                    {
+                        collect_value(item);
+                    });
+                }
+            }
+
+            void write_function(const function &input)
+            {
+                write_string(input.has_name ? input.name : "");
+
+                write_u32(static_cast<std::uint32_t>(input.parameters.size()));
+                for (const auto &iter : input.parameters)
+                {
+                    write_string(iter);
+                }
+
+                write_u32(static_cast<std::uint32_t>(input.locals.size()));
+                for (const auto &iter : input.locals)
+                {
+                    write_string(iter);
+                }
+
+                write_u32(static_cast<std::uint32_t>(input.labels.size()));
+                for (const auto &key : sorted_keys(input.labels))
+                {
+                    write_string(key);
+                    write_i32(input.labels.at(key));
+                }
+
+                write_i32(input.max_stack_depth);
+
+                write_u32(static_cast<std::uint32_t>(input.code.size()));
+                for (const auto &line : input.code)
+                {
+                    write_u8(static_cast<std::uint8_t>(line.op));
+                    // Symbol ids are only valid in this process, they are interned again when loading.
+                    write_i32(has_symbol_index(line.op) ? -1 : line.index);
+                    write_value(line.value);
+                }
+
+                write_string(input.symbols ? input.symbols->source_name : "");
+                if (include_debug_symbols)
+                {
+                    auto text = input.symbols ? input.symbols->full_text.get() : nullptr;
+                    write_i32(text ? source_text_ids.at(text) : -1);
+
+                    auto num_locations = input.symbols ? input.symbols->code_line_to_text.size() : 0;
+                    write_u32(static_cast<std::uint32_t>(num_locations));
+                    for (auto i = 0u; i < num_locations; i++)
+                    {
+                        const auto &location = input.symbols->code_line_to_text[i];
+                        write_i32(location.start_line_number);
+                        write_i32(location.start_column_number);
+                        write_i32(location.end_line_number);
+                        write_i32(location.end_column_number);
+                    }
+                }
+            }
+
+            void write_value(const value &input)
+            {
+                if (input.is_undefined())
+                {
+                    write_type(bytecode_value_type::undefined);
+                    return;
+                }
+                if (input.is_null())
+                {
+                    write_type(bytecode_value_type::null);
+                    return;
+                }
+                if (input.is_bool())
+                {
+                    write_type(input.get_bool() ? bytecode_value_type::is_true : bytecode_value_type::is_false);
+                    return;
+                }
+                if (input.is_number())
+                {
+                    write_type(bytecode_value_type::number);
+                    write_f64(input.get_number());
+                    return;
+                }
+
+                auto str = input.get_complex<const string_value>();
+                if (str)
+                {
+                    write_type(bytecode_value_type::string);
+                    write_string(str->to_string());
+                    return;
+                }
+
+                auto variable = input.get_complex<const variable_value>();
+                if (variable)
+                {
+                    write_type(bytecode_value_type::variable);
+                    write_string(variable->data);
+                    return;
+                }
+
+                auto array = input.get_complex<const array_value>();
+                if (array)
+                {
+                    write_type(bytecode_value_type::array);
+                    write_u8(array->is_arguments_value ? 1 : 0);
+                    write_u32(static_cast<std::uint32_t>(array->data.size()));
+                    for (const auto &iter : array->data)
+                    {
+                        write_value(iter);
+                    }
+                    return;
+                }
+
+                auto object = input.get_complex<const object_value>();
+                if (object)
+                {
+                    write_type(bytecode_value_type::object);
+                    write_u32(static_cast<std::uint32_t>(object->size()));
+                    object->for_each([&](const std::string &key, const value &item)
+                    {
+                        write_string(key);
+                        write_value(item);
+                    });
+                    return;
+                }
+
+                auto func = input.get_complex<const function_value>();
+                if (func)
+                {
+                    write_type(bytecode_value_type::function);
+                    write_i32(function_ids.at(func->data.get()));
+                    return;
+                }
+
+                auto builtin = input.get_complex<const builtin_function_value>();
+                if (builtin)
+                {
+                    auto find = builtin_paths.find(builtin.get());
+                    if (find == builtin_paths.end())
+                    {
+                        throw bytecode_error("Unable to save builtin function that is not in the builtin scope");
+                    }
+
+                    write_type(bytecode_value_type::builtin);
+                    write_string(find->second);
+                    return;
+                }
+
+                throw bytecode_error("Unable to save value of type: " + input.type_name());
+            }
+
+            inline void write_type(bytecode_value_type input)
+            {
+                write_u8(static_cast<std::uint8_t>(input));
+            }
+    };
+
+    class bytecode_reader : public binary_reader<bytecode_error>
+    {
+        public:
+            // Constructor
+            bytecode_reader(const std::uint8_t *data, std::size_t size, const scope &builtin_scope) :
+                binary_reader(data, size, "bytecode"), builtin_scope(builtin_scope) { }
+
+            // Methods
+            std::shared_ptr<script> read_script()
+            {
+                if (remaining() < sizeof(bytecode_magic) || std::memcmp(position, bytecode_magic, sizeof(bytecode_magic)) != 0)
+                {
+                    throw bytecode_error("Input is not lysithea bytecode");
+                }
+                position += sizeof(bytecode_magic);
+
+                auto file_version = read_u32();
+                if (file_version != bytecode::version)
+                {
+                    throw bytecode_error("Unsupported bytecode version: " + std::to_string(file_version));
+                }
+
+                auto flags = read_u32();
+                include_debug_symbols = (flags & flag_debug_symbols) != 0;
+
+                if (include_debug_symbols)
+                {
+                    auto num_texts = read_count();
+                    for (auto i = 0u; i < num_texts; i++)
+                    {
+                        auto text = std::make_shared<std::vector<std::string>>();
+                        auto num_lines = read_count();
+                        for (auto j = 0u; j < num_lines; j++)
+                        {
+                            text->push_back(read_string());
+                        }
+                        source_texts.push_back(text);
+                    }
+                }
+
+                // Functions can refer to each other so the values are created first and filled in as they are read.
+                auto num_functions = read_count();
+                for (auto i = 0u; i < num_functions; i++)
+                {
+                    functions.push_back(make_complex<function_value>(function_ptr()));
+                }
+                for (auto &iter : functions)
+                {
+                    iter->data = read_function();
+                }
+
+                auto constants = std::make_shared<scope>();
+                auto num_constants = read_count();
+                for (auto i = 0u; i < num_constants; i++)
+                {
+                    auto key = read_string();
+                    constants->try_set_constant(key, read_value());
+                }
+
+                auto entry = read_function_id();
+                auto max_stack_depth = read_i32();
+                for (const auto &iter : functions)
+                {
+                    max_stack_depth = std::max(max_stack_depth, iter->data->max_stack_depth);
+                }
+
+                auto script_scope = std::make_shared<scope>();
+                script_scope->combine_scope(builtin_scope);
+                script_scope->combine_scope(*constants);
+
+                return std::make_shared<script>(script_scope, constants, functions[entry]->data, max_stack_depth);
+            }
+
+        private:
+            // Fields
+            const scope &builtin_scope;
+            bool include_debug_symbols;
+
+            std::vector<complex_ref<function_value>> functions;
+            std::vector<std::shared_ptr<std::vector<std::string>>> source_texts;
+
+            // Methods
+            function_ptr read_function()
+            {
+                auto name = read_string();
+
+                auto parameters = read_strings();
+                auto locals = read_strings();
+
+                std::unordered_map<std::string, int> labels;
+                auto num_labels = read_count();
+                for (auto i = 0u; i < num_labels; i++)
+                {
+                    auto key = read_string();
+                    labels[key] = read_i32();
+                }
+
+                auto file_max_stack_depth = read_i32();
+
+                std::vector<code_line> code;
+                auto num_lines = read_count();
+                for (auto i = 0u; i < num_lines; i++)
+                {
+                    auto op = read_u8();
+                    if (op > static_cast<std::uint8_t>(vm_operator::get_property_call))
+                    {
+                        throw bytecode_error("Unknown operator in bytecode");
+                    }
+
+                    auto index = read_i32();
+                    code.emplace_back(static_cast<vm_operator>(op), read_value(), index);
+
+                    auto &line = code.back();
+                    if (has_symbol_index(line.op))
+                    {
+                        line.index = line.has_value() ? symbol::intern(line.value.to_string()).id : -1;
+                    }
+                }
+
+                // Parameters are copied into the first locals when the function is called.
+                if (parameters.size() > locals.size())
+                {
+                    throw bytecode_error("More parameters than locals in bytecode");
+                }
+                validate_code(code, locals, labels);
+                auto max_stack_depth = std::max(file_max_stack_depth, assembler::calculate_max_stack_depth(code, labels));
+
+                auto source_name = read_string();
+                auto text = std::make_shared<std::vector<std::string>>();
+                std::vector<code_location> locations;
+                if (include_debug_symbols)
+                {
+                    auto text_id = read_i32();
+                    if (text_id >= 0)
+                    {
+                        if (text_id >= static_cast<int>(source_texts.size()))
+                        {
+                            throw bytecode_error("Invalid source text in bytecode");
+                        }
+                        text = source_texts[text_id];
+                    }
+
+                    auto num_locations = read_count();
+                    for (auto i = 0u; i < num_locations; i++)
+                    {
+                        auto start_line = read_i32();
+                        auto start_column = read_i32();
+                        auto end_line = read_i32();
+                        auto end_column = read_i32();
+                        locations.emplace_back(start_line, start_column, end_line, end_column);
+                    }
+                }
+
+                auto symbols = std::make_shared<debug_symbols>(source_name, text, locations);
+                return std::make_shared<function>(code, parameters, locals, labels, name, symbols, max_stack_depth);
+            }
+
+            // The VM trusts local indices, jump targets and the lines following a superinstruction without checking them.
+            static void validate_code(const std::vector<code_line> &code, const std::vector<std::string> &locals, const std::unordered_map<std::string, int> &labels)
+            {
+                auto num_lines = static_cast<int>(code.size());
+                auto num_locals = static_cast<int>(locals.size());
+                for (const auto &iter : labels)
+                {
+                    if (iter.second < 0 || iter.second > num_lines)
+                    {
+                        throw bytecode_error("Invalid label in bytecode: " + iter.first);
+                    }
+                }
+
+                for (auto i = 0; i < num_lines; i++)
+                {
+                    const auto &line = code[i];
+                    switch (line.op)
+                    {
+                        default: break;
+                        case vm_operator::push:
+                            if (!line.has_value())
+                            {
+                                throw bytecode_error("Push without a value in bytecode");
+                            }
+                            break;
+                        case vm_operator::to_argument:
+                        case vm_operator::get_property:
+                            if (line.has_value() && !line.value.is_array())
+                            {
+                                throw bytecode_error("Invalid property in bytecode");
+                            }
+                            break;
+                        case vm_operator::call:
+                        case vm_operator::make_array:
+                        case vm_operator::make_object:
+                        case vm_operator::string_concat:
+                            validate_count(line.value);
+                            break;
+                        case vm_operator::call_direct:
+                            if (line.value.is_array())
+                            {
+                                const auto &data = line.value.get_complex<const array_value>()->data;
+                                if (data.size() == 2)
+                                {
+                                    validate_count(data[1]);
+                                }
+                            }
+                            break;
+                        case vm_operator::get_local:
+                        case vm_operator::set_local:
+                        case vm_operator::define_local:
+                        case vm_operator::inc_local:
+                        case vm_operator::dec_local:
+                            validate_local(line, num_locals);
+                            break;
+                        case vm_operator::jump:
+                        case vm_operator::jump_true:
+                        case vm_operator::jump_false:
+                            if (line.index < -1 || line.index > num_lines)
+                            {
+                                throw bytecode_error("Invalid jump in bytecode");
+                            }
+                            break;
+                        case vm_operator::less_than_jump_false:
+                        case vm_operator::less_than_equals_jump_false:
+                        case vm_operator::greater_than_jump_false:
+                        case vm_operator::greater_than_equals_jump_false:
+                        case vm_operator::equals_jump_false:
+                        case vm_operator::not_equals_jump_false:
+                            if (i + 1 >= num_lines || code[i + 1].op != vm_operator::jump_false || code[i + 1].index < 0)
+                            {
+                                throw bytecode_error("Invalid superinstruction in bytecode");
+                            }
+                            break;
+                        case vm_operator::add_local:
+                            validate_local(line, num_locals);
+                            if (i + 2 >= num_lines ||
+                                (code[i + 1].op != vm_operator::add && code[i + 1].op != vm_operator::sub) || !code[i + 1].value.is_number() ||
+                                code[i + 2].op != vm_operator::set_local || code[i + 2].index != line.index)
+                            {
+                                throw bytecode_error("Invalid superinstruction in bytecode");
+                            }
+                            break;
+                        case vm_operator::get_property_call:
+                            if (!line.value.is_array() || i + 1 >= num_lines ||
+                                code[i + 1].op != vm_operator::call || !code[i + 1].value.is_number())
+                            {
+                                throw bytecode_error("Invalid superinstruction in bytecode");
+                            }
+                            break;
+                    }
+                }
+            }
+
+            // Counts of arguments to pop off the stack, anything other than a number is already an error in the VM.
+            static void validate_count(const value &input)
+            {
+                if (input.is_number() && !(input.get_number() >= 0 && input.get_number() <= std::numeric_limits<int>::max()))
+                {
+                    throw bytecode_error("Invalid argument count in bytecode");
+                }
+            }
+
+            static void validate_local(const code_line &line, int num_locals)
+            {
+                if (line.index < 0 || line.index >= num_locals)
+                {
+                    throw bytecode_error("Invalid local in bytecode: " + std::to_string(line.index));
+                }
+            }
+
+            value read_value(int depth = 0)
+            {
+                check_value_depth(depth);
+                auto type = static_cast<bytecode_value_type>(read_u8());
+                switch (type)
+                {
+                    case bytecode_value_type::undefined: return value();
+                    case bytecode_value_type::null: return value::make_null();
+                    case bytecode_value_type::is_true: return value(true);
+                    case bytecode_value_type::is_false: return value(false);
+                    case bytecode_value_type::number: return value(read_f64());
+                    case bytecode_value_type::string: return value(read_string());
+                    case bytecode_value_type::variable: return value(make_complex<variable_value>(read_string()));
+                    case bytecode_value_type::array:
+                    {
+                        auto is_arguments_value = read_u8() != 0;
+                        array_vector data;
+                        auto count = read_count();
+                        for (auto i = 0u; i < count; i++)
+                        {
+                            data.push_back(read_value(depth + 1));
+                        }
+                        return array_value::make_value(data, is_arguments_value);
+                    }
+                    case bytecode_value_type::object:
+                    {
+                        object_map data;
+                        auto count = read_count();
+                        for (auto i = 0u; i < count; i++)
+                        {
+                            auto key = read_string();
+                            data[key] = read_value(depth + 1);
+                        }
+                        return object_value::make_value(data);
+                    }
+                    case bytecode_value_type::function: return value(functions[read_function_id()]);
+                    case bytecode_value_type::builtin: return find_builtin(read_string());
+                    default: break;
+                }
+
+                throw bytecode_error("Unknown value type in bytecode");
+            }
+
+            value find_builtin(const std::string &path)
+            {
+                value result;
+                if (!try_find_builtin(builtin_scope, path, result))
+                {
+                    throw bytecode_error("Unable to find builtin function: " + path);
+                }
+                return result;
+            }
+
+            int read_function_id()
+            {
+                auto id = read_i32();
+                if (id < 0 || id >= static_cast<int>(functions.size()))
+                {
+                    throw bytecode_error("Invalid function in bytecode");
+                }
+                return id;
+            }
+
+            std::vector<std::string> read_strings()
+            {
+                std::vector<std::string> result;
+                auto count = read_count();
+                for (auto i = 0u; i < count; i++)
+                {
+                    result.push_back(read_string());
+                }
+                return result;
+            }
+    };
+
+    std::vector<std::uint8_t> bytecode::save_script(const script &input, bool include_debug_symbols)
+    {
+        bytecode_writer writer(input, include_debug_symbols);
+        writer.write_script();
+        return writer.output;
+    }
+
+    void bytecode::save_script(const script &input, std::ostream &output, bool include_debug_symbols)
+    {
+        auto data = save_script(input, include_debug_symbols);
+        output.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+
+    std::shared_ptr<script> bytecode::load_script(const void *data, std::size_t size, const scope &builtin_scope)
+    {
+        bytecode_reader reader(static_cast<const std::uint8_t *>(data), size, builtin_scope);
+        return reader.read_script();
+    }
+
+    std::shared_ptr<script> bytecode::load_script(std::istream &input, const scope &builtin_scope)
+    {
+        std::vector<char> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        return load_script(data.data(), data.size(), builtin_scope);
+    }
+} // lysithea_vm
\ No newline at end of file
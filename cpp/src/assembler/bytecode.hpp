@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <memory>
+#include <vector>
+
+#include "../script.hpp"
+#include "../scope.hpp"
+#include "../errors/bytecode_error.hpp"
+
+namespace lysithea_vm
+{
+    // Saves and loads assembled scripts in a binary format so they don't need to be parsed again.
+    // Builtin functions are stored by their path in the builtin scope (eg "math.sin") and are looked up again when loading.
+    class bytecode
+    {
+        public:
+            // Fields
+            static const std::uint32_t version;
+
+            // Methods
+            static std::vector<std::uint8_t> save_script(const script &input, bool include_debug_symbols = true);
+            static void save_script(const script &input, std::ostream &output, bool include_debug_symbols = true);
+
+            // The data is only read during the call, so it can come straight from a memory mapped file.
+            static std::shared_ptr<script> load_script(const void *data, std::size_t size, const scope &builtin_scope);
+            static std::shared_ptr<script> load_script(std::istream &input, const scope &builtin_scope);
+    };
+} // lysithea_vm
\ No newline at end of file
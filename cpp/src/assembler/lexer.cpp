@@ -136,10 +136,10 @@ namespace lysithea_vm
         if ((first == '"' && last == '"') ||
             (first == '\'' && last == '\''))
         {
-            return value(std::make_shared<string_value>(input.substr(1, input.size() - 2)));
+            return value(string_value::make(input.substr(1, input.size() - 2)));
         }
 
-        return value(std::make_shared<variable_value>(input));
+        return value(make_complex<variable_value>(input));
     }
 
 } // lysithea_vm
\ No newline at end of file
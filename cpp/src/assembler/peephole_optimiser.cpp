@@ -0,0 +1,80 @@
+#include "peephole_optimiser.hpp"
+
+#include "../utils.hpp"
+
+namespace lysithea_vm
+{
+    void peephole_optimiser::set_enabled(bool enabled)
+    {
+        fuse_compare_jump = enabled;
+        fuse_local_math = enabled;
+        fuse_property_call = enabled;
+    }
+
+    void peephole_optimiser::optimise(std::vector<code_line> &code)
+    {
+        auto size = static_cast<int>(code.size());
+        for (auto i = 0; i < size - 1; i++)
+        {
+            auto &line = code[i];
+            const auto &next = code[i + 1];
+
+            auto fused_op = vm_operator::unknown;
+            if (fuse_compare_jump && next.op == vm_operator::jump_false && next.index >= 0)
+            {
+                fused_op = get_compare_jump(line.op);
+            }
+            else if (fuse_local_math && i < size - 2 && is_local_math(line, next, code[i + 2]))
+            {
+                fused_op = vm_operator::add_local;
+            }
+            else if (fuse_property_call && line.op == vm_operator::get_property && line.value.is_array() &&
+                next.op == vm_operator::call && next.value.is_number())
+            {
+                fused_op = vm_operator::get_property_call;
+            }
+
+            if (fused_op != vm_operator::unknown)
+            {
+                line.op = fused_op;
+                fusion_counts[fused_op]++;
+            }
+        }
+    }
+
+    void peephole_optimiser::reset_counts()
+    {
+        fusion_counts.clear();
+    }
+
+    void peephole_optimiser::print_fusion_counts(std::ostream &output) const
+    {
+        for (const auto &iter : fusion_counts)
+        {
+            output << to_string(iter.first) << ": " << iter.second << '\n';
+        }
+    }
+
+    vm_operator peephole_optimiser::get_compare_jump(vm_operator compare_op)
+    {
+        switch (compare_op)
+        {
+            case vm_operator::less_than: return vm_operator::less_than_jump_false;
+            case vm_operator::less_than_equals: return vm_operator::less_than_equals_jump_false;
+            case vm_operator::equals: return vm_operator::equals_jump_false;
+            case vm_operator::not_equals: return vm_operator::not_equals_jump_false;
+            case vm_operator::greater_than: return vm_operator::greater_than_jump_false;
+            case vm_operator::greater_than_equals: return vm_operator::greater_than_equals_jump_false;
+            default: return vm_operator::unknown;
+        }
+    }
+
+    bool peephole_optimiser::is_local_math(const code_line &get_line, const code_line &math_line, const code_line &set_line)
+    {
+        return get_line.op == vm_operator::get_local &&
+            (math_line.op == vm_operator::add || math_line.op == vm_operator::sub) &&
+            math_line.value.is_number() &&
+            set_line.op == vm_operator::set_local &&
+            set_line.index == get_line.index;
+    }
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <vector>
+
+#include "../code_line.hpp"
+#include "../operator.hpp"
+
+namespace lysithea_vm
+{
+    // Fuses common sequences of code lines into superinstructions.
+    // Fused lines are replaced in place and the lines they cover are left as they were,
+    // so labels, jump targets and debug symbols don't need to change and a jump into the middle of a sequence still works.
+    class peephole_optimiser
+    {
+        public:
+            // Fields
+            // A comparison followed by a jump_false to a known line.
+            bool fuse_compare_jump;
+            // A get_local, add or sub of a constant number and a set_local of the same local.
+            bool fuse_local_math;
+            // A get_property with a known property followed by a call.
+            bool fuse_property_call;
+
+            // How many times each superinstruction was created since the counts were last reset.
+            std::map<vm_operator, int> fusion_counts;
+
+            // Constructor
+            peephole_optimiser() : fuse_compare_jump(true), fuse_local_math(true), fuse_property_call(true) { }
+
+            // Methods
+            void set_enabled(bool enabled);
+            void optimise(std::vector<code_line> &code);
+
+            void reset_counts();
+            void print_fusion_counts(std::ostream &output) const;
+
+        private:
+            // Methods
+            static vm_operator get_compare_jump(vm_operator compare_op);
+            static bool is_local_math(const code_line &get_line, const code_line &math_line, const code_line &set_line);
+    };
+} // lysithea_vm
\ No newline at end of file
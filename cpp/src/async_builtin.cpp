@@ -0,0 +1,104 @@
+#include "async_builtin.hpp"
+
+#include <stdexcept>
+
+#include "./virtual_machine.hpp"
+
+namespace lysithea_vm
+{
+    void async_operation::complete(value result)
+    {
+        finish([result](virtual_machine &vm)
+        {
+            vm.push_stack(result);
+        }, nullptr);
+    }
+
+    void async_operation::complete()
+    {
+        finish(nullptr, nullptr);
+    }
+
+    void async_operation::complete_with(std::function<void(virtual_machine &)> action)
+    {
+        finish(action, nullptr);
+    }
+
+    void async_operation::fail(std::exception_ptr error)
+    {
+        finish(nullptr, error);
+    }
+
+    bool async_operation::is_complete() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return completed;
+    }
+
+    void async_operation::on_complete(std::function<void()> callback)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!completed)
+            {
+                this->callback = callback;
+                return;
+            }
+        }
+
+        callback();
+    }
+
+    void async_operation::finish(std::function<void(virtual_machine &)> action, std::exception_ptr error)
+    {
+        std::function<void()> to_call;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (completed)
+            {
+                throw std::runtime_error("Async operation has already been completed");
+            }
+
+            completed = true;
+            this->action = action;
+            this->error = error;
+            to_call.swap(callback);
+        }
+
+        // Called outside of the lock, it could run the VM straight away.
+        if (to_call)
+        {
+            to_call();
+        }
+    }
+
+    void async_operation::apply(virtual_machine &vm)
+    {
+        std::function<void(virtual_machine &)> to_run;
+        std::exception_ptr to_throw;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            to_run.swap(action);
+            to_throw = error;
+        }
+
+        if (to_throw)
+        {
+            std::rethrow_exception(to_throw);
+        }
+        if (to_run)
+        {
+            to_run(vm);
+        }
+    }
+
+    builtin_function_callback make_async_builtin(async_builtin_callback callback)
+    {
+        return [callback](virtual_machine &vm, const arguments_view &args)
+        {
+            auto operation = std::make_shared<async_operation>();
+            callback(vm, args, operation);
+            vm.wait_for(operation);
+        };
+    }
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "./values/value.hpp"
+#include "./values/builtin_function_value.hpp"
+
+namespace lysithea_vm
+{
+    class virtual_machine;
+    class arguments_view;
+
+    // Something a VM is waiting on before it can carry on after an async builtin. The host completes it once, from any
+    // thread, and the VM uses the result the next time it is run.
+    class async_operation
+    {
+        public:
+            // Constructor
+            async_operation() : completed(false) { }
+
+            async_operation(const async_operation &other) = delete;
+            async_operation &operator=(const async_operation &other) = delete;
+
+            // Methods
+            // The result is pushed onto the VM's stack as the return value of the builtin.
+            void complete(value result);
+            // For builtins that don't return anything.
+            void complete();
+            // Runs the action on the VM's thread when it carries on, as if the builtin had done it before returning.
+            void complete_with(std::function<void(virtual_machine &)> action);
+            // The exception is thrown from the VM when it carries on.
+            void fail(std::exception_ptr error);
+
+            bool is_complete() const;
+
+            // Called once the operation is complete, straight away if it already is. Replaces any earlier callback.
+            // This is how whatever is running the VM finds out it can run it again.
+            void on_complete(std::function<void()> callback);
+
+        private:
+            // Fields
+            mutable std::mutex lock;
+            bool completed;
+            std::function<void(virtual_machine &)> action;
+            std::exception_ptr error;
+            std::function<void()> callback;
+
+            // Methods
+            void finish(std::function<void(virtual_machine &)> action, std::exception_ptr error);
+            // Called by the VM once it is complete.
+            void apply(virtual_machine &vm);
+
+            friend class virtual_machine;
+    };
+
+    // The arguments are only valid until the callback returns, the operation can be completed at any time after that.
+    using async_builtin_callback = std::function<void(virtual_machine &, const arguments_view &, std::shared_ptr<async_operation>)>;
+
+    // Wraps an async callback as a normal builtin. Calling it pauses the VM until the operation is complete, unless it is
+    // completed before the callback returns.
+    builtin_function_callback make_async_builtin(async_builtin_callback callback);
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+// The rest of the VM only needs C++11, this header is empty unless it's compiled as C++20 or later.
+#if __cplusplus >= 202002L
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "async_builtin.hpp"
+#include "virtual_machine.hpp"
+
+namespace lysithea_vm
+{
+    // The return type of a coroutine used as an async builtin. The coroutine starts straight away and the VM waits until it
+    // has finished, so it can co_await anything the host provides. Returning an undefined value doesn't push anything onto
+    // the stack, and an exception is thrown from the VM when it carries on.
+    // A promise can't have both return_value and return_void, so a coroutine that has nothing to return has to finish
+    // with co_return value(); as a plain co_return; won't compile.
+    class async_builtin_task
+    {
+        public:
+            // Types
+            class promise_type
+            {
+                public:
+                    // Fields
+                    const std::shared_ptr<async_operation> operation;
+
+                    // Constructor
+                    promise_type() : operation(std::make_shared<async_operation>()) { }
+
+                    // Methods
+                    inline async_builtin_task get_return_object() { return async_builtin_task(operation); }
+                    inline std::suspend_never initial_suspend() noexcept { return { }; }
+                    inline std::suspend_never final_suspend() noexcept { return { }; }
+
+                    void return_value(value result)
+                    {
+                        if (result.is_undefined())
+                        {
+                            operation->complete();
+                        }
+                        else
+                        {
+                            operation->complete(std::move(result));
+                        }
+                    }
+
+                    inline void unhandled_exception() { operation->fail(std::current_exception()); }
+            };
+
+            // Fields
+            const std::shared_ptr<async_operation> operation;
+
+            // Constructor
+            explicit async_builtin_task(std::shared_ptr<async_operation> operation) : operation(operation) { }
+    };
+
+    // The arguments are copied for the coroutine as the VM's stack will have moved on by the time it resumes. The VM should
+    // only be used before the first co_await, after that it may be running another script or fiber.
+    using async_builtin_coroutine = std::function<async_builtin_task(virtual_machine &, std::vector<value>)>;
+
+    // Wraps a coroutine as a normal builtin, the same as make_async_builtin.
+    inline builtin_function_callback make_coroutine_builtin(async_builtin_coroutine coroutine)
+    {
+        return [coroutine](virtual_machine &vm, const arguments_view &args)
+        {
+            auto task = coroutine(vm, std::vector<value>(args.begin(), args.end()));
+            vm.wait_for(task.operation);
+        };
+    }
+} // lysithea_vm
+
+#endif
\ No newline at end of file
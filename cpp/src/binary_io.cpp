@@ -0,0 +1,88 @@
+#include "binary_io.hpp"
+
+#include <algorithm>
+
+#include "./scope.hpp"
+#include "./values/object_value.hpp"
+#include "./values/builtin_function_value.hpp"
+
+namespace lysithea_vm
+{
+    static const int max_builtin_path_depth = 3;
+
+    static void add_builtin_paths(std::unordered_map<const complex_value *, std::string> &result, const std::string &path, const value &input, int depth)
+    {
+        auto builtin = input.get_complex<const builtin_function_value>();
+        if (builtin)
+        {
+            result.emplace(builtin.get(), path);
+            return;
+        }
+
+        auto object = input.get_complex<const object_value>();
+        if (object && depth < max_builtin_path_depth)
+        {
+            object->for_each([&](const std::string &key, const value &item)
+            {
+                add_builtin_paths(result, path + "." + key, item, depth + 1);
+            });
+        }
+    }
+
+    std::vector<std::pair<std::string, value>> sorted_scope_values(const scope &input)
+    {
+        std::vector<std::pair<std::string, value>> result;
+        for (const auto &iter : input.values)
+        {
+            result.emplace_back(iter.first.to_string(), iter.second);
+        }
+        std::sort(result.begin(), result.end(), [](const std::pair<std::string, value> &left, const std::pair<std::string, value> &right)
+        {
+            return left.first < right.first;
+        });
+        return result;
+    }
+
+    std::unordered_map<const complex_value *, std::string> find_builtin_paths(const scope &builtin_scope)
+    {
+        std::unordered_map<const complex_value *, std::string> result;
+        for (const auto &iter : sorted_scope_values(builtin_scope))
+        {
+            add_builtin_paths(result, iter.first, iter.second, 1);
+        }
+        return result;
+    }
+
+    bool try_find_builtin(const scope &builtin_scope, const std::string &path, value &result)
+    {
+        auto dot = path.find('.');
+        if (!builtin_scope.try_get_key(path.substr(0, dot), result))
+        {
+            return false;
+        }
+
+        while (dot != std::string::npos)
+        {
+            auto next_dot = path.find('.', dot + 1);
+            auto key = path.substr(dot + 1, next_dot == std::string::npos ? std::string::npos : next_dot - dot - 1);
+            if (!result.is_complex() || !result.get_complex()->try_get(key, result))
+            {
+                return false;
+            }
+            dot = next_dot;
+        }
+
+        return result.is_function();
+    }
+
+    std::uint64_t content_hash(const std::vector<std::uint8_t> &input)
+    {
+        std::uint64_t result = 14695981039346656037ull;
+        for (auto iter : input)
+        {
+            result ^= iter;
+            result *= 1099511628211ull;
+        }
+        return result;
+    }
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "./values/value.hpp"
+
+namespace lysithea_vm
+{
+    class scope;
+
+    // Arrays and objects are read and written recursively, deeper values are rejected instead of overflowing the C++ stack.
+    const int max_value_depth = 1024;
+
+    // Little endian primitives shared by the bytecode and snapshot formats.
+    class binary_writer
+    {
+        public:
+            // Fields
+            std::vector<std::uint8_t> output;
+
+            // Methods
+            inline void write_u8(std::uint8_t input)
+            {
+                output.push_back(input);
+            }
+
+            inline void write_u32(std::uint32_t input)
+            {
+                for (auto i = 0; i < 4; i++)
+                {
+                    output.push_back(static_cast<std::uint8_t>(input >> (i * 8)));
+                }
+            }
+
+            inline void write_i32(std::int32_t input)
+            {
+                write_u32(static_cast<std::uint32_t>(input));
+            }
+
+            inline void write_u64(std::uint64_t input)
+            {
+                for (auto i = 0; i < 8; i++)
+                {
+                    output.push_back(static_cast<std::uint8_t>(input >> (i * 8)));
+                }
+            }
+
+            inline void write_f64(double input)
+            {
+                std::uint64_t bits;
+                std::memcpy(&bits, &input, sizeof(bits));
+                write_u64(bits);
+            }
+
+            inline void write_string(const std::string &input)
+            {
+                write_u32(static_cast<std::uint32_t>(input.size()));
+                output.insert(output.end(), input.begin(), input.end());
+            }
+    };
+
+    // Throws error_type when reading past the end of the data.
+    template <typename error_type>
+    class binary_reader
+    {
+        public:
+            // Constructor
+            binary_reader(const std::uint8_t *data, std::size_t size, const char *format_name) :
+                position(data), end(data + size), format_name(format_name) { }
+
+        protected:
+            // Fields
+            const std::uint8_t *position;
+            const std::uint8_t *end;
+
+            // Methods
+            inline void check_value_depth(int depth) const
+            {
+                if (depth > max_value_depth)
+                {
+                    throw error_type(std::string("Values are nested too deeply in ") + format_name);
+                }
+            }
+
+            inline std::size_t remaining() const
+            {
+                return static_cast<std::size_t>(end - position);
+            }
+
+            inline void require(std::size_t size)
+            {
+                if (remaining() < size)
+                {
+                    throw error_type(std::string("Unexpected end of ") + format_name);
+                }
+            }
+
+            inline std::uint8_t read_u8()
+            {
+                require(1);
+                return *position++;
+            }
+
+            inline std::uint32_t read_u32()
+            {
+                require(4);
+                std::uint32_t result = 0;
+                for (auto i = 0; i < 4; i++)
+                {
+                    result |= static_cast<std::uint32_t>(*position++) << (i * 8);
+                }
+                return result;
+            }
+
+            // Counts are checked against the remaining data so a corrupt count can't cause a huge allocation.
+            inline std::uint32_t read_count()
+            {
+                auto result = read_u32();
+                if (result > remaining())
+                {
+                    throw error_type(std::string("Unexpected end of ") + format_name);
+                }
+                return result;
+            }
+
+            inline std::int32_t read_i32()
+            {
+                return static_cast<std::int32_t>(read_u32());
+            }
+
+            inline std::uint64_t read_u64()
+            {
+                require(8);
+                std::uint64_t result = 0;
+                for (auto i = 0; i < 8; i++)
+                {
+                    result |= static_cast<std::uint64_t>(*position++) << (i * 8);
+                }
+                return result;
+            }
+
+            inline double read_f64()
+            {
+                auto bits = read_u64();
+                double result;
+                std::memcpy(&result, &bits, sizeof(result));
+                return result;
+            }
+
+            inline std::string read_string()
+            {
+                auto size = read_count();
+                std::string result(reinterpret_cast<const char *>(position), size);
+                position += size;
+                return result;
+            }
+
+        private:
+            // Fields
+            const char *format_name;
+    };
+
+    // The keys and values of the scope sorted by key, so that anything saved from it comes out the same every time.
+    std::vector<std::pair<std::string, value>> sorted_scope_values(const scope &input);
+
+    // Builtin functions are saved by their path in the builtin scope (eg "math.sin") and are looked up again when loading.
+    std::unordered_map<const complex_value *, std::string> find_builtin_paths(const scope &builtin_scope);
+    bool try_find_builtin(const scope &builtin_scope, const std::string &path, value &result);
+
+    // 64 bit FNV-1a, for checking saved data belongs with something else rather than for security.
+    std::uint64_t content_hash(const std::vector<std::uint8_t> &input);
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "block_pool.hpp"
+
+#include <new>
+
+namespace lysithea_vm
+{
+    namespace
+    {
+        const std::size_t size_classes = block_pool::max_block_size / block_pool::granularity;
+
+        class free_block
+        {
+            public:
+                // Fields
+                free_block *next;
+        };
+
+        class thread_free_lists
+        {
+            public:
+                // Fields
+                free_block *heads[size_classes];
+                std::size_t counts[size_classes];
+
+                // Constructor
+                thread_free_lists() : heads(), counts() { }
+                ~thread_free_lists();
+        };
+
+        // Values can still be freed by static destructors after the thread's lists are gone, so that is
+        // tracked separately in something that is never destroyed.
+        thread_local bool lists_destroyed = false;
+        thread_local thread_free_lists lists;
+
+        thread_free_lists::~thread_free_lists()
+        {
+            lists_destroyed = true;
+            for (auto i = 0u; i < size_classes; i++)
+            {
+                auto current = heads[i];
+                while (current)
+                {
+                    auto next = current->next;
+                    ::operator delete(current);
+                    current = next;
+                }
+            }
+        }
+
+        inline std::size_t size_class(std::size_t size)
+        {
+            return (size + block_pool::granularity - 1) / block_pool::granularity - 1;
+        }
+    }
+
+    void *block_pool::allocate(std::size_t size)
+    {
+        if (size == 0 || size > max_block_size)
+        {
+            return ::operator new(size);
+        }
+
+        // Always allocate the whole size class, the block could be freed on a thread that puts it in a list.
+        auto index = size_class(size);
+        if (!lists_destroyed && lists.heads[index])
+        {
+            auto block = lists.heads[index];
+            lists.heads[index] = block->next;
+            lists.counts[index]--;
+            return block;
+        }
+
+        return ::operator new((index + 1) * granularity);
+    }
+
+    void block_pool::deallocate(void *ptr, std::size_t size)
+    {
+        if (size == 0 || size > max_block_size || lists_destroyed)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+
+        auto index = size_class(size);
+        if (lists.counts[index] >= max_free_blocks)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+
+        auto block = static_cast<free_block *>(ptr);
+        block->next = lists.heads[index];
+        lists.heads[index] = block;
+        lists.counts[index]++;
+    }
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+
+namespace lysithea_vm
+{
+    // Free lists of small blocks of memory by size class. Each thread keeps its own lists so there is no locking, a block
+    // can be freed on a different thread to the one that allocated it and just ends up in that thread's list.
+    class block_pool
+    {
+        public:
+            // Fields
+            static const std::size_t granularity = 16;
+            static const std::size_t max_block_size = 256;
+            // The most free blocks kept for each size class per thread, anything freed past this goes back to the heap.
+            static const std::size_t max_free_blocks = 1024;
+
+            // Methods
+            static void *allocate(std::size_t size);
+            static void deallocate(void *ptr, std::size_t size);
+
+        private:
+            // Constructor
+            block_pool() { }
+    };
+
+    // Lets std::allocate_shared put the control block and the object in one pooled block.
+    template <typename T>
+    class pool_allocator
+    {
+        public:
+            // Types
+            using value_type = T;
+
+            // Constructor
+            pool_allocator() { }
+            template <typename U>
+            pool_allocator(const pool_allocator<U> &) { }
+
+            // Methods
+            inline T *allocate(std::size_t count)
+            {
+                return static_cast<T *>(block_pool::allocate(count * sizeof(T)));
+            }
+            inline void deallocate(T *ptr, std::size_t count)
+            {
+                block_pool::deallocate(ptr, count * sizeof(T));
+            }
+    };
+
+    template <typename T, typename U>
+    inline bool operator==(const pool_allocator<T> &left, const pool_allocator<U> &right) { return true; }
+    template <typename T, typename U>
+    inline bool operator!=(const pool_allocator<T> &left, const pool_allocator<U> &right) { return false; }
+} // lysithea_vm
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <sstream>
 
 #include "operator.hpp"
+#include "inline_cache.hpp"
 #include "./values/value.hpp"
 
 namespace lysithea_vm
@@ -16,16 +17,24 @@ namespace lysithea_vm
             // Fields
             vm_operator op;
             lysithea_vm::value value;
+            // Resolved program counter for jumps, slot for local variables or symbol id for other variables,
+            // -1 when it has to be looked up at runtime.
+            int index;
+            // Used by get_property lines to remember where the property was found in the last object.
+            inline_cache cache;
+            // Used by get lines to remember which scope the variable was found in.
+            binding_cache cached_binding;
 
             // Constructor
-            code_line(vm_operator op) : op(op)
+            code_line(vm_operator op) : op(op), index(-1)
             {
                 if (op == vm_operator::push)
                 {
                     throw std::runtime_error("Cannot create code line of push without arg");
                 }
             }
-            code_line(vm_operator op, lysithea_vm::value input) : op(op), value(input)
+            code_line(vm_operator op, lysithea_vm::value input) : code_line(op, input, -1) { }
+            code_line(vm_operator op, lysithea_vm::value input, int index) : op(op), value(input), index(index)
             {
                 if (op == vm_operator::push && input.is_undefined())
                 {
@@ -12,9 +12,9 @@ namespace lysithea_vm
     {
         public:
             // Fields
-            std::string source_name;
-            std::shared_ptr<std::vector<std::string>> full_text;
-            std::vector<code_location> code_line_to_text;
+            const std::string source_name;
+            const std::shared_ptr<const std::vector<std::string>> full_text;
+            const std::vector<code_location> code_line_to_text;
 
             // Constructor
             debug_symbols(const std::string &source_name, std::shared_ptr<std::vector<std::string>> full_text, const std::vector<code_location> &code_line_to_text):
@@ -24,7 +24,7 @@ namespace lysithea_vm
             }
 
             // Methods
-            bool try_get_location(int line, code_location &result)
+            bool try_get_location(int line, code_location &result) const
             {
                 if (line >= 0 && line < code_line_to_text.size())
                 {
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+namespace lysithea_vm
+{
+    class snapshot_error : public std::runtime_error
+    {
+        public:
+            // Fields
+            std::string message;
+
+            // Constructor
+            snapshot_error(const std::string &message):
+                message(message), std::runtime_error(message.c_str()) { }
+
+            // Methods
+    };
+} // lysithea_vm
\ No newline at end of file
@@ -1,69 +1,151 @@
 #pragma once
 
 #include <vector>
+#include <utility>
 #include <exception>
 
 namespace lysithea_vm
 {
-    template <typename T>
+    // Bounds policies for fixed_stack pushes.
+    // Unchecked pushes are only safe when the maximum depth has already been verified ahead of time.
+    struct checked_stack_bounds
+    {
+        static const bool check_push = true;
+    };
+
+    struct unchecked_stack_bounds
+    {
+        static const bool check_push = false;
+    };
+
+    template <typename T, typename bounds_policy = checked_stack_bounds>
     class fixed_stack
     {
         public:
             // Fields
 
             // Constructor
-            fixed_stack(int size) : max_size(size) { }
+            // All of the storage is allocated up front, so pointers into the stack stay valid while pushing.
+            fixed_stack(int size) : data(size), count(0), max_size(size) { }
 
             // Methods
             inline void clear()
             {
-                data.clear();
+                for (auto i = 0; i < count; i++)
+                {
+                    data[i] = T();
+                }
+                count = 0;
             }
 
             inline bool pop(T &result)
             {
-                if (stack_size() > 0)
+                if (count > 0)
                 {
-                    result = data.back();
-                    data.pop_back();
+                    result = std::move(data[--count]);
                     return true;
                 }
 
                 return false;
             }
 
-            inline bool push(T value)
+            inline bool pop_n(int num)
             {
-                if (stack_size() < max_size)
+                if (num > count)
                 {
-                    data.emplace_back(value);
-                    return true;
+                    return false;
                 }
 
-                return false;
+                for (auto i = 0; i < num; i++)
+                {
+                    data[--count] = T();
+                }
+                return true;
+            }
+
+            inline bool push(const T &value)
+            {
+                if (bounds_policy::check_push && count >= max_size)
+                {
+                    return false;
+                }
+
+                data[count++] = value;
+                return true;
+            }
+
+            inline bool push(T &&value)
+            {
+                if (bounds_policy::check_push && count >= max_size)
+                {
+                    return false;
+                }
+
+                data[count++] = std::move(value);
+                return true;
             }
 
-            inline bool peek(T& result) const
+            inline bool push_n(const T *values, int num)
             {
-                if (data.size() == 0)
+                if (bounds_policy::check_push && count + num > max_size)
                 {
                     return false;
                 }
 
-                result = data.back();
+                for (auto i = 0; i < num; i++)
+                {
+                    data[count++] = values[i];
+                }
                 return true;
             }
 
-            inline int stack_size() const { return static_cast<int>(data.size()); }
+            // Returns a reference to the top of the stack, the stack must not be empty.
+            inline T &peek() { return data[count - 1]; }
+            inline const T &peek() const { return data[count - 1]; }
+
+            inline bool peek(T &result) const
+            {
+                if (count == 0)
+                {
+                    return false;
+                }
+
+                result = data[count - 1];
+                return true;
+            }
 
-            const std::vector<T> stack_data() const
+            // Removes num items starting at index, anything above them is moved down.
+            inline void erase(int index, int num)
             {
-                return data;
+                if (index >= count || num <= 0)
+                {
+                    return;
+                }
+
+                auto end = index + num < count ? index + num : count;
+                auto new_count = count - (end - index);
+                for (auto i = end; i < count; i++)
+                {
+                    data[index++] = std::move(data[i]);
+                }
+                for (auto i = new_count; i < count; i++)
+                {
+                    data[i] = T();
+                }
+                count = new_count;
             }
 
+            inline bool empty() const { return count == 0; }
+            inline int stack_size() const { return count; }
+            inline int capacity() const { return max_size; }
+            inline T &at(int index) { return data[index]; }
+            inline const T &at(int index) const { return data[index]; }
+            inline const T *top_data(int num) const { return data.data() + (count - num); }
+
         private:
             // Fields
             std::vector<T> data;
+            int count;
             int max_size;
 
             // Methods
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <string>
@@ -7,6 +8,7 @@
 
 #include "./code_line.hpp"
 #include "./debug_symbols.hpp"
+#include "./symbol.hpp"
 
 namespace lysithea_vm
 {
@@ -17,14 +19,76 @@ namespace lysithea_vm
             const std::string name;
             const std::vector<code_line> code;
             const std::vector<std::string> parameters;
+            // Names of the slot indexed local variables, the parameters always come first.
+            const std::vector<std::string> locals;
+            const std::vector<symbol> local_symbols;
+            // A bit for each local from local_mask_bit.
+            const std::uint64_t locals_mask;
             const std::unordered_map<std::string, int> labels;
-            std::shared_ptr<debug_symbols> symbols;
+            const std::shared_ptr<const debug_symbols> symbols;
             const bool has_name;
+            // If the code still uses the name based define then calls need their own scope.
+            const bool needs_scope;
+            // The most the operand stack can grow between the points where the VM checks for space.
+            const int max_stack_depth;
 
             // Constructor
-            function(const std::vector<code_line> &code, const std::vector<std::string> &parameters, const std::unordered_map<std::string, int> &labels, const std::string &name, std::shared_ptr<debug_symbols> debug_symbols) :
-                name(name.size() > 0 ? name : "anonymous"), code(code), parameters(parameters), labels(labels), has_name(name.size() > 0), symbols(debug_symbols) { }
+            function(const std::vector<code_line> &code, const std::vector<std::string> &parameters, const std::vector<std::string> &locals, const std::unordered_map<std::string, int> &labels, const std::string &name, std::shared_ptr<debug_symbols> debug_symbols, int max_stack_depth) :
+                name(name.size() > 0 ? name : "anonymous"), code(code), parameters(parameters), locals(locals), local_symbols(intern_all(locals)), locals_mask(make_locals_mask(local_symbols)), labels(labels), has_name(name.size() > 0), symbols(debug_symbols), needs_scope(has_define(code)), max_stack_depth(max_stack_depth) { }
 
             // Methods
+            // Symbols can share a bit, so a set bit only means the function may have a local with that name.
+            static inline std::uint64_t local_mask_bit(symbol key)
+            {
+                return 1ull << (key.id & 63);
+            }
+
+            inline int local_index(symbol key) const
+            {
+                for (std::size_t i = 0; i < local_symbols.size(); i++)
+                {
+                    if (local_symbols[i] == key)
+                    {
+                        return static_cast<int>(i);
+                    }
+                }
+
+                return -1;
+            }
+
+        private:
+            // Methods
+            static std::vector<symbol> intern_all(const std::vector<std::string> &names)
+            {
+                std::vector<symbol> result;
+                for (const auto &name : names)
+                {
+                    result.push_back(symbol::intern(name));
+                }
+                return result;
+            }
+
+            static std::uint64_t make_locals_mask(const std::vector<symbol> &local_symbols)
+            {
+                std::uint64_t result = 0;
+                for (auto key : local_symbols)
+                {
+                    result |= local_mask_bit(key);
+                }
+                return result;
+            }
+
+            static bool has_define(const std::vector<code_line> &code)
+            {
+                for (const auto &line : code)
+                {
+                    if (line.op == vm_operator::define)
+                    {
+                        return true;
+                    }
+                }
+
+                return false;
+            }
     };
 } // lysithea_vm
\ No newline at end of file
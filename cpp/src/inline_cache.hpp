@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace lysithea_vm
+{
+    class value;
+
+    // A monomorphic cache of the slot that was found for the last object shape seen by a code line.
+    // The shape id and slot are packed into one atomic so VMs on different threads can share a script without locking,
+    // a line that sees a different shape just overwrites the cache.
+    class inline_cache
+    {
+        public:
+            // Constructor
+            inline_cache() : data(0) { }
+            inline_cache(const inline_cache &) : data(0) { }
+            inline_cache &operator=(const inline_cache &)
+            {
+                data.store(0, std::memory_order_relaxed);
+                return *this;
+            }
+
+            // Methods
+            inline bool try_get(std::uint64_t shape_id, int &slot) const
+            {
+                auto current = data.load(std::memory_order_relaxed);
+                if ((current >> slot_bits) != shape_id)
+                {
+                    return false;
+                }
+
+                slot = static_cast<int>(current & slot_mask);
+                return true;
+            }
+
+            inline void update(std::uint64_t shape_id, int slot) const
+            {
+                if (slot < 0 || static_cast<std::uint64_t>(slot) > slot_mask || shape_id >= (1ull << (64 - slot_bits)))
+                {
+                    return;
+                }
+
+                data.store((shape_id << slot_bits) | static_cast<std::uint64_t>(slot), std::memory_order_relaxed);
+            }
+
+        private:
+            // Fields
+            static const int slot_bits = 16;
+            static const std::uint64_t slot_mask = (1ull << slot_bits) - 1;
+
+            mutable std::atomic<std::uint64_t> data;
+    };
+
+    // Remembers where a named variable was found for a get line, checked against the scope the lookup started from,
+    // the builtin scope and the versions of their keys. The fields are guarded by a sequence number so a VM on another thread
+    // reading the cache while it is being updated just sees a miss.
+    class binding_cache
+    {
+        public:
+            // Constructor
+            binding_cache() : sequence(0), scope_id(0), builtin_id(0), keys_version(0), binding(nullptr) { }
+            binding_cache(const binding_cache &) : binding_cache() { }
+            binding_cache &operator=(const binding_cache &)
+            {
+                binding.store(nullptr, std::memory_order_relaxed);
+                return *this;
+            }
+
+            // Methods
+            inline const value *try_get(std::uint64_t scope_id, std::uint64_t builtin_id, std::uint64_t keys_version) const
+            {
+                auto start = sequence.load(std::memory_order_acquire);
+                auto result = binding.load(std::memory_order_relaxed);
+                auto matches = this->scope_id.load(std::memory_order_relaxed) == scope_id &&
+                    this->builtin_id.load(std::memory_order_relaxed) == builtin_id &&
+                    this->keys_version.load(std::memory_order_relaxed) == keys_version;
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (!matches || (start & 1) || sequence.load(std::memory_order_relaxed) != start)
+                {
+                    return nullptr;
+                }
+                return result;
+            }
+
+            inline void update(std::uint64_t scope_id, std::uint64_t builtin_id, std::uint64_t keys_version, const value *binding) const
+            {
+                // If another thread is already updating then leave it to them.
+                auto start = sequence.load(std::memory_order_relaxed);
+                if ((start & 1) || !sequence.compare_exchange_strong(start, start + 1, std::memory_order_relaxed))
+                {
+                    return;
+                }
+                std::atomic_thread_fence(std::memory_order_release);
+
+                this->scope_id.store(scope_id, std::memory_order_relaxed);
+                this->builtin_id.store(builtin_id, std::memory_order_relaxed);
+                this->keys_version.store(keys_version, std::memory_order_relaxed);
+                this->binding.store(binding, std::memory_order_relaxed);
+
+                sequence.store(start + 2, std::memory_order_release);
+            }
+
+        private:
+            // Fields
+            mutable std::atomic<std::uint32_t> sequence;
+            mutable std::atomic<std::uint64_t> scope_id;
+            mutable std::atomic<std::uint64_t> builtin_id;
+            mutable std::atomic<std::uint64_t> keys_version;
+            mutable std::atomic<const value *> binding;
+    };
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "instruction_profiler.hpp"
+
+#include <algorithm>
+#include <map>
+
+#include "./utils.hpp"
+
+namespace lysithea_vm
+{
+    static const int num_operators = static_cast<int>(vm_operator::get_property_call) + 1;
+
+    template <typename T>
+    static void sort_by_time(std::vector<T> &input)
+    {
+        std::stable_sort(input.begin(), input.end(), [](const T &left, const T &right)
+        {
+            return left.total.time_ns > right.total.time_ns;
+        });
+    }
+
+    static void write_json_string(std::ostream &output, const std::string &input)
+    {
+        output << '"';
+        for (auto ch : input)
+        {
+            switch (ch)
+            {
+                case '"': output << "\\\""; break;
+                case '\\': output << "\\\\"; break;
+                case '\n': output << "\\n"; break;
+                case '\r': output << "\\r"; break;
+                case '\t': output << "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(ch) < 0x20)
+                    {
+                        static const char *hex = "0123456789abcdef";
+                        output << "\\u00" << hex[(ch >> 4) & 0xf] << hex[ch & 0xf];
+                    }
+                    else
+                    {
+                        output << ch;
+                    }
+                    break;
+            }
+        }
+        output << '"';
+    }
+
+    static void write_json_counter(std::ostream &output, const instruction_profiler::counter &input)
+    {
+        output << "\"count\": " << input.count << ", \"time_ns\": " << input.time_ns;
+    }
+
+    instruction_profiler::instruction_profiler() : operators(num_operators),
+        current_function(nullptr), current_profile(nullptr), pending_profile(nullptr), pending_line(0), pending_op(0)
+    {
+
+    }
+
+    void instruction_profiler::clear()
+    {
+        operators.assign(num_operators, counter());
+        functions.clear();
+        current_function = nullptr;
+        current_profile = nullptr;
+        pending_profile = nullptr;
+    }
+
+    void instruction_profiler::start()
+    {
+        // A builtin can run the VM again while the call instruction is pending, so charge it up to here.
+        finish_pending(clock::now());
+        pending_profile = nullptr;
+    }
+
+    void instruction_profiler::stop()
+    {
+        finish_pending(clock::now());
+        pending_profile = nullptr;
+    }
+
+    instruction_profiler::function_profile &instruction_profiler::get_function_profile(const std::shared_ptr<function> &code)
+    {
+        auto find = functions.find(code.get());
+        if (find != functions.end())
+        {
+            return find->second;
+        }
+
+        return functions.emplace(code.get(), function_profile(code)).first->second;
+    }
+
+    std::vector<instruction_profiler::line_report> instruction_profiler::create_line_reports() const
+    {
+        // Several code lines usually come from the same source line, so they're combined here.
+        std::map<std::pair<std::string, int>, int> report_index;
+        std::vector<line_report> result;
+
+        for (const auto &iter : functions)
+        {
+            const auto &profile = iter.second;
+            const auto &symbols = profile.code->symbols;
+            for (auto i = 0u; i < profile.lines.size(); i++)
+            {
+                const auto &line = profile.lines[i];
+                if (line.count == 0)
+                {
+                    continue;
+                }
+
+                code_location location;
+                auto source_name = symbols ? symbols->source_name : profile.code->name;
+                auto line_number = symbols && symbols->try_get_location(i, location) ? location.start_line_number + 1 : 0;
+
+                auto key = std::make_pair(source_name, line_number);
+                auto find = report_index.find(key);
+                if (find == report_index.end())
+                {
+                    find = report_index.emplace(key, static_cast<int>(result.size())).first;
+                    result.emplace_back(source_name, line_number);
+                }
+
+                auto &report = result[find->second].total;
+                report.count += line.count;
+                report.time_ns += line.time_ns;
+            }
+        }
+
+        sort_by_time(result);
+        return result;
+    }
+
+    void instruction_profiler::print_report(std::ostream &output) const
+    {
+        struct operator_report
+        {
+            std::string name;
+            counter total;
+        };
+
+        std::vector<operator_report> operator_reports;
+        for (auto i = 0; i < num_operators; i++)
+        {
+            if (operators[i].count > 0)
+            {
+                operator_reports.push_back(operator_report { to_string(static_cast<vm_operator>(i)), operators[i] });
+            }
+        }
+        sort_by_time(operator_reports);
+
+        std::vector<const function_profile *> function_reports;
+        for (const auto &iter : functions)
+        {
+            function_reports.push_back(&iter.second);
+        }
+        std::stable_sort(function_reports.begin(), function_reports.end(), [](const function_profile *left, const function_profile *right)
+        {
+            return left->total.time_ns > right->total.time_ns;
+        });
+
+        output << "Operators:\n";
+        for (const auto &iter : operator_reports)
+        {
+            output << "  " << iter.name << ": " << iter.total.count << " runs, " << iter.total.time_ns << "ns\n";
+        }
+
+        output << "Functions:\n";
+        for (auto iter : function_reports)
+        {
+            output << "  " << iter->code->name << ": " << iter->total.count << " runs, " << iter->total.time_ns << "ns\n";
+        }
+
+        output << "Lines:\n";
+        for (const auto &iter : create_line_reports())
+        {
+            output << "  " << iter.source_name << ':' << iter.line_number << ": " << iter.total.count << " runs, " << iter.total.time_ns << "ns\n";
+        }
+    }
+
+    void instruction_profiler::print_report_json(std::ostream &output) const
+    {
+        output << "{\n  \"operators\": [";
+        auto first = true;
+        for (auto i = 0; i < num_operators; i++)
+        {
+            if (operators[i].count == 0)
+            {
+                continue;
+            }
+
+            output << (first ? "\n    { \"name\": " : ",\n    { \"name\": ");
+            write_json_string(output, to_string(static_cast<vm_operator>(i)));
+            output << ", ";
+            write_json_counter(output, operators[i]);
+            output << " }";
+            first = false;
+        }
+
+        output << "\n  ],\n  \"functions\": [";
+        first = true;
+        for (const auto &iter : functions)
+        {
+            output << (first ? "\n    { \"name\": " : ",\n    { \"name\": ");
+            write_json_string(output, iter.second.code->name);
+            output << ", ";
+            write_json_counter(output, iter.second.total);
+            output << " }";
+            first = false;
+        }
+
+        output << "\n  ],\n  \"lines\": [";
+        first = true;
+        for (const auto &iter : create_line_reports())
+        {
+            output << (first ? "\n    { \"source\": " : ",\n    { \"source\": ");
+            write_json_string(output, iter.source_name);
+            output << ", \"line\": " << iter.line_number << ", ";
+            write_json_counter(output, iter.total);
+            output << " }";
+            first = false;
+        }
+
+        output << "\n  ]\n}\n";
+    }
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "operator.hpp"
+#include "function.hpp"
+
+namespace lysithea_vm
+{
+    // Counts and times every instruction the VM runs, by operator, function and source line.
+    // Only used when built with LYSITHEA_VM_PROFILER, otherwise the VM has no profiler at all.
+    // Times are self times, each instruction is charged until the next one starts so calls to builtins are included in the call instruction.
+    class instruction_profiler
+    {
+        public:
+            struct counter
+            {
+                // Fields
+                std::uint64_t count;
+                std::uint64_t time_ns;
+
+                // Constructor
+                counter() : count(0), time_ns(0) { }
+
+                // Methods
+                inline void add(std::uint64_t time)
+                {
+                    count++;
+                    time_ns += time;
+                }
+            };
+
+            struct function_profile
+            {
+                // Fields
+                std::shared_ptr<const function> code;
+                counter total;
+                std::vector<counter> lines;
+
+                // Constructor
+                function_profile(std::shared_ptr<const function> code) : code(code), lines(code->code.size()) { }
+            };
+
+            // Keeps track of when the VM starts and stops running so time spent in the host isn't counted.
+            class run_scope
+            {
+                public:
+                    // Constructor
+                    run_scope(instruction_profiler &profiler) : profiler(profiler) { profiler.start(); }
+                    ~run_scope() { profiler.stop(); }
+
+                private:
+                    // Fields
+                    instruction_profiler &profiler;
+            };
+
+            // Fields
+
+            // Constructor
+            instruction_profiler();
+
+            // Methods
+            void clear();
+
+            inline void record_line(const std::shared_ptr<function> &code, int line, vm_operator op)
+            {
+                auto now = clock::now();
+                finish_pending(now);
+
+                if (code.get() != current_function)
+                {
+                    current_function = code.get();
+                    current_profile = &get_function_profile(code);
+                }
+
+                pending_profile = current_profile;
+                pending_line = line;
+                pending_op = static_cast<int>(op);
+            }
+
+            const std::vector<counter> &operator_counters() const { return operators; }
+            const std::unordered_map<const function *, function_profile> &function_profiles() const { return functions; }
+
+            void print_report(std::ostream &output) const;
+            void print_report_json(std::ostream &output) const;
+
+        private:
+            using clock = std::chrono::steady_clock;
+
+            struct line_report
+            {
+                // Fields
+                std::string source_name;
+                int line_number;
+                counter total;
+
+                // Constructor
+                line_report(const std::string &source_name, int line_number) : source_name(source_name), line_number(line_number) { }
+            };
+
+            // Fields
+            std::vector<counter> operators;
+            std::unordered_map<const function *, function_profile> functions;
+
+            const function *current_function;
+            function_profile *current_profile;
+
+            function_profile *pending_profile;
+            int pending_line;
+            int pending_op;
+            clock::time_point pending_start;
+
+            // Methods
+            void start();
+            void stop();
+
+            inline void finish_pending(clock::time_point now)
+            {
+                if (pending_profile)
+                {
+                    auto time = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - pending_start).count());
+                    operators[pending_op].add(time);
+                    pending_profile->total.add(time);
+                    pending_profile->lines[pending_line].add(time);
+                }
+                pending_start = now;
+            }
+
+            function_profile &get_function_profile(const std::shared_ptr<function> &code);
+
+            std::vector<line_report> create_line_reports() const;
+    };
+} // lysithea_vm
\ No newline at end of file
@@ -10,6 +10,7 @@ namespace lysithea_vm
         push, to_argument,
         call, call_direct, call_return,
         get_property, get, set, define,
+        get_local, set_local, define_local,
         jump, jump_true, jump_false,
 
         // Misc
@@ -26,8 +27,15 @@ namespace lysithea_vm
         // Math
         add, sub, multiply, divide,
         inc, dec, unary_negative,
+        inc_local, dec_local,
 
         // Value create
-        make_array, make_object
+        make_array, make_object,
+
+        // Superinstructions, these are only created by the peephole optimiser
+        less_than_jump_false, less_than_equals_jump_false,
+        equals_jump_false, not_equals_jump_false,
+        greater_than_jump_false, greater_than_equals_jump_false,
+        add_local, get_property_call
     };
 } // namespace lysithea_vm
@@ -0,0 +1,119 @@
+#include "sampling_profiler.hpp"
+
+#include <algorithm>
+
+namespace lysithea_vm
+{
+    sampling_profiler::sampling_profiler(std::chrono::microseconds interval) :
+        interval(interval), requested(false), timer_running(false), num_samples(0)
+    {
+
+    }
+
+    sampling_profiler::~sampling_profiler()
+    {
+        stop();
+    }
+
+    void sampling_profiler::start()
+    {
+        std::lock_guard<std::mutex> lock(timer_mutex);
+        if (timer_running)
+        {
+            return;
+        }
+
+        timer_running = true;
+        timer_thread = std::thread(&sampling_profiler::run_timer, this);
+    }
+
+    void sampling_profiler::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(timer_mutex);
+            if (!timer_running)
+            {
+                return;
+            }
+            timer_running = false;
+        }
+
+        timer_condition.notify_all();
+        timer_thread.join();
+        requested.store(false, std::memory_order_relaxed);
+    }
+
+    void sampling_profiler::clear()
+    {
+        std::lock_guard<std::mutex> lock(samples_mutex);
+        samples.clear();
+        num_samples = 0;
+    }
+
+    void sampling_profiler::add_sample(const std::vector<sample_frame> &frames)
+    {
+        std::string key;
+        for (const auto &frame : frames)
+        {
+            if (!key.empty())
+            {
+                key += ';';
+            }
+            append_frame(key, frame);
+        }
+
+        std::lock_guard<std::mutex> lock(samples_mutex);
+        samples[key]++;
+        num_samples++;
+    }
+
+    std::uint64_t sampling_profiler::total_samples() const
+    {
+        std::lock_guard<std::mutex> lock(samples_mutex);
+        return num_samples;
+    }
+
+    void sampling_profiler::write_folded(std::ostream &output) const
+    {
+        std::vector<std::pair<std::string, std::uint64_t>> sorted;
+        {
+            std::lock_guard<std::mutex> lock(samples_mutex);
+            sorted.assign(samples.begin(), samples.end());
+        }
+
+        std::sort(sorted.begin(), sorted.end());
+        for (const auto &iter : sorted)
+        {
+            output << iter.first << ' ' << iter.second << '\n';
+        }
+    }
+
+    void sampling_profiler::run_timer()
+    {
+        std::unique_lock<std::mutex> lock(timer_mutex);
+        auto next = std::chrono::steady_clock::now() + interval;
+        while (timer_running)
+        {
+            if (timer_condition.wait_until(lock, next) == std::cv_status::timeout)
+            {
+                requested.store(true, std::memory_order_relaxed);
+                next += interval;
+            }
+        }
+    }
+
+    void sampling_profiler::append_frame(std::string &output, const sample_frame &frame)
+    {
+        output += frame.code->name;
+
+        code_location location;
+        if (frame.code->symbols && frame.code->symbols->try_get_location(frame.line, location))
+        {
+            output += " (";
+            output += frame.code->symbols->source_name;
+            output += ':';
+            output += std::to_string(location.start_line_number + 1);
+            output += ')';
+        }
+    }
+} // lysithea_vm
\ No newline at end of file
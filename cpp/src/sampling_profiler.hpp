@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "function.hpp"
+
+namespace lysithea_vm
+{
+    struct sample_frame
+    {
+        // Fields
+        const function *code;
+        int line;
+
+        // Constructor
+        sample_frame(const function *code, int line) : code(code), line(line) { }
+    };
+
+    // Records where scripts are spending their time by sampling the VM's call stack at a fixed rate.
+    // A timer thread only raises a flag, the VM takes the sample itself the next time it reaches a call, return or backward jump,
+    // so the VM state is never read from another thread and a VM without a sampler only pays for a null check.
+    class sampling_profiler
+    {
+        public:
+            // Fields
+
+            // Constructor
+            sampling_profiler(std::chrono::microseconds interval);
+            ~sampling_profiler();
+
+            sampling_profiler(const sampling_profiler &) = delete;
+            sampling_profiler &operator=(const sampling_profiler &) = delete;
+
+            // Methods
+            void start();
+            void stop();
+            void clear();
+
+            inline bool sample_requested()
+            {
+                return requested.load(std::memory_order_relaxed) && requested.exchange(false, std::memory_order_relaxed);
+            }
+
+            void add_sample(const std::vector<sample_frame> &frames);
+
+            std::uint64_t total_samples() const;
+
+            // Writes one line per unique stack, "global (test.lys:20);main (test.lys:3);step (test.lys:10) 42",
+            // which can be given to flamegraph.pl or similar tools.
+            void write_folded(std::ostream &output) const;
+
+        private:
+            // Fields
+            std::chrono::microseconds interval;
+            std::atomic<bool> requested;
+
+            std::thread timer_thread;
+            std::mutex timer_mutex;
+            std::condition_variable timer_condition;
+            bool timer_running;
+
+            mutable std::mutex samples_mutex;
+            std::unordered_map<std::string, std::uint64_t> samples;
+            std::uint64_t num_samples;
+
+            // Methods
+            void run_timer();
+
+            static void append_frame(std::string &output, const sample_frame &frame);
+    };
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,359 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <unordered_set>
+
+namespace lysithea_vm
+{
+    namespace
+    {
+        thread_local const std::shared_ptr<scheduled_vm> *running_task = nullptr;
+    }
+
+    class scheduler::worker
+    {
+        public:
+            // Fields
+            std::mutex lock;
+            std::deque<std::shared_ptr<scheduled_vm>> queue;
+            std::thread thread;
+            // Used to pick which worker to steal from first.
+            std::uint32_t random_state;
+
+            std::atomic<std::uint64_t> slices;
+            std::atomic<std::uint64_t> completed;
+            std::atomic<std::uint64_t> parked;
+            std::atomic<std::uint64_t> steals;
+            std::atomic<std::uint64_t> failed_steals;
+            std::atomic<std::int64_t> busy_nanoseconds;
+
+            // Constructor
+            worker(std::size_t index) : random_state(static_cast<std::uint32_t>(index) * 2654435761u + 1),
+                slices(0), completed(0), parked(0), steals(0), failed_steals(0), busy_nanoseconds(0) { }
+
+            // Methods
+            inline std::uint32_t next_random()
+            {
+                random_state ^= random_state << 13;
+                random_state ^= random_state >> 17;
+                random_state ^= random_state << 5;
+                return random_state;
+            }
+    };
+
+    class scheduler::async_waits
+    {
+        public:
+            // Fields
+            std::mutex lock;
+            // Set to null when the scheduler stops.
+            scheduler *owner;
+            // The callbacks only have a weak pointer to the task, otherwise the task, its VM, the operation it is waiting
+            // on and the callback would all keep each other alive.
+            std::unordered_set<std::shared_ptr<scheduled_vm>> tasks;
+
+            // Constructor
+            async_waits(scheduler *owner) : owner(owner) { }
+    };
+
+    scheduler::scheduler(std::size_t num_workers, std::int64_t slice_budget, std::function<void(scheduled_vm &, run_status)> on_finished) :
+        slice_budget(slice_budget), on_finished(on_finished), next_worker(0), stopping(false), queued_count(0), active_count(0),
+        parked_count(0), sleeping_count(0), waits(std::make_shared<async_waits>(this))
+    {
+        num_workers = std::max<std::size_t>(1, num_workers);
+        for (std::size_t i = 0; i < num_workers; i++)
+        {
+            workers.emplace_back(new worker(i));
+        }
+
+        // Only start the threads once all of the workers exist, so they can steal from each other.
+        for (auto &iter : workers)
+        {
+            auto self = iter.get();
+            self->thread = std::thread([this, self]() { run_worker(*self); });
+        }
+    }
+
+    scheduler::~scheduler()
+    {
+        stop();
+    }
+
+    std::shared_ptr<scheduled_vm> scheduler::spawn(std::shared_ptr<virtual_machine> vm)
+    {
+        auto result = std::make_shared<scheduled_vm>(vm);
+        active_count++;
+        push(*workers[next_worker++ % workers.size()], result);
+        return result;
+    }
+
+    bool scheduler::wake(const std::shared_ptr<scheduled_vm> &task)
+    {
+        auto state = task->state.load();
+        for (;;)
+        {
+            if (state == scheduled_vm::parked)
+            {
+                if (task->state.compare_exchange_weak(state, scheduled_vm::queued))
+                {
+                    // Nothing else can be using the VM while it is parked.
+                    task->vm->paused = false;
+                    parked_count--;
+                    active_count++;
+                    push(*workers[next_worker++ % workers.size()], task);
+                    return true;
+                }
+            }
+            else if (state == scheduled_vm::running)
+            {
+                // The worker will see this when the slice ends and queue it again instead of parking it.
+                if (task->state.compare_exchange_weak(state, scheduled_vm::woken))
+                {
+                    return true;
+                }
+            }
+            else
+            {
+                return false;
+            }
+        }
+    }
+
+    void scheduler::wait_idle()
+    {
+        std::unique_lock<std::mutex> guard(idle_lock);
+        idle.wait(guard, [this]() { return active_count.load() == 0; });
+    }
+
+    void scheduler::stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            stopping = true;
+        }
+        wake_workers.notify_all();
+
+        for (auto &iter : workers)
+        {
+            if (iter->thread.joinable())
+            {
+                iter->thread.join();
+            }
+        }
+
+        // Taking the lock waits for any callback that is already waking a task.
+        std::unordered_set<std::shared_ptr<scheduled_vm>> released;
+        {
+            std::lock_guard<std::mutex> guard(waits->lock);
+            waits->owner = nullptr;
+            released.swap(waits->tasks);
+        }
+    }
+
+    std::vector<worker_stats> scheduler::stats() const
+    {
+        std::vector<worker_stats> result;
+        for (const auto &iter : workers)
+        {
+            worker_stats stats;
+            stats.slices = iter->slices.load(std::memory_order_relaxed);
+            stats.completed = iter->completed.load(std::memory_order_relaxed);
+            stats.parked = iter->parked.load(std::memory_order_relaxed);
+            stats.steals = iter->steals.load(std::memory_order_relaxed);
+            stats.failed_steals = iter->failed_steals.load(std::memory_order_relaxed);
+            stats.busy_time = std::chrono::nanoseconds(iter->busy_nanoseconds.load(std::memory_order_relaxed));
+            result.push_back(stats);
+        }
+        return result;
+    }
+
+    std::shared_ptr<scheduled_vm> scheduler::current_task()
+    {
+        return running_task ? *running_task : nullptr;
+    }
+
+    void scheduler::run_worker(worker &self)
+    {
+        while (!stopping.load())
+        {
+            auto task = take(self);
+            if (task)
+            {
+                run_slice(self, std::move(task));
+            }
+            else
+            {
+                sleep();
+            }
+        }
+    }
+
+    std::shared_ptr<scheduled_vm> scheduler::take(worker &self)
+    {
+        std::shared_ptr<scheduled_vm> result;
+        {
+            // Take from the front of our own queue so each VM gets a turn before any of them run again.
+            std::lock_guard<std::mutex> guard(self.lock);
+            if (!self.queue.empty())
+            {
+                result = std::move(self.queue.front());
+                self.queue.pop_front();
+            }
+        }
+
+        if (!result && workers.size() > 1 && queued_count.load() > 0)
+        {
+            // Steal from the back of another queue, starting from a random worker so they don't all pick the same one.
+            auto start = self.next_random();
+            for (std::size_t i = 0; i < workers.size() && !result; i++)
+            {
+                auto &victim = *workers[(start + i) % workers.size()];
+                if (&victim == &self)
+                {
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (!victim.queue.empty())
+                {
+                    result = std::move(victim.queue.back());
+                    victim.queue.pop_back();
+                }
+            }
+
+            if (result)
+            {
+                self.steals.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                self.failed_steals.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if (result)
+        {
+            queued_count--;
+        }
+        return result;
+    }
+
+    void scheduler::run_slice(worker &self, std::shared_ptr<scheduled_vm> task)
+    {
+        task->state.store(scheduled_vm::running);
+
+        running_task = &task;
+        auto start = std::chrono::steady_clock::now();
+        auto status = task->vm->run_for(slice_budget);
+        auto end = std::chrono::steady_clock::now();
+        running_task = nullptr;
+
+        self.slices.fetch_add(1, std::memory_order_relaxed);
+        self.busy_nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+
+        switch (status)
+        {
+            case run_status::budget_exhausted:
+            {
+                task->state.store(scheduled_vm::queued);
+                push(self, std::move(task));
+                break;
+            }
+            case run_status::paused:
+            {
+                auto operation = task->vm->waiting_on;
+                auto expected = static_cast<int>(scheduled_vm::running);
+                if (task->state.compare_exchange_strong(expected, scheduled_vm::parked))
+                {
+                    // The task could be woken from another thread as soon as it is parked, so it can't be used after this.
+                    self.parked.fetch_add(1, std::memory_order_relaxed);
+                    parked_count++;
+                    finish_active();
+
+                    // A VM waiting on an async builtin is woken when the operation completes.
+                    if (operation)
+                    {
+                        {
+                            std::lock_guard<std::mutex> guard(waits->lock);
+                            if (!waits->owner)
+                            {
+                                break;
+                            }
+                            waits->tasks.insert(task);
+                        }
+
+                        auto shared_waits = waits;
+                        std::weak_ptr<scheduled_vm> weak_task = task;
+                        operation->on_complete([shared_waits, weak_task]()
+                        {
+                            std::lock_guard<std::mutex> guard(shared_waits->lock);
+                            auto task = weak_task.lock();
+                            if (shared_waits->owner && task && shared_waits->tasks.erase(task) > 0)
+                            {
+                                shared_waits->owner->wake(task);
+                            }
+                        });
+                    }
+                }
+                else
+                {
+                    // Woken before the slice ended.
+                    task->vm->paused = false;
+                    task->state.store(scheduled_vm::queued);
+                    push(self, std::move(task));
+                }
+                break;
+            }
+            default:
+            {
+                task->state.store(scheduled_vm::finished);
+                self.completed.fetch_add(1, std::memory_order_relaxed);
+                if (on_finished)
+                {
+                    on_finished(*task, status);
+                }
+                finish_active();
+                break;
+            }
+        }
+    }
+
+    void scheduler::push(worker &target, std::shared_ptr<scheduled_vm> task)
+    {
+        {
+            std::lock_guard<std::mutex> guard(target.lock);
+            target.queue.push_back(std::move(task));
+        }
+
+        queued_count++;
+        if (sleeping_count.load() > 0)
+        {
+            // Taking the lock means a worker that is about to sleep will either see the new count or get the notify.
+            {
+                std::lock_guard<std::mutex> guard(sleep_lock);
+            }
+            wake_workers.notify_one();
+        }
+    }
+
+    void scheduler::sleep()
+    {
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        sleeping_count++;
+        wake_workers.wait(guard, [this]() { return queued_count.load() > 0 || stopping.load(); });
+        sleeping_count--;
+    }
+
+    void scheduler::finish_active()
+    {
+        if (--active_count == 0)
+        {
+            {
+                std::lock_guard<std::mutex> guard(idle_lock);
+            }
+            idle.notify_all();
+        }
+    }
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "virtual_machine.hpp"
+
+namespace lysithea_vm
+{
+    class scheduler;
+
+    // A VM being run by a scheduler.
+    class scheduled_vm
+    {
+        public:
+            // Fields
+            const std::shared_ptr<virtual_machine> vm;
+
+            // Constructor
+            scheduled_vm(std::shared_ptr<virtual_machine> vm) : vm(vm), state(queued) { }
+
+        private:
+            // Fields
+            enum task_state { queued, running, parked, woken, finished };
+            std::atomic<int> state;
+
+            friend class scheduler;
+    };
+
+    struct worker_stats
+    {
+        // Fields
+        // Number of times a VM was run for a slice.
+        std::uint64_t slices;
+        std::uint64_t completed;
+        std::uint64_t parked;
+        // VMs taken from another worker's queue, and the times there was nothing to take.
+        std::uint64_t steals;
+        std::uint64_t failed_steals;
+        std::chrono::nanoseconds busy_time;
+
+        // Constructor
+        worker_stats() : slices(0), completed(0), parked(0), steals(0), failed_steals(0), busy_time(0) { }
+    };
+
+    // Runs VMs across a number of worker threads, a slice of instructions at a time. Each worker has its own queue and
+    // takes VMs from the other queues when it runs out. A VM that is paused by a builtin is parked until the host calls wake,
+    // or until the async operation it is waiting on completes, so a VM waiting on a host event doesn't take up a worker.
+    // Many VMs can share a script, but the builtins they call need to be safe to call from any worker thread.
+    class scheduler
+    {
+        public:
+            // Fields
+            // The number of instructions each VM runs before it goes to the back of the queue.
+            const std::int64_t slice_budget;
+            // Called on the worker thread when a VM finishes or throws, with an error the exception is in the VM's last_error.
+            const std::function<void(scheduled_vm &, run_status)> on_finished;
+
+            // Constructor
+            scheduler(std::size_t num_workers, std::int64_t slice_budget, std::function<void(scheduled_vm &, run_status)> on_finished = nullptr);
+            ~scheduler();
+
+            scheduler(const scheduler &other) = delete;
+            scheduler &operator=(const scheduler &other) = delete;
+
+            // Methods
+            // The VM should already have been given a script with start.
+            std::shared_ptr<scheduled_vm> spawn(std::shared_ptr<virtual_machine> vm);
+            // Unpauses a parked VM and queues it to run again. If the VM is still running the builtin that paused it then
+            // it is queued again as soon as it stops. Returns false if the VM wasn't paused or running.
+            bool wake(const std::shared_ptr<scheduled_vm> &task);
+
+            // Waits until there are no VMs queued or running, parked VMs aren't counted.
+            void wait_idle();
+            // Stops the workers once they have finished their current slice, anything still queued is not run.
+            // VMs waiting on an async operation are let go, completing the operation later won't wake them.
+            void stop();
+
+            inline std::size_t num_workers() const { return workers.size(); }
+            inline std::size_t num_parked() const { return parked_count.load(); }
+            std::vector<worker_stats> stats() const;
+
+            // The VM being run on this thread, for builtins that need to give their VM to something that will wake it.
+            static std::shared_ptr<scheduled_vm> current_task();
+
+        private:
+            // Types
+            class worker;
+            class async_waits;
+
+            // Fields
+            std::vector<std::unique_ptr<worker>> workers;
+            std::atomic<std::size_t> next_worker;
+            std::atomic<bool> stopping;
+
+            // VMs sitting in the queues, used to let sleeping workers know there is something to take.
+            std::atomic<std::int64_t> queued_count;
+            // VMs that are queued or running.
+            std::atomic<std::int64_t> active_count;
+            std::atomic<std::int64_t> parked_count;
+
+            std::atomic<int> sleeping_count;
+            std::mutex sleep_lock;
+            std::condition_variable wake_workers;
+
+            std::mutex idle_lock;
+            std::condition_variable idle;
+
+            // VMs parked on an async operation, shared with the operations' callbacks as they can outlive the scheduler.
+            std::shared_ptr<async_waits> waits;
+
+            // Methods
+            void run_worker(worker &self);
+            std::shared_ptr<scheduled_vm> take(worker &self);
+            void run_slice(worker &self, std::shared_ptr<scheduled_vm> task);
+            void push(worker &target, std::shared_ptr<scheduled_vm> task);
+            void sleep();
+            void finish_active();
+    };
+} // lysithea_vm
\ No newline at end of file
@@ -4,20 +4,32 @@
 
 namespace lysithea_vm
 {
-    scope::scope() { }
-    scope::scope(std::shared_ptr<scope> parent): parent(parent) { }
+    scope::scope() : id(next_id()), version(0) { }
+    scope::scope(std::shared_ptr<scope> parent): id(next_id()), parent(parent), version(0) { }
+    scope::scope(std::shared_ptr<scope> parent, std::shared_ptr<vm_arena> arena) : id(next_id()),
+        values(0, symbol_hash(), std::equal_to<symbol>(), arena), constants(0, symbol_hash(), std::equal_to<symbol>(), arena), parent(parent), version(0) { }
+    scope::scope(const scope &other) : id(next_id()), values(other.values), constants(other.constants), parent(other.parent), version(0) { }
 
     void scope::clear()
     {
         values.clear();
         constants.clear();
+        keys_changed();
     }
 
     void scope::combine_scope(const scope &input)
     {
         for (auto iter : input.values)
         {
-            values[iter.first] = iter.second;
+            auto result = values.emplace(iter.first, iter.second);
+            if (result.second)
+            {
+                keys_changed();
+            }
+            else
+            {
+                result.first->second = iter.second;
+            }
         }
 
         for (auto iter : input.constants)
@@ -26,29 +38,48 @@ namespace lysithea_vm
         }
     }
 
-    bool scope::has_key(const std::string &key) const
+    bool scope::has_key(symbol key) const
     {
         auto find = values.find(key);
         return find != values.cend();
     }
 
-    bool scope::try_define(const std::string &key, value input)
+    bool scope::has_key(const std::string &key) const
+    {
+        symbol found;
+        return symbol::try_find(key, found) && has_key(found);
+    }
+
+    bool scope::try_define(symbol key, value input)
     {
         if (is_constant(key))
         {
             return false;
         }
 
-        values[key] = input;
+        auto result = values.emplace(key, input);
+        if (result.second)
+        {
+            keys_changed();
+        }
+        else
+        {
+            result.first->second = input;
+        }
         return true;
     }
 
+    bool scope::try_define(const std::string &key, value input)
+    {
+        return try_define(symbol::intern(key), input);
+    }
+
     bool scope::try_define(const std::string &key, builtin_function_callback callback)
     {
         return try_define(key, value::make_builtin(callback));
     }
 
-    bool scope::try_set_constant(const std::string &key, value input)
+    bool scope::try_set_constant(symbol key, value input)
     {
         if (has_key(key))
         {
@@ -61,12 +92,17 @@ namespace lysithea_vm
         return true;
     }
 
+    bool scope::try_set_constant(const std::string &key, value input)
+    {
+        return try_set_constant(symbol::intern(key), input);
+    }
+
     bool scope::try_set_constant(const std::string &key, builtin_function_callback callback)
     {
         return try_set_constant(key, value::make_builtin(callback));
     }
 
-    bool scope::try_set(const std::string &key, value input)
+    bool scope::try_set(symbol key, value input)
     {
         if (is_constant(key))
         {
@@ -88,7 +124,13 @@ namespace lysithea_vm
         return false;
     }
 
-    bool scope::try_get_key(const std::string &key, value &result) const
+    bool scope::try_set(const std::string &key, value input)
+    {
+        symbol found;
+        return symbol::try_find(key, found) && try_set(found, input);
+    }
+
+    bool scope::try_get_key(symbol key, value &result) const
     {
         auto find = values.find(key);
         if (find != values.cend())
@@ -105,6 +147,12 @@ namespace lysithea_vm
         return false;
     }
 
+    bool scope::try_get_key(const std::string &key, value &result) const
+    {
+        symbol found;
+        return symbol::try_find(key, found) && try_get_key(found, result);
+    }
+
     bool scope::try_get_number(const std::string &key, double &result) const
     {
         value found;
@@ -135,14 +183,50 @@ namespace lysithea_vm
         return false;
     }
 
-    bool scope::is_constant(const std::string &key) const
+    bool scope::is_constant(symbol key) const
     {
         auto find = constants.find(key);
         return find != constants.cend();
     }
 
-    void scope::set_constant(const std::string &key)
+    bool scope::is_constant(const std::string &key) const
+    {
+        symbol found;
+        return symbol::try_find(key, found) && is_constant(found);
+    }
+
+    void scope::set_constant(symbol key)
     {
         constants.emplace(key, true);
     }
+
+    void scope::set_constant(const std::string &key)
+    {
+        set_constant(symbol::intern(key));
+    }
+
+    const value *scope::find_binding(symbol key) const
+    {
+        for (auto current = this; current; current = current->parent.get())
+        {
+            auto find = current->values.find(key);
+            if (find != current->values.cend())
+            {
+                return &find->second;
+            }
+        }
+
+        return nullptr;
+    }
+
+    std::uint64_t scope::next_id()
+    {
+        static std::atomic<std::uint64_t> ids(1);
+        return ids.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void scope::keys_changed()
+    {
+        version.fetch_add(1, std::memory_order_relaxed);
+    }
 } // lysithea_vm
\ No newline at end of file
@@ -1,41 +1,86 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
 
+#include "./symbol.hpp"
+#include "./vm_arena.hpp"
 #include "./values/value.hpp"
 #include "./values/builtin_function_value.hpp"
 
 namespace lysithea_vm
 {
+    template <typename T>
+    using scope_map = std::unordered_map<symbol, T, symbol_hash, std::equal_to<symbol>, shared_arena_allocator<std::pair<const symbol, T>>>;
+
     class scope
     {
         public:
             // Fields
-            std::unordered_map<std::string, value> values;
-            std::unordered_map<std::string, bool> constants;
+            // Unique for the life of the program, copies get a new id.
+            const std::uint64_t id;
+            // Keys should be added and removed through the methods below so that cached lookups are invalidated.
+            scope_map<value> values;
+            scope_map<bool> constants;
+            // Should not be changed once code has been run with this scope.
             std::shared_ptr<scope> parent;
 
             // Constructor
             scope();
             scope(std::shared_ptr<scope> parent);
+            // The keys are allocated from the arena, so keys should only be added on the thread using the arena.
+            scope(std::shared_ptr<scope> parent, std::shared_ptr<vm_arena> arena);
+            scope(const scope &other);
+
+            scope &operator=(const scope &other) = delete;
 
             // Methods
             void clear();
             void combine_scope(const scope &input);
 
+            bool has_key(symbol key) const;
             bool has_key(const std::string &key) const;
+            bool try_define(symbol key, value input);
             bool try_define(const std::string &key, value input);
             bool try_define(const std::string &key, builtin_function_callback input);
+            bool try_set_constant(symbol key, value input);
             bool try_set_constant(const std::string &key, value input);
             bool try_set_constant(const std::string &key, builtin_function_callback callback);
+            bool try_set(symbol key, value input);
             bool try_set(const std::string &key, value input);
+            bool try_get_key(symbol key, value &result) const;
             bool try_get_key(const std::string &key, value &result) const;
             bool try_get_number(const std::string &key, double &result) const;
             bool try_get_bool(const std::string &key, bool &result) const;
 
+            bool is_constant(symbol key) const;
             bool is_constant(const std::string &key) const;
+            void set_constant(symbol key);
             void set_constant(const std::string &key);
+
+            // Finds the value for the key in this scope or its parents, the pointer stays valid until the key is removed from that scope.
+            const value *find_binding(symbol key) const;
+
+            // Changes whenever a key is added to or removed from this scope or one of its parents.
+            inline std::uint64_t keys_version() const
+            {
+                std::uint64_t result = 0;
+                for (auto current = this; current; current = current->parent.get())
+                {
+                    result += current->version.load(std::memory_order_relaxed);
+                }
+                return result;
+            }
+
+        private:
+            // Fields
+            std::atomic<std::uint64_t> version;
+
+            // Methods
+            static std::uint64_t next_id();
+            void keys_changed();
     };
 } // lysithea_vm
\ No newline at end of file
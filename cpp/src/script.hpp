@@ -7,15 +7,22 @@ namespace lysithea_vm
     class scope;
     class function;
 
+    // A script is never changed by running it, apart from the inline caches on its code lines which are safe to
+    // update from any thread, so one script can be executed by VMs on different threads at the same time.
     class script
     {
         public:
             // Fields
-            std::shared_ptr<const scope> builtin_scope;
-            std::shared_ptr<function> code;
+            const std::shared_ptr<const scope> builtin_scope;
+            // Just the constants defined by the script itself, these are also included in the builtin scope.
+            const std::shared_ptr<const scope> constants;
+            const std::shared_ptr<function> code;
+            // The deepest operand stack needed by any single function in the script.
+            const int max_stack_depth;
 
             // Constructor
-            script(std::shared_ptr<const scope> builtin_scope, std::shared_ptr<function> code): builtin_scope(builtin_scope), code(code) { }
+            script(std::shared_ptr<const scope> builtin_scope, std::shared_ptr<const scope> constants, std::shared_ptr<function> code, int max_stack_depth):
+                builtin_scope(builtin_scope), constants(constants), code(code), max_stack_depth(max_stack_depth) { }
 
             // Methods
     };
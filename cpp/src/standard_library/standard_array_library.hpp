@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <memory>
+#include <stdexcept>
 
 #include "../values/value.hpp"
 #include "../values/array_value.hpp"
@@ -14,30 +16,33 @@ namespace lysithea_vm
     {
         public:
             // Fields
-            static std::shared_ptr<const scope> library_scope;
+            static const std::shared_ptr<const scope> library_scope;
 
             // Methods
             static std::shared_ptr<scope> create_scope();
 
-            static value concat(const array_vector &target, const array_vector &input);
-            static value get(const array_vector &target, int index);
-            static value set(const array_vector &target, int index, const value &input);
-            static value insert(const array_vector &target, int index, const value &input);
-            static value insert_flatten(const array_vector &target, int index, const array_vector &input);
-            static value remove_at(const array_vector &target, int index);
+            static value concat(const persistent_array &target, const persistent_array &input);
+            static value get(const persistent_array &target, int index);
+            static value set(const persistent_array &target, int index, const value &input);
+            static value insert(const persistent_array &target, int index, const value &input);
+            static value insert_flatten(const persistent_array &target, int index, const persistent_array &input);
+            static value remove_at(const persistent_array &target, int index);
             static value remove(const value &target, const value &value);
             static value remove_all(const value &target, const value &value);
-            static value contains(const array_vector &target, const value &value);
-            static value index_of(const array_vector &target, const value &value);
-            static value sublist(const array_vector &target, int index, int length);
+            static value contains(const persistent_array &target, const value &value);
+            static value index_of(const persistent_array &target, const value &value);
+            static value sublist(const persistent_array &target, int index, int length);
 
-            inline static array_vector::const_iterator get_iter(const array_vector &value, int index)
+            // Negative indices count back from the end, the end itself is only allowed when adding values.
+            inline static std::size_t get_index(const persistent_array &value, int index, bool allow_end)
             {
-                if (index < 0)
+                auto result = index < 0 ? static_cast<int>(value.size()) + index : index;
+                auto max_index = static_cast<int>(value.size()) - (allow_end ? 0 : 1);
+                if (result < 0 || result > max_index)
                 {
-                    return value.begin() + (value.size() + index);
+                    throw std::out_of_range("Array index out of range");
                 }
-                return value.begin() + index;
+                return static_cast<std::size_t>(result);
             }
 
         private:
@@ -5,20 +5,21 @@
 
 #include "../virtual_machine.hpp"
 #include "../values/object_value.hpp"
+#include "../values/builtin_function_value.hpp"
 #include "../utils.hpp"
 #include "../scope.hpp"
 
 namespace lysithea_vm
 {
-    std::shared_ptr<const scope> standard_assert_library::library_scope = create_scope();
+    const std::shared_ptr<const scope> standard_assert_library::library_scope = create_scope();
 
     std::shared_ptr<scope> standard_assert_library::create_scope()
     {
         auto result = std::make_shared<scope>();
 
-        auto functions = std::make_shared<object_value>();
+        object_map functions;
 
-        functions->data["true"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["true"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto top = args.get_index(0);
             if (!top.is_true())
@@ -30,7 +31,7 @@ namespace lysithea_vm
             }
         });
 
-        functions->data["false"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["false"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto top = args.get_index(0);
             if (!top.is_false())
@@ -41,7 +42,7 @@ namespace lysithea_vm
             }
         });
 
-        functions->data["equals"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["equals"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto expected = args.get_index(0);
             auto actual = args.get_index(1);
@@ -56,7 +57,7 @@ namespace lysithea_vm
             }
         });
 
-        functions->data["notEquals"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["notEquals"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto expected = args.get_index(0);
             auto actual = args.get_index(1);
@@ -72,7 +73,25 @@ namespace lysithea_vm
             }
         });
 
-        result->try_define("assert", value(functions));
+        functions["throws"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
+        {
+            // Calls the builtin with the rest of the arguments, it is expected to throw.
+            auto builtin = args.get_index<const builtin_function_value>(0);
+            try
+            {
+                builtin->invoke(vm, arguments_view(args.begin() + 1, args.size() - 1), false);
+            }
+            catch (const std::exception &)
+            {
+                return;
+            }
+
+            vm.running = false;
+            std::cout << "Assert expected an exception\n";
+            vm.print_stack_trace_debug();
+        });
+
+        result->try_define("assert", object_value::make_value(functions));
 
         return result;
     }
@@ -11,71 +11,71 @@
 
 namespace lysithea_vm
 {
-    std::shared_ptr<const scope> standard_math_library::library_scope = create_scope();
+    const std::shared_ptr<const scope> standard_math_library::library_scope = create_scope();
 
     std::shared_ptr<scope> standard_math_library::create_scope()
     {
         auto result = std::make_shared<scope>();
 
-        auto functions = std::make_shared<object_value>();
+        object_map functions;
 
-        functions->data["E"] = value(M_E);
-        functions->data["PI"] = value(M_PI);
-        functions->data["DegToRad"] = value(M_DEG_TO_RAD);
+        functions["E"] = value(M_E);
+        functions["PI"] = value(M_PI);
+        functions["DegToRad"] = value(M_DEG_TO_RAD);
 
-        functions->data["sin"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["sin"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &top = args.get_number(0);
             vm.push_stack(sin(top));
         });
-        functions->data["cos"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["cos"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &top = args.get_number(0);
             vm.push_stack(cos(top));
         });
-        functions->data["tan"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["tan"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &top = args.get_number(0);
             vm.push_stack(tan(top));
         });
 
-        functions->data["pow"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["pow"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             const auto &y = args.get_number(1);
             vm.push_stack(pow(x, y));
         });
-        functions->data["exp"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["exp"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             vm.push_stack(exp(x));
         });
-        functions->data["floor"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["floor"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             vm.push_stack(floor(x));
         });
-        functions->data["ceil"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["ceil"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             vm.push_stack(ceil(x));
         });
-        functions->data["round"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["round"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             vm.push_stack(round(x));
         });
-        functions->data["isNaN"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["isNaN"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             vm.push_stack(std::isnan(x));
         });
-        functions->data["isFinite"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["isFinite"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             vm.push_stack(std::isfinite(x));
         });
-        functions->data["parse"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["parse"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &top = args.get_index(0);
             if (top.is_number())
@@ -87,31 +87,31 @@ namespace lysithea_vm
             vm.push_stack(std::stod(top.to_string()));
         });
 
-        functions->data["log"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["log"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             vm.push_stack(log(x));
         });
-        functions->data["log2"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["log2"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             vm.push_stack(log2(x));
         });
-        functions->data["log10"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["log10"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             vm.push_stack(log10(x));
         });
-        functions->data["abs"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["abs"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             const auto &x = args.get_number(0);
             vm.push_stack(abs(x));
         });
 
-        functions->data["max"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["max"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto max = args.get_index(0);
-            for (auto iter = args.data.cbegin() + 1; iter != args.data.cend(); ++iter)
+            for (auto iter = args.cbegin() + 1; iter != args.cend(); ++iter)
             {
                 if (iter->compare_to(max) > 0)
                 {
@@ -122,10 +122,10 @@ namespace lysithea_vm
             vm.push_stack(max);
         });
 
-        functions->data["min"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["min"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto min = args.get_index(0);
-            for (auto iter = args.data.cbegin() + 1; iter != args.data.cend(); ++iter)
+            for (auto iter = args.cbegin() + 1; iter != args.cend(); ++iter)
             {
                 if (iter->compare_to(min) < 0)
                 {
@@ -136,10 +136,10 @@ namespace lysithea_vm
             vm.push_stack(min);
         });
 
-        functions->data["sum"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["sum"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto total = 0.0;
-            for (const auto &iter : args.data)
+            for (const auto &iter : args)
             {
                 if (!iter.is_number())
                 {
@@ -150,7 +150,7 @@ namespace lysithea_vm
             vm.push_stack(total);
         });
 
-        result->try_define("math", value(functions));
+        result->try_define("math", object_value::make_value(functions));
 
         return result;
     }
@@ -13,7 +13,7 @@ namespace lysithea_vm
     {
         public:
             // Fields
-            static std::shared_ptr<const scope> library_scope;
+            static const std::shared_ptr<const scope> library_scope;
 
             // Methods
             static std::shared_ptr<scope> create_scope();
@@ -11,42 +11,42 @@
 
 namespace lysithea_vm
 {
-    std::shared_ptr<const scope> standard_misc_library::library_scope = create_scope();
+    const std::shared_ptr<const scope> standard_misc_library::library_scope = create_scope();
 
     std::shared_ptr<scope> standard_misc_library::create_scope()
     {
         auto result = std::make_shared<scope>();
 
-        result->try_define("typeof", [](virtual_machine &vm, const array_value &args) -> void
+        result->try_define("typeof", [](virtual_machine &vm, const arguments_view &args) -> void
         {
-            auto top = args.data[0];
+            auto top = args[0];
             vm.push_stack(top.type_name());
         });
 
-        result->try_define("isDefined", [](virtual_machine &vm, const array_value &args) -> void
+        result->try_define("isDefined", [](virtual_machine &vm, const arguments_view &args) -> void
         {
-            auto top = args.data[0].to_string();
+            auto top = args[0].to_string();
             value temp;
-            auto is_defined = vm.current_scope->try_get_key(top, temp);
+            auto is_defined = vm.try_get_variable(top, temp);
             vm.push_stack(is_defined);
         });
 
-        result->try_define("toString", [](virtual_machine &vm, const array_value &args) -> void
+        result->try_define("toString", [](virtual_machine &vm, const arguments_view &args) -> void
         {
-            auto top = args.data[0];
+            auto top = args[0];
             vm.push_stack(top.to_string());
         });
 
-        result->try_define("compareTo", [](virtual_machine &vm, const array_value &args) -> void
+        result->try_define("compareTo", [](virtual_machine &vm, const arguments_view &args) -> void
         {
-            auto left = args.data[0];
-            auto right = args.data[1];
+            auto left = args[0];
+            auto right = args[1];
             vm.push_stack(left.compare_to(right));
         });
 
-        result->try_define("print", [](virtual_machine &vm, const array_value &args) -> void
+        result->try_define("print", [](virtual_machine &vm, const arguments_view &args) -> void
         {
-            for (auto iter : args.data)
+            for (auto iter : args)
             {
                 std::cout << iter.to_string();
             }
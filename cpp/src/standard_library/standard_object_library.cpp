@@ -5,75 +5,73 @@
 
 namespace lysithea_vm
 {
-    std::shared_ptr<const scope> standard_object_library::library_scope = create_scope();
+    const std::shared_ptr<const scope> standard_object_library::library_scope = create_scope();
 
     std::shared_ptr<scope> standard_object_library::create_scope()
     {
         auto result = std::make_shared<scope>();
 
-        auto functions = std::make_shared<object_value>();
-        functions->data["join"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        object_map functions;
+        functions["join"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             vm.push_stack(object_value::join(args));
         });
-        functions->data["set"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["set"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto obj = args.get_index<const object_value>(0);
             auto key = args.get_index<const string_value>(1);
             auto value = args.get_index(2);
-            vm.push_stack(set(obj->data, key->data, value));
+            vm.push_stack(set(*obj, key->to_string(), value));
         });
-        functions->data["get"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["get"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto obj = args.get_index<const object_value>(0);
             auto key = args.get_index<const string_value>(1);
-            vm.push_stack(get(obj->data, key->data));
+            vm.push_stack(get(*obj, key->to_string()));
         });
-        functions->data["keys"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["keys"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto obj = args.get_index<const object_value>(0);
-            vm.push_stack(keys(obj->data));
+            vm.push_stack(keys(*obj));
         });
-        functions->data["values"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["values"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto obj = args.get_index<const object_value>(0);
-            vm.push_stack(values(obj->data));
+            vm.push_stack(values(*obj));
         });
-        functions->data["length"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["length"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto obj = args.get_index<const object_value>(0);
-            vm.push_stack(obj->data.size());
+            vm.push_stack(obj->size());
         });
-        functions->data["removeKey"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["removeKey"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto obj = args.get_index(0);
             auto key = args.get_index<const string_value>(1);
-            vm.push_stack(removeKey(obj, key->data));
+            vm.push_stack(removeKey(obj, key->to_string()));
         });
-        functions->data["removeValues"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["removeValues"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto obj = args.get_index(0);
             auto values = args.get_index(1);
             vm.push_stack(removeValues(obj, values));
         });
 
-        result->try_define("object", value(functions));
+        result->try_define("object", object_value::make_value(functions));
 
         return result;
     }
 
-    value standard_object_library::set(const object_map &target, const std::string &key, const value &input)
+    value standard_object_library::set(const object_value &target, const std::string &key, const value &input)
     {
-        object_map obj(target);
-        obj[key] = input;
-        return object_value::make_value(obj);
+        return target.with_value(key, input);
     }
-    value standard_object_library::get(const object_map &target, const std::string &key)
+    value standard_object_library::get(const object_value &target, const std::string &key)
     {
-        auto find = target.find(key);
-        if (find != target.end())
+        value result;
+        if (target.try_get(key, result))
         {
-            return find->second;
+            return result;
         }
         else
         {
@@ -81,43 +79,40 @@ namespace lysithea_vm
         }
     }
 
-    value standard_object_library::keys(const object_map &target)
+    value standard_object_library::keys(const object_value &target)
     {
         array_vector arr;
-        for (auto iter : target)
+        target.for_each([&](const std::string &key, const value &item)
         {
-            arr.push_back(iter.first);
-        }
+            arr.push_back(key);
+        });
         return array_value::make_value(arr);
     }
-    value standard_object_library::values(const object_map &target)
+    value standard_object_library::values(const object_value &target)
     {
         array_vector arr;
-        for (auto iter : target)
+        target.for_each([&](const std::string &key, const value &item)
         {
-            arr.push_back(iter.second);
-        }
+            arr.push_back(item);
+        });
         return array_value::make_value(arr);
     }
 
     value standard_object_library::removeKey(const value &target, const std::string &key)
     {
         auto obj_target = target.get_complex<const object_value>();
-        auto find = obj_target->data.find(key);
-        if (find == obj_target->data.cend())
+        if (!obj_target->has_key(key))
         {
             return target;
         }
 
-        object_map obj(obj_target->data);
-        obj.erase(obj.find(key));
-        return object_value::make_value(obj);
+        return obj_target->without_key(key);
     }
 
     value standard_object_library::removeValues(const value &target, const value &input)
     {
         auto obj_target = target.get_complex<const object_value>();
-        object_map obj(obj_target->data);
+        object_map obj(obj_target->to_map());
         for (auto iter = obj.begin(); iter != obj.end();)
         {
             if (iter->second.compare_to(input) == 0)
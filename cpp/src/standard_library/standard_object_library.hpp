@@ -14,15 +14,15 @@ namespace lysithea_vm
     {
         public:
             // Fields
-            static std::shared_ptr<const scope> library_scope;
+            static const std::shared_ptr<const scope> library_scope;
 
             // Methods
             static std::shared_ptr<scope> create_scope();
 
-            static value set(const object_map &target, const std::string &key, const value &input);
-            static value get(const object_map &target, const std::string &key);
-            static value keys(const object_map &target);
-            static value values(const object_map &target);
+            static value set(const object_value &target, const std::string &key, const value &input);
+            static value get(const object_value &target, const std::string &key);
+            static value keys(const object_value &target);
+            static value values(const object_value &target);
             static value removeKey(const value &target, const std::string &key);
             static value removeValues(const value &target, const value &input);
 
@@ -4,69 +4,92 @@
 
 #include "../virtual_machine.hpp"
 #include "../values/object_value.hpp"
+#include "../values/string_builder_value.hpp"
 #include "../utils.hpp"
 #include "../scope.hpp"
 
 namespace lysithea_vm
 {
-    std::shared_ptr<const scope> standard_string_library::library_scope = create_scope();
+    const std::shared_ptr<const scope> standard_string_library::library_scope = create_scope();
 
     std::shared_ptr<scope> standard_string_library::create_scope()
     {
         auto result = std::make_shared<scope>();
 
-        auto functions = std::make_shared<object_value>();
-        functions->data["length"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        object_map functions;
+        functions["length"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto top = args.get_index<string_value>(0);
-            vm.push_stack(top->data.size());
+            vm.push_stack(top->size());
         });
-        functions->data["get"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["get"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
-            auto top = args.get_index(0).to_string();
             auto index = args.get_int(1);
-            vm.push_stack(get(top, index));
+            auto top = args.get_index(0).get_complex<const string_value>();
+            if (top)
+            {
+                vm.push_stack(get(*top, index));
+            }
+            else
+            {
+                vm.push_stack(get(args.get_index(0).to_string(), index));
+            }
         });
-        functions->data["set"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["set"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto top = args.get_index(0).to_string();
             auto index = args.get_int(1);
             auto value = args.get_index(2).to_string();
             vm.push_stack(set(top, index, value));
         });
-        functions->data["insert"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["insert"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto top = args.get_index(0).to_string();
             auto index = args.get_int(1);
             auto value = args.get_index(2).to_string();
             vm.push_stack(insert(top, index, value));
         });
-        functions->data["substring"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["substring"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto top = args.get_index(0).to_string();
             auto index = args.get_int(1);
             auto length = args.get_int(2);
             vm.push_stack(substring(top, index, length));
         });
-        functions->data["removeAt"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["removeAt"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto top = args.get_index(0).to_string();
             auto index = args.get_int(1);
             vm.push_stack(remove_at(top, index));
         });
-        functions->data["removeAll"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["removeAll"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto top = args.get_index(0).to_string();
             auto values = args.get_index(1).to_string();
             vm.push_stack(remove_all(top, values));
         });
-        functions->data["join"] = value::make_builtin([](virtual_machine &vm, const array_value &args) -> void
+        functions["join"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
         {
             auto separator = args.get_index(0).to_string();
-            vm.push_stack(join(separator, args.data.cbegin() + 1, args.data.cend()));
+            vm.push_stack(join(separator, args.cbegin() + 1, args.cend()));
+        });
+        functions["builder"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
+        {
+            string_builder_value empty;
+            vm.push_stack(empty.append(args.cbegin(), args.cend()));
+        });
+        functions["append"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
+        {
+            auto top = args.get_index<const string_builder_value>(0);
+            vm.push_stack(top->append(args.cbegin() + 1, args.cend()));
+        });
+        functions["build"] = value::make_builtin([](virtual_machine &vm, const arguments_view &args) -> void
+        {
+            auto top = args.get_index<const string_builder_value>(0);
+            vm.push_stack(top->to_string());
         });
 
-        result->try_define("string", value(functions));
+        result->try_define("string", object_value::make_value(functions));
 
         return result;
     }
@@ -74,14 +97,19 @@ namespace lysithea_vm
     value standard_string_library::get(const std::string &target, int index)
     {
         auto ch = target[get_index(target, index)];
-        return value(std::make_shared<string_value>(std::string(ch, 1)));
+        return value(string_value::make(&ch, 1));
+    }
+    value standard_string_library::get(const string_value &target, int index)
+    {
+        return value(string_value::make(target.c_str() + get_index(target.size(), index), 1));
     }
     value standard_string_library::set(const std::string &target, int index, const std::string &input)
     {
-        std::stringstream ss;
         index = get_index(target, index);
-        ss << target.substr(0, index) << input << target.substr(index + 1);
-        return value(ss.str());
+        std::string result;
+        result.reserve(target.size() + input.size());
+        result.append(target, 0, index).append(input).append(target, index + 1, std::string::npos);
+        return value(std::move(result));
     }
     value standard_string_library::insert(const std::string &target, int index, const std::string &input)
     {
@@ -110,7 +138,7 @@ namespace lysithea_vm
         return copy;
     }
 
-    value standard_string_library::join(const std::string &separator, const std::vector<value>::const_iterator begin, const std::vector<value>::const_iterator end)
+    value standard_string_library::join(const std::string &separator, const value *begin, const value *end)
     {
         auto first = true;
         std::stringstream ss;
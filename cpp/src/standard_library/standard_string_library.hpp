@@ -12,7 +12,7 @@ namespace lysithea_vm
     {
         public:
             // Fields
-            static std::shared_ptr<const scope> library_scope;
+            static const std::shared_ptr<const scope> library_scope;
 
             // Methods
             static std::shared_ptr<scope> create_scope();
@@ -20,17 +20,22 @@ namespace lysithea_vm
             static value length(const std::string &target);
             static value set(const std::string &target, int index, const std::string &input);
             static value get(const std::string &target, int index);
+            static value get(const string_value &target, int index);
             static value insert(const std::string &target, int index, const std::string &input);
             static value substring(const std::string &target, int index, int length);
             static value remove_at(const std::string &target, int index);
             static value remove_all(const std::string &target, const std::string &values);
-            static value join(const std::string &separator, const std::vector<value>::const_iterator begin, const std::vector<value>::const_iterator end);
+            static value join(const std::string &separator, const value *begin, const value *end);
 
             inline static int get_index(const std::string &input, int index)
+            {
+                return get_index(input.size(), index);
+            }
+            inline static int get_index(std::size_t size, int index)
             {
                 if (index < 0)
                 {
-                    return input.size() + index;
+                    return size + index;
                 }
 
                 return index;
@@ -0,0 +1,72 @@
+#include "symbol.hpp"
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace lysithea_vm
+{
+    namespace
+    {
+        class symbol_table
+        {
+            public:
+                // Fields
+                std::mutex lock;
+                std::unordered_map<std::string, int> ids;
+                // A deque so references to names stay valid as more are added.
+                std::deque<std::string> names;
+        };
+
+        symbol_table &get_table()
+        {
+            static symbol_table table;
+            return table;
+        }
+    }
+
+    symbol symbol::intern(const std::string &name)
+    {
+        auto &table = get_table();
+        std::lock_guard<std::mutex> guard(table.lock);
+
+        auto find = table.ids.find(name);
+        if (find != table.ids.end())
+        {
+            return symbol(find->second);
+        }
+
+        auto id = static_cast<int>(table.names.size());
+        table.names.push_back(name);
+        table.ids.emplace(name, id);
+        return symbol(id);
+    }
+
+    bool symbol::try_find(const std::string &name, symbol &result)
+    {
+        auto &table = get_table();
+        std::lock_guard<std::mutex> guard(table.lock);
+
+        auto find = table.ids.find(name);
+        if (find == table.ids.end())
+        {
+            return false;
+        }
+
+        result = symbol(find->second);
+        return true;
+    }
+
+    const std::string &symbol::to_string() const
+    {
+        if (id < 0)
+        {
+            static const std::string empty_name;
+            return empty_name;
+        }
+
+        auto &table = get_table();
+        std::lock_guard<std::mutex> guard(table.lock);
+        return table.names[id];
+    }
+} // lysithea_vm
\ No newline at end of file
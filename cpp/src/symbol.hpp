@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace lysithea_vm
+{
+    // An interned name, symbols with the same name always have the same id so they can be compared and hashed as integers.
+    // The table is shared by every assembler and VM and names are never removed from it.
+    class symbol
+    {
+        public:
+            // Fields
+            int id;
+
+            // Constructor
+            symbol() : id(-1) { }
+            explicit symbol(int id) : id(id) { }
+
+            // Methods
+            static symbol intern(const std::string &name);
+            // Doesn't add the name, a name that has never been interned can't be a key in anything.
+            static bool try_find(const std::string &name, symbol &result);
+
+            const std::string &to_string() const;
+
+            inline bool is_valid() const { return id >= 0; }
+
+            inline bool operator==(const symbol &other) const { return id == other.id; }
+            inline bool operator!=(const symbol &other) const { return id != other.id; }
+    };
+
+    struct symbol_hash
+    {
+        inline std::size_t operator()(const symbol &input) const
+        {
+            return static_cast<std::size_t>(input.id);
+        }
+    };
+} // lysithea_vm
\ No newline at end of file
@@ -14,6 +14,9 @@ namespace lysithea_vm
             case vm_operator::define: return "define";
             case vm_operator::get: return "get";
             case vm_operator::get_property: return "getProperty";
+            case vm_operator::get_local: return "getLocal";
+            case vm_operator::set_local: return "setLocal";
+            case vm_operator::define_local: return "defineLocal";
             case vm_operator::jump: return "jump";
             case vm_operator::jump_false: return "jumpFalse";
             case vm_operator::jump_true: return "jumpTrue";
@@ -37,15 +40,39 @@ namespace lysithea_vm
             case vm_operator::greater_than_equals: return ">=";
             case vm_operator::inc: return "++";
             case vm_operator::dec: return "--";
+            case vm_operator::inc_local: return "incLocal";
+            case vm_operator::dec_local: return "decLocal";
             case vm_operator::op_and: return "&&";
             case vm_operator::op_or: return "||";
             case vm_operator::op_not: return "!";
+            case vm_operator::make_array: return "makeArray";
+            case vm_operator::make_object: return "makeObject";
+
+            case vm_operator::less_than_jump_false: return "<JumpFalse";
+            case vm_operator::less_than_equals_jump_false: return "<=JumpFalse";
+            case vm_operator::equals_jump_false: return "==JumpFalse";
+            case vm_operator::not_equals_jump_false: return "!=JumpFalse";
+            case vm_operator::greater_than_jump_false: return ">JumpFalse";
+            case vm_operator::greater_than_equals_jump_false: return ">=JumpFalse";
+            case vm_operator::add_local: return "addLocal";
+            case vm_operator::get_property_call: return "getPropertyCall";
             default: break;
         }
 
         return "unknown";
     }
 
+    bool is_jump_operator(vm_operator input)
+    {
+        return input == vm_operator::jump || input == vm_operator::jump_true || input == vm_operator::jump_false;
+    }
+
+    bool has_symbol_index(vm_operator input)
+    {
+        return input == vm_operator::get || input == vm_operator::set || input == vm_operator::define ||
+            input == vm_operator::inc || input == vm_operator::dec;
+    }
+
     int compare(double v1, double v2)
     {
         auto diff = v1 - v2;
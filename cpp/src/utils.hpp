@@ -10,6 +10,8 @@ namespace lysithea_vm
 {
     vm_operator parse_operator(const std::string &input);
     std::string to_string(vm_operator input);
+    bool is_jump_operator(vm_operator input);
+    bool has_symbol_index(vm_operator input);
 
     int compare(double v1, double v2);
     int compare(int v1, int v2);
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <stdexcept>
+#include <typeinfo>
+
+#include "./value.hpp"
+#include "./complex_value.hpp"
+
+namespace lysithea_vm
+{
+    using array_vector = std::vector<value>;
+
+    // A read only view over the arguments for a function call.
+    // For calls made by the VM this points directly at the top of the stack, so it is only valid until the call returns.
+    class arguments_view
+    {
+        public:
+            // Constructor
+            arguments_view() : data_begin(nullptr), length(0) { }
+            arguments_view(const value *data_begin, int length) : data_begin(data_begin), length(length) { }
+            arguments_view(const array_vector &input) : data_begin(input.data()), length(static_cast<int>(input.size())) { }
+
+            // Methods
+            inline int size() const { return length; }
+            inline bool empty() const { return length == 0; }
+
+            inline const value *begin() const { return data_begin; }
+            inline const value *end() const { return data_begin + length; }
+            inline const value *cbegin() const { return data_begin; }
+            inline const value *cend() const { return data_begin + length; }
+
+            inline const value &operator[](int index) const { return data_begin[index]; }
+
+            // Copies the arguments into a new array, only needed when the arguments have to outlive the call.
+            inline array_vector to_array() const
+            {
+                return array_vector(begin(), end());
+            }
+
+            template <typename T>
+            inline complex_ref<T> get_index(int index) const
+            {
+                auto casted = get_index(index).get_complex<T>();
+                if (!casted)
+                {
+                    throw std::bad_cast();
+                }
+
+                return casted;
+            }
+
+            inline bool get_bool(int index) const
+            {
+                const auto &result = get_index(index);
+                if (result.is_bool())
+                {
+                    return result.get_bool();
+                }
+                throw std::bad_cast();
+            }
+
+            inline double get_number(int index) const
+            {
+                const auto &result = get_index(index);
+                if (result.is_number())
+                {
+                    return result.get_number();
+                }
+                throw std::bad_cast();
+            }
+
+            inline int get_int(int index) const
+            {
+                const auto &result = get_index(index);
+                if (result.is_number())
+                {
+                    return result.get_int();
+                }
+                throw std::bad_cast();
+            }
+
+            inline const value &get_index(int index) const
+            {
+                if (index < 0)
+                {
+                    index += length;
+                }
+
+                if (index < 0 || index >= length)
+                {
+                    throw std::out_of_range("Error getting argument at index, out of range");
+                }
+
+                return data_begin[index];
+            }
+
+        private:
+            // Fields
+            const value *data_begin;
+            int length;
+    };
+} // lysithea_vm
\ No newline at end of file
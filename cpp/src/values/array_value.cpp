@@ -10,7 +10,7 @@
 
 namespace lysithea_vm
 {
-    value array_value::empty(std::make_shared<array_value>(false));
+    value array_value::empty(make_complex<array_value>(false));
 
     int array_value::compare_to(const complex_value *input) const
     {
@@ -20,21 +20,21 @@ namespace lysithea_vm
             return 1;
         }
 
-        const auto &other_array = other->data;
-
-        auto compare_length = compare(data.size(), other_array.size());
+        auto compare_length = compare(data.size(), other->data.size());
         if (compare_length != 0)
         {
             return compare_length;
         }
 
-        for (auto i = 0; i < data.size(); i++)
+        auto other_iter = other->data.begin();
+        for (const auto &iter : data)
         {
-            auto compare_value = data[i].compare_to(other_array[i]);
+            auto compare_value = iter.compare_to(*other_iter);
             if (compare_value != 0)
             {
                 return compare_value;
             }
+            ++other_iter;
         }
 
         return 0;
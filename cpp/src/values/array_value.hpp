@@ -7,6 +7,7 @@
 
 #include "./complex_value.hpp"
 #include "./value.hpp"
+#include "./persistent_array.hpp"
 
 namespace lysithea_vm
 {
@@ -18,7 +19,7 @@ namespace lysithea_vm
             // Fields
             static value empty;
 
-            array_vector data;
+            persistent_array data;
             bool is_arguments_value;
 
             // Constructor
@@ -27,12 +28,14 @@ namespace lysithea_vm
             }
             array_value(const array_vector &value, bool is_arguments_value)
                 : data(value), is_arguments_value(is_arguments_value) { }
+            array_value(const persistent_array &value, bool is_arguments_value)
+                : data(value), is_arguments_value(is_arguments_value) { }
 
             virtual ~array_value() { }
 
             // Helper Methods
             template <typename T>
-            inline std::shared_ptr<T> get_index(int index) const
+            inline complex_ref<T> get_index(int index) const
             {
                 index = calc_index(index);
                 if (index < 0 || index >= data.size())
@@ -40,7 +43,7 @@ namespace lysithea_vm
                     throw std::out_of_range("Error getting array at index, out of range");
                 }
 
-                auto casted = std::dynamic_pointer_cast<T>(data[index].get_complex());
+                auto casted = data[index].get_complex<T>();
                 if (!casted)
                 {
                     throw std::bad_cast();
@@ -92,7 +95,11 @@ namespace lysithea_vm
 
             static inline lysithea_vm::value make_value(const array_vector &input, bool is_argument_value = false)
             {
-                return lysithea_vm::value(std::make_shared<array_value>(input, is_argument_value));
+                return lysithea_vm::value(make_complex<array_value>(input, is_argument_value));
+            }
+            static inline lysithea_vm::value make_value(const persistent_array &input, bool is_argument_value = false)
+            {
+                return lysithea_vm::value(make_complex<array_value>(input, is_argument_value));
             }
 
             // Value Methods
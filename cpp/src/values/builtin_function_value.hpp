@@ -8,8 +8,9 @@
 namespace lysithea_vm
 {
     class virtual_machine;
+    class arguments_view;
 
-    using builtin_function_callback = std::function<void (virtual_machine &, const array_value &)>;
+    using builtin_function_callback = std::function<void (virtual_machine &, const arguments_view &)>;
 
     class builtin_function_value : public complex_value
     {
@@ -36,9 +37,9 @@ namespace lysithea_vm
             virtual std::string type_name() const { return "builtin-function"; }
             virtual bool is_function() const { return true; }
 
-            virtual void invoke(virtual_machine &vm, std::shared_ptr<const array_value> args, bool push_to_stack_trace) const
+            virtual void invoke(virtual_machine &vm, const arguments_view &args, bool push_to_stack_trace) const
             {
-                data(vm, *args);
+                data(vm, args);
             }
     };
 } // lysithea_vm
\ No newline at end of file
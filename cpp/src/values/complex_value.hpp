@@ -4,17 +4,32 @@
 #include <vector>
 #include <memory>
 #include <stdexcept>
+#include <utility>
+
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+#ifdef __GLIBCXX__
+#include <ext/atomicity.h>
+#else
+#include <atomic>
+#endif
+#endif
 
 namespace lysithea_vm
 {
     class value;
     class virtual_machine;
     class array_value;
+    class arguments_view;
 
     class complex_value
     {
         public:
             // Constructor
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+            complex_value() : ref_count(0) { }
+            complex_value(const complex_value &) : ref_count(0) { }
+            complex_value &operator=(const complex_value &) { return *this; }
+#endif
             virtual ~complex_value() { }
 
             // Methods
@@ -43,13 +58,150 @@ namespace lysithea_vm
 
             // Function methods
             virtual bool is_function() const { return false; }
-            virtual void invoke(virtual_machine &vm, std::shared_ptr<const array_value> args, bool push_to_stack_trace) const
+            virtual void invoke(virtual_machine &vm, const arguments_view &args, bool push_to_stack_trace) const
             {
                 throw std::runtime_error("Attempting to invoke a function that does not override the invoke method");
             }
 
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+            // Reference counting methods
+            // With libstdc++ this uses the same dispatch as std::shared_ptr, which skips
+            // the atomic instructions while the program only has a single thread.
+            inline void add_ref() const
+            {
+#ifdef __GLIBCXX__
+                __gnu_cxx::__atomic_add_dispatch(&ref_count, 1);
+#else
+                ref_count.fetch_add(1, std::memory_order_relaxed);
+#endif
+            }
+            inline void release() const
+            {
+#ifdef __GLIBCXX__
+                if (__gnu_cxx::__exchange_and_add_dispatch(&ref_count, -1) == 1)
+#else
+                if (ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+#endif
+                {
+                    delete this;
+                }
+            }
+#endif
+
         private:
             // Fields
             static const std::vector<std::string> empty_object_keys;
+
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+#ifdef __GLIBCXX__
+            mutable _Atomic_word ref_count;
+#else
+            mutable std::atomic<int> ref_count;
+#endif
+#endif
+    };
+
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+    // Intrusive reference counted pointer that uses the count stored on the complex value.
+    template <typename T>
+    class complex_ref
+    {
+        public:
+            // Constructor
+            complex_ref() : ptr(nullptr) { }
+            complex_ref(std::nullptr_t) : ptr(nullptr) { }
+            explicit complex_ref(T *input) : ptr(input)
+            {
+                if (ptr) { ptr->add_ref(); }
+            }
+            complex_ref(const complex_ref &other) : ptr(other.ptr)
+            {
+                if (ptr) { ptr->add_ref(); }
+            }
+            complex_ref(complex_ref &&other) noexcept : ptr(other.ptr)
+            {
+                other.ptr = nullptr;
+            }
+            template <typename U>
+            complex_ref(const complex_ref<U> &other) : ptr(other.get())
+            {
+                if (ptr) { ptr->add_ref(); }
+            }
+            template <typename U>
+            complex_ref(complex_ref<U> &&other) : ptr(other.detach()) { }
+            ~complex_ref()
+            {
+                if (ptr) { ptr->release(); }
+            }
+
+            // Methods
+            complex_ref &operator=(complex_ref other)
+            {
+                std::swap(ptr, other.ptr);
+                return *this;
+            }
+
+            inline T *get() const { return ptr; }
+            inline T *operator->() const { return ptr; }
+            inline T &operator*() const { return *ptr; }
+            inline explicit operator bool() const { return ptr != nullptr; }
+
+            inline void reset()
+            {
+                complex_ref().swap(*this);
+            }
+            inline void swap(complex_ref &other)
+            {
+                std::swap(ptr, other.ptr);
+            }
+
+            // Gives up ownership of the pointer without releasing it.
+            inline T *detach()
+            {
+                auto result = ptr;
+                ptr = nullptr;
+                return result;
+            }
+
+        private:
+            // Fields
+            T *ptr;
     };
+
+    template <typename T, typename U>
+    inline bool operator==(const complex_ref<T> &left, const complex_ref<U> &right) { return left.get() == right.get(); }
+    template <typename T, typename U>
+    inline bool operator!=(const complex_ref<T> &left, const complex_ref<U> &right) { return left.get() != right.get(); }
+    template <typename T>
+    inline bool operator==(const complex_ref<T> &left, std::nullptr_t) { return left.get() == nullptr; }
+    template <typename T>
+    inline bool operator!=(const complex_ref<T> &left, std::nullptr_t) { return left.get() != nullptr; }
+
+    template <typename T, typename... Args>
+    inline complex_ref<T> make_complex(Args&&... args)
+    {
+        return complex_ref<T>(new T(std::forward<Args>(args)...));
+    }
+
+    template <typename T, typename U>
+    inline complex_ref<T> complex_cast(const complex_ref<U> &input)
+    {
+        return complex_ref<T>(dynamic_cast<T *>(input.get()));
+    }
+#else
+    template <typename T>
+    using complex_ref = std::shared_ptr<T>;
+
+    template <typename T, typename... Args>
+    inline complex_ref<T> make_complex(Args&&... args)
+    {
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+
+    template <typename T, typename U>
+    inline complex_ref<T> complex_cast(const complex_ref<U> &input)
+    {
+        return std::dynamic_pointer_cast<T>(input);
+    }
+#endif
 } // lysithea_vm
\ No newline at end of file
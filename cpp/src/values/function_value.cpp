@@ -2,10 +2,11 @@
 
 #include "../virtual_machine.hpp"
 #include "./array_value.hpp"
+#include "./arguments_view.hpp"
 
 namespace lysithea_vm
 {
-    void function_value::invoke(virtual_machine &vm, std::shared_ptr<const array_value> args, bool push_to_stack_trace) const
+    void function_value::invoke(virtual_machine &vm, const arguments_view &args, bool push_to_stack_trace) const
     {
         vm.execute_function(data, args, push_to_stack_trace);
     }
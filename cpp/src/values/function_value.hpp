@@ -35,7 +35,7 @@ namespace lysithea_vm
             virtual std::string type_name() const { return "function"; }
             virtual bool is_function() const { return true; }
 
-            virtual void invoke(virtual_machine &vm, std::shared_ptr<const array_value> args, bool push_to_stack_trace) const;
+            virtual void invoke(virtual_machine &vm, const arguments_view &args, bool push_to_stack_trace) const;
     };
 
 } // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "object_shape.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace lysithea_vm
+{
+    namespace
+    {
+        std::atomic<std::uint64_t> next_shape_id(1);
+    }
+
+    int object_shape::find_slot(const std::string &key) const
+    {
+        auto find = std::lower_bound(keys.begin(), keys.end(), key);
+        if (find == keys.end() || *find != key)
+        {
+            return -1;
+        }
+
+        return static_cast<int>(find - keys.begin());
+    }
+
+    std::shared_ptr<const object_shape> object_shape::with_key(const std::string &key) const
+    {
+        {
+            std::lock_guard<std::mutex> guard(transitions_lock);
+            auto find = transitions.find(key);
+            if (find != transitions.end())
+            {
+                auto result = find->second.lock();
+                if (result)
+                {
+                    return result;
+                }
+            }
+
+            // Only this shape makes the shape with the key on the end, so there is only ever one shape for a set of keys.
+            if (keys.empty() || keys.back() < key)
+            {
+                auto new_keys = keys;
+                new_keys.push_back(key);
+                std::shared_ptr<const object_shape> result(new object_shape(next_shape_id++, new_keys, shared_from_this()), release);
+                transitions[key] = result;
+                return result;
+            }
+        }
+
+        // Otherwise the shape was made by another shape, it is found once and remembered here.
+        auto new_keys = keys;
+        new_keys.insert(std::lower_bound(new_keys.begin(), new_keys.end(), key), key);
+        auto result = intern(new_keys);
+
+        std::lock_guard<std::mutex> guard(transitions_lock);
+        transitions[key] = result;
+        return result;
+    }
+
+    std::shared_ptr<const object_shape> object_shape::without_slot(int slot) const
+    {
+        auto new_keys = keys;
+        new_keys.erase(new_keys.begin() + slot);
+        return intern(new_keys);
+    }
+
+    std::shared_ptr<const object_shape> object_shape::empty()
+    {
+        static std::shared_ptr<const object_shape> empty_shape(new object_shape(next_shape_id++, std::vector<std::string>(), nullptr), release);
+        return empty_shape;
+    }
+
+    std::shared_ptr<const object_shape> object_shape::intern(const std::vector<std::string> &keys)
+    {
+        // Following the keys in order from the empty shape gets the same shape however the object was built.
+        auto result = empty();
+        for (const auto &key : keys)
+        {
+            result = result->with_key(key);
+        }
+
+        return result;
+    }
+
+    // Removes the shape from its parent when the last object using it is gone,
+    // unless the parent has already made a new shape for the same keys.
+    void object_shape::release(const object_shape *shape)
+    {
+        if (shape->parent)
+        {
+            auto &parent = *shape->parent;
+            std::lock_guard<std::mutex> guard(parent.transitions_lock);
+            auto find = parent.transitions.find(shape->keys.back());
+            if (find != parent.transitions.end() && find->second.expired())
+            {
+                parent.transitions.erase(find);
+            }
+        }
+
+        delete shape;
+    }
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lysithea_vm
+{
+    // The layout of an object, the sorted list of its keys where the index of a key is the slot its value is stored in.
+    // Shapes are shared so objects with the same keys point at the same shape, and a shape is freed when no object is using it.
+    // Each shape is made by the shape without its last key, which it keeps alive, and every shape remembers the shapes it
+    // has been extended to, so adding a key that has been added before is a single lookup in that shape.
+    class object_shape : public std::enable_shared_from_this<object_shape>
+    {
+        public:
+            // Fields
+            // Unique for the life of the program, so it can be cached without keeping the shape alive.
+            const std::uint64_t id;
+            const std::vector<std::string> keys;
+
+            object_shape(const object_shape &) = delete;
+            object_shape &operator=(const object_shape &) = delete;
+
+            // Methods
+            // Returns -1 if the key is not part of the shape.
+            int find_slot(const std::string &key) const;
+
+            inline std::size_t size() const { return keys.size(); }
+
+            std::shared_ptr<const object_shape> with_key(const std::string &key) const;
+            std::shared_ptr<const object_shape> without_slot(int slot) const;
+
+            static std::shared_ptr<const object_shape> empty();
+            // The keys must already be sorted and unique.
+            static std::shared_ptr<const object_shape> intern(const std::vector<std::string> &keys);
+
+        private:
+            // Fields
+            const std::shared_ptr<const object_shape> parent;
+
+            mutable std::mutex transitions_lock;
+            // The shape with each key added, the new key doesn't have to come last.
+            mutable std::unordered_map<std::string, std::weak_ptr<const object_shape>> transitions;
+
+            // Constructor
+            object_shape(std::uint64_t id, const std::vector<std::string> &keys, std::shared_ptr<const object_shape> parent) :
+                id(id), keys(keys), parent(std::move(parent)) { }
+
+            // Methods
+            static void release(const object_shape *shape);
+    };
+} // lysithea_vm
\ No newline at end of file
@@ -1,13 +1,114 @@
 #include "object_value.hpp"
 
+#include <algorithm>
 #include <sstream>
+#include <typeinfo>
+#include <utility>
 
 #include "../utils.hpp"
 #include "../values/array_value.hpp"
 
 namespace lysithea_vm
 {
-    value object_value::empty(std::make_shared<object_value>());
+    namespace
+    {
+        using object_entry = std::pair<std::string, value>;
+
+        // Sorts the entries by key, if a key is given more than once the last one wins.
+        value make_from_entries(std::vector<object_entry> &entries)
+        {
+            std::stable_sort(entries.begin(), entries.end(), [](const object_entry &left, const object_entry &right)
+            {
+                return left.first < right.first;
+            });
+
+            std::vector<std::string> keys;
+            std::vector<value> values;
+            keys.reserve(entries.size());
+            values.reserve(entries.size());
+            for (auto &iter : entries)
+            {
+                if (!keys.empty() && keys.back() == iter.first)
+                {
+                    values.back() = iter.second;
+                    continue;
+                }
+
+                keys.push_back(std::move(iter.first));
+                values.push_back(iter.second);
+            }
+
+            if (keys.size() > object_value::max_shape_size)
+            {
+                persistent_map map;
+                for (auto i = 0u; i < keys.size(); i++)
+                {
+                    map = map.set(keys[i], values[i]);
+                }
+                return value(make_complex<object_value>(map));
+            }
+
+            return value(make_complex<object_value>(object_shape::intern(keys), std::move(values)));
+        }
+
+        // Join takes pairs of keys and values or whole objects to copy the keys from.
+        template <typename Callback>
+        void read_join_args(const value *begin, const value *end, Callback add)
+        {
+            for (auto iter = begin; iter != end; ++iter)
+            {
+                if (iter->is_string() || !iter->is_object())
+                {
+                    auto key = iter->to_string();
+                    ++iter;
+                    add(key, *iter);
+                    continue;
+                }
+
+                auto object = iter->get_complex<const object_value>();
+                if (object)
+                {
+                    object->for_each(add);
+                    continue;
+                }
+
+                auto complex = iter->get_complex();
+                for (const auto &key : complex->object_keys())
+                {
+                    value obj_value;
+                    if (complex->try_get(key, obj_value))
+                    {
+                        add(key, obj_value);
+                    }
+                }
+            }
+        }
+    }
+
+    value object_value::empty(make_complex<object_value>());
+
+    object_value::object_value(const object_map &data)
+    {
+        if (data.size() > max_shape_size)
+        {
+            for (const auto &iter : data)
+            {
+                map = map.set(iter.first, iter.second);
+            }
+            return;
+        }
+
+        std::vector<std::string> keys;
+        keys.reserve(data.size());
+        values.reserve(data.size());
+        for (const auto &iter : data)
+        {
+            keys.push_back(iter.first);
+            values.push_back(iter.second);
+        }
+
+        shape = object_shape::intern(keys);
+    }
 
     int object_value::compare_to(const complex_value *input) const
     {
@@ -17,30 +118,35 @@ namespace lysithea_vm
             return 1;
         }
 
-        const auto &other_object = other->data;
-
-        auto compare_length = compare(data.size(), other_object.size());
+        auto compare_length = compare(size(), other->size());
         if (compare_length != 0)
         {
             return compare_length;
         }
 
-        for (auto iter = data.cbegin(); iter != data.cend(); ++iter)
+        // Stops at the first key that is missing or has a different value, a different value has always counted as equal.
+        auto result = 0;
+        auto done = false;
+        for_each([&](const std::string &key, const value &item)
         {
-            auto find_other = other_object.find(iter->first);
-            if (find_other == other_object.end())
+            if (done)
             {
-                return 1;
+                return;
             }
 
-            auto compare_value = iter->second.compare_to(find_other->second);
-            if (compare_value != 0)
+            value other_value;
+            if (!other->try_get(key, other_value))
             {
-                return 0;
+                result = 1;
+                done = true;
             }
-        }
+            else if (item.compare_to(other_value) != 0)
+            {
+                done = true;
+            }
+        });
 
-        return 0;
+        return result;
     }
 
     std::string object_value::to_string() const
@@ -48,7 +154,7 @@ namespace lysithea_vm
         std::stringstream ss;
         ss << '{';
         auto first = true;
-        for (const auto &iter : data)
+        for_each([&](const std::string &key, const value &item)
         {
             if (!first)
             {
@@ -57,46 +163,109 @@ namespace lysithea_vm
             first = false;
 
             ss << '"';
-            ss << iter.first;
+            ss << key;
             ss << "\" ";
-            ss << iter.second.to_string();
-        }
+            ss << item.to_string();
+        });
         ss << '}';
         return ss.str();
     }
 
-    value object_value::join(const array_value &args)
+    std::vector<std::string> object_value::object_keys() const
     {
-        object_map obj;
+        if (shape)
+        {
+            return shape->keys;
+        }
 
-        for (auto iter = args.data.cbegin(); iter != args.data.cend(); ++iter)
+        std::vector<std::string> result;
+        result.reserve(map.size());
+        for (auto iter : map.sorted_entries())
         {
-            if (iter->is_string())
-            {
-                auto key = iter->to_string();
-                ++iter;
-                obj[key] = *iter;
-            }
-            else if (iter->is_object())
+            result.push_back(iter->key);
+        }
+        return result;
+    }
+
+    object_map object_value::to_map() const
+    {
+        object_map result;
+        for_each([&](const std::string &key, const value &item)
+        {
+            result.emplace(key, item);
+        });
+        return result;
+    }
+
+    value object_value::with_value(const std::string &key, const value &input) const
+    {
+        if (!shape)
+        {
+            return value(make_complex<object_value>(map.set(key, input)));
+        }
+
+        auto slot = shape->find_slot(key);
+        if (slot >= 0)
+        {
+            auto new_values = values;
+            new_values[slot] = input;
+            return value(make_complex<object_value>(shape, std::move(new_values)));
+        }
+
+        if (values.size() >= max_shape_size)
+        {
+            persistent_map new_map;
+            for (auto i = 0u; i < values.size(); i++)
             {
-                auto complex = iter->get_complex();
-                for (auto key : complex->object_keys())
-                {
-                    value obj_value;
-                    if (complex->try_get(key, obj_value))
-                    {
-                        obj[key] = obj_value;
-                    }
-                }
+                new_map = new_map.set(shape->keys[i], values[i]);
             }
-            else
+            return value(make_complex<object_value>(new_map.set(key, input)));
+        }
+
+        auto new_shape = shape->with_key(key);
+        auto new_slot = new_shape->find_slot(key);
+
+        std::vector<value> new_values;
+        new_values.reserve(values.size() + 1);
+        new_values.insert(new_values.end(), values.begin(), values.begin() + new_slot);
+        new_values.push_back(input);
+        new_values.insert(new_values.end(), values.begin() + new_slot, values.end());
+        return value(make_complex<object_value>(new_shape, std::move(new_values)));
+    }
+
+    value object_value::without_key(const std::string &key) const
+    {
+        if (!shape)
+        {
+            return value(make_complex<object_value>(map.erase(key)));
+        }
+
+        auto slot = shape->find_slot(key);
+        auto new_values = values;
+        new_values.erase(new_values.begin() + slot);
+        return value(make_complex<object_value>(shape->without_slot(slot), std::move(new_values)));
+    }
+
+    value object_value::join(const arguments_view &args)
+    {
+        // Adding to an object that is already using a map only needs to change the map, not build a new one.
+        auto first = args.empty() ? nullptr : args[0].get_complex_raw();
+        if (first && typeid(*first) == typeid(object_value) && !static_cast<const object_value *>(first)->shape)
+        {
+            auto map = static_cast<const object_value *>(first)->map;
+            read_join_args(args.cbegin() + 1, args.cend(), [&](const std::string &key, const value &item)
             {
-                auto key = iter->to_string();
-                ++iter;
-                obj[key] = *iter;
-            }
+                map = map.set(key, item);
+            });
+            return value(make_complex<object_value>(map));
         }
 
-        return object_value::make_value(obj);
+        std::vector<object_entry> entries;
+        read_join_args(args.cbegin(), args.cend(), [&](const std::string &key, const value &item)
+        {
+            entries.emplace_back(key, item);
+        });
+
+        return make_from_entries(entries);
     }
 } // lysithea_vm
\ No newline at end of file
@@ -3,24 +3,37 @@
 #include <memory>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "./complex_value.hpp"
 #include "./value.hpp"
+#include "./arguments_view.hpp"
+#include "./object_shape.hpp"
+#include "./persistent_map.hpp"
 
 namespace lysithea_vm
 {
     using object_map = std::map<std::string, value>;
 
+    // Objects with only a few keys are stored as a shared shape and a flat list of values, one for each key in the shape.
+    // Objects with more keys than that are stored in a persistent_map instead and have no shape, so adding and removing keys
+    // one at a time doesn't copy the whole object each time.
     class object_value : public complex_value
     {
         public:
             // Fields
             static value empty;
-            object_map data;
+            static const std::size_t max_shape_size = 32;
+
+            std::shared_ptr<const object_shape> shape;
+            std::vector<value> values;
+            persistent_map map;
 
             // Constructor
-            object_value() { }
-            object_value(const object_map &data) : data(data) { }
+            object_value() : shape(object_shape::empty()) { }
+            object_value(const object_map &data);
+            object_value(std::shared_ptr<const object_shape> shape, std::vector<value> &&values) : shape(shape), values(std::move(values)) { }
+            object_value(const persistent_map &map) : map(map) { }
 
             // Methods
             virtual int compare_to(const complex_value *input) const;
@@ -29,35 +42,70 @@ namespace lysithea_vm
             virtual std::string type_name() const { return "object"; }
             virtual bool is_object() const { return true; }
 
-            virtual std::vector<std::string> object_keys() const
+            virtual std::vector<std::string> object_keys() const;
+
+            virtual bool try_get(const std::string &key, lysithea_vm::value &result) const
             {
-                std::vector<std::string> result;
+                if (!shape)
+                {
+                    auto found = map.find(key);
+                    if (!found)
+                    {
+                        return false;
+                    }
+
+                    result = *found;
+                    return true;
+                }
 
-                for (const auto &iter : data)
+                auto slot = shape->find_slot(key);
+                if (slot < 0)
                 {
-                    result.push_back(iter.first);
+                    return false;
                 }
 
-                return result;
+                result = values[slot];
+                return true;
             }
 
-            virtual bool try_get(const std::string &key, lysithea_vm::value &result) const
+            inline std::size_t size() const { return shape ? values.size() : map.size(); }
+
+            inline bool has_key(const std::string &key) const
             {
-                auto find = data.find(key);
-                if (find == data.end())
+                return shape ? shape->find_slot(key) >= 0 : map.find(key) != nullptr;
+            }
+
+            // Calls the callback with each key and value in key order.
+            template <typename Callback>
+            void for_each(Callback callback) const
+            {
+                if (shape)
                 {
-                    return false;
+                    for (auto slot = 0u; slot < values.size(); slot++)
+                    {
+                        callback(shape->keys[slot], values[slot]);
+                    }
+                    return;
                 }
 
-                result = find->second;
-                return true;
+                for (auto iter : map.sorted_entries())
+                {
+                    callback(iter->key, iter->value);
+                }
             }
 
+            object_map to_map() const;
+
+            // Returns a new object with the key added or replaced.
+            value with_value(const std::string &key, const value &input) const;
+            // Returns a new object without the key, the key must be in this object.
+            value without_key(const std::string &key) const;
+
             static inline lysithea_vm::value make_value(const object_map &input)
             {
-                return lysithea_vm::value(std::make_shared<object_value>(input));
+                return lysithea_vm::value(make_complex<object_value>(input));
             }
 
-            static value join(const array_value &args);
+            static value join(const arguments_view &args);
     };
 } // lysithea_vm
\ No newline at end of file
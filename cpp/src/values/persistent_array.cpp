@@ -0,0 +1,288 @@
+#include "persistent_array.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace lysithea_vm
+{
+    namespace
+    {
+        using node_list = std::vector<array_node_ptr>;
+
+        const std::size_t max_size = array_node::max_size;
+
+        array_node_ptr make_leaf(std::vector<value> &&values)
+        {
+            auto result = std::make_shared<array_node>();
+            result->size = values.size();
+            result->values = std::move(values);
+            return result;
+        }
+
+        array_node_ptr make_branch(node_list &&children)
+        {
+            auto result = std::make_shared<array_node>();
+            result->children = std::move(children);
+            result->ends.reserve(result->children.size());
+
+            std::size_t total = 0;
+            for (const auto &iter : result->children)
+            {
+                total += iter->size;
+                result->ends.push_back(total);
+            }
+            result->size = total;
+            return result;
+        }
+
+        // Builds the tree up a level at a time from full leaves.
+        array_node_ptr build_tree(const std::vector<value> &input)
+        {
+            if (input.empty())
+            {
+                return nullptr;
+            }
+
+            node_list level;
+            for (auto start = 0u; start < input.size(); start += max_size)
+            {
+                auto end = std::min(start + max_size, input.size());
+                level.push_back(make_leaf(std::vector<value>(input.begin() + start, input.begin() + end)));
+            }
+
+            while (level.size() > 1)
+            {
+                node_list next_level;
+                for (auto start = 0u; start < level.size(); start += max_size)
+                {
+                    auto end = std::min(start + max_size, level.size());
+                    next_level.push_back(make_branch(node_list(level.begin() + start, level.begin() + end)));
+                }
+                level = std::move(next_level);
+            }
+
+            return level.front();
+        }
+
+        std::size_t find_child(const array_node &node, std::size_t position, std::size_t &child_start)
+        {
+            auto find = std::upper_bound(node.ends.begin(), node.ends.end(), position);
+            auto index = std::min(static_cast<std::size_t>(find - node.ends.begin()), node.children.size() - 1);
+            child_start = index > 0 ? node.ends[index - 1] : 0;
+            return index;
+        }
+
+        // Splits a list that has gone one over the max size. When the extra item was added at the end the first node
+        // is left full, so that building an array by appending doesn't leave every node half empty.
+        template <typename T>
+        void split_list(std::vector<T> &&input, bool added_at_end, std::vector<T> &first, std::vector<T> &second)
+        {
+            auto split = input.begin() + (added_at_end ? max_size : input.size() / 2);
+            first.assign(std::make_move_iterator(input.begin()), std::make_move_iterator(split));
+            second.assign(std::make_move_iterator(split), std::make_move_iterator(input.end()));
+        }
+
+        array_node_ptr set_value(const array_node &node, std::size_t position, const value &input)
+        {
+            if (node.is_leaf())
+            {
+                auto values = node.values;
+                values[position] = input;
+                return make_leaf(std::move(values));
+            }
+
+            std::size_t child_start;
+            auto index = find_child(node, position, child_start);
+            auto children = node.children;
+            children[index] = set_value(*children[index], position - child_start, input);
+            return make_branch(std::move(children));
+        }
+
+        // Adds either the new node or two nodes if it had to be split to the result.
+        void insert_value(const array_node &node, std::size_t position, const value &input, node_list &result)
+        {
+            if (node.is_leaf())
+            {
+                std::vector<value> values;
+                values.reserve(node.values.size() + 1);
+                values.insert(values.end(), node.values.begin(), node.values.begin() + position);
+                values.push_back(input);
+                values.insert(values.end(), node.values.begin() + position, node.values.end());
+
+                if (values.size() <= max_size)
+                {
+                    result.push_back(make_leaf(std::move(values)));
+                    return;
+                }
+
+                std::vector<value> first, second;
+                split_list(std::move(values), position == node.values.size(), first, second);
+                result.push_back(make_leaf(std::move(first)));
+                result.push_back(make_leaf(std::move(second)));
+                return;
+            }
+
+            std::size_t child_start;
+            auto index = find_child(node, position, child_start);
+            node_list replaced;
+            insert_value(*node.children[index], position - child_start, input, replaced);
+
+            node_list children;
+            children.reserve(node.children.size() + 1);
+            children.insert(children.end(), node.children.begin(), node.children.begin() + index);
+            children.insert(children.end(), replaced.begin(), replaced.end());
+            children.insert(children.end(), node.children.begin() + index + 1, node.children.end());
+
+            if (children.size() <= max_size)
+            {
+                result.push_back(make_branch(std::move(children)));
+                return;
+            }
+
+            node_list first, second;
+            split_list(std::move(children), index == node.children.size() - 1, first, second);
+            result.push_back(make_branch(std::move(first)));
+            result.push_back(make_branch(std::move(second)));
+        }
+
+        // Returns null when the node has nothing left in it.
+        array_node_ptr erase_value(const array_node &node, std::size_t position)
+        {
+            if (node.is_leaf())
+            {
+                if (node.values.size() == 1)
+                {
+                    return nullptr;
+                }
+
+                auto values = node.values;
+                values.erase(values.begin() + position);
+                return make_leaf(std::move(values));
+            }
+
+            std::size_t child_start;
+            auto index = find_child(node, position, child_start);
+            auto replaced = erase_value(*node.children[index], position - child_start);
+
+            auto children = node.children;
+            if (!replaced)
+            {
+                children.erase(children.begin() + index);
+                if (children.empty())
+                {
+                    return nullptr;
+                }
+            }
+            else
+            {
+                children[index] = replaced;
+
+                // Merge leaves that have been mostly emptied with their neighbour so lots of removes don't leave lots of tiny leaves.
+                auto neighbour = index + 1 < children.size() ? index + 1 : index - 1;
+                if (replaced->is_leaf() && replaced->size < max_size / 4 && children.size() > 1 &&
+                    children[neighbour]->is_leaf() && replaced->size + children[neighbour]->size <= max_size)
+                {
+                    auto left = std::min(index, neighbour);
+                    std::vector<value> values(children[left]->values);
+                    values.insert(values.end(), children[left + 1]->values.begin(), children[left + 1]->values.end());
+                    children[left] = make_leaf(std::move(values));
+                    children.erase(children.begin() + left + 1);
+                }
+            }
+
+            return make_branch(std::move(children));
+        }
+    }
+
+    persistent_array::persistent_array(const std::vector<value> &input) : root(build_tree(input)), offset(0), length(input.size()) { }
+
+    persistent_array persistent_array::set(std::size_t index, const value &input) const
+    {
+        return persistent_array(set_value(*root, offset + index, input), offset, length);
+    }
+
+    persistent_array persistent_array::insert(std::size_t index, const value &input) const
+    {
+        if (!root)
+        {
+            return persistent_array(make_leaf(std::vector<value>(1, input)), 0, 1);
+        }
+
+        node_list result;
+        insert_value(*root, offset + index, input, result);
+        auto new_root = result.size() == 1 ? result.front() : make_branch(std::move(result));
+        return persistent_array(new_root, offset, length + 1);
+    }
+
+    persistent_array persistent_array::insert(std::size_t index, const persistent_array &input) const
+    {
+        // A few values are quicker to add one at a time, otherwise it's quicker to build a new tree.
+        if (input.size() <= max_size)
+        {
+            auto result = *this;
+            for (const auto &iter : input)
+            {
+                result = result.insert(index++, iter);
+            }
+            return result;
+        }
+
+        std::vector<value> values;
+        values.reserve(length + input.size());
+        values.insert(values.end(), begin(), const_iterator(this, index));
+        values.insert(values.end(), input.begin(), input.end());
+        values.insert(values.end(), const_iterator(this, index), end());
+        return persistent_array(values);
+    }
+
+    persistent_array persistent_array::erase(std::size_t index) const
+    {
+        if (length == 1)
+        {
+            return persistent_array();
+        }
+
+        auto new_root = erase_value(*root, offset + index);
+        while (!new_root->is_leaf() && new_root->children.size() == 1)
+        {
+            new_root = new_root->children.front();
+        }
+        return persistent_array(new_root, offset, length - 1);
+    }
+
+    persistent_array persistent_array::slice(std::size_t start, std::size_t count) const
+    {
+        if (count == 0)
+        {
+            return persistent_array();
+        }
+
+        // Small slices are copied so they don't keep a large array alive.
+        if (count <= max_size)
+        {
+            return persistent_array(make_leaf(std::vector<value>(const_iterator(this, start), const_iterator(this, start + count))), 0, count);
+        }
+
+        return persistent_array(root, offset + start, count);
+    }
+
+    std::vector<value> persistent_array::to_vector() const
+    {
+        return std::vector<value>(begin(), end());
+    }
+
+    const array_node *persistent_array::find_leaf(std::size_t position, std::size_t &leaf_start) const
+    {
+        const array_node *current = root.get();
+        leaf_start = 0;
+        while (!current->is_leaf())
+        {
+            std::size_t child_start;
+            auto index = find_child(*current, position - leaf_start, child_start);
+            leaf_start += child_start;
+            current = current->children[index].get();
+        }
+
+        return current;
+    }
+} // lysithea_vm
\ No newline at end of file
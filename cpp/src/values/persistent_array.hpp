@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "./value.hpp"
+
+namespace lysithea_vm
+{
+    class array_node;
+    using array_node_ptr = std::shared_ptr<const array_node>;
+
+    // Leaves hold the values and branches hold the other nodes, either way a node has at most max_size of them.
+    class array_node
+    {
+        public:
+            // Fields
+            static const std::size_t max_size = 32;
+
+            std::size_t size;
+            std::vector<value> values;
+            std::vector<array_node_ptr> children;
+            // The total size of the children up to and including each child.
+            std::vector<std::size_t> ends;
+
+            // Constructor
+            array_node() : size(0) { }
+
+            // Methods
+            inline bool is_leaf() const { return children.empty(); }
+    };
+
+    // An immutable array where changes return a new array that shares all but the changed path of nodes with the old one,
+    // so set, insert and remove are O(log n). A slice is an O(1) view onto the same nodes, so a small slice of a large
+    // array keeps the whole of the large array alive.
+    class persistent_array
+    {
+        public:
+            class const_iterator
+            {
+                public:
+                    // Types
+                    using iterator_category = std::forward_iterator_tag;
+                    using value_type = lysithea_vm::value;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = const lysithea_vm::value *;
+                    using reference = const lysithea_vm::value &;
+
+                    // Constructor
+                    const_iterator(const persistent_array *owner, std::size_t index) :
+                        owner(owner), index(index), leaf(nullptr), leaf_start(0), leaf_end(0) { }
+
+                    // Methods
+                    inline reference operator*() const
+                    {
+                        // Only look up the leaf again once the iterator has moved past the end of the last one.
+                        auto position = owner->offset + index;
+                        if (!leaf || position < leaf_start || position >= leaf_end)
+                        {
+                            leaf = owner->find_leaf(position, leaf_start);
+                            leaf_end = leaf_start + leaf->size;
+                        }
+                        return leaf->values[position - leaf_start];
+                    }
+                    inline pointer operator->() const { return &**this; }
+
+                    inline const_iterator &operator++()
+                    {
+                        index++;
+                        return *this;
+                    }
+                    inline const_iterator operator++(int)
+                    {
+                        auto result = *this;
+                        index++;
+                        return result;
+                    }
+
+                    inline bool operator==(const const_iterator &other) const { return index == other.index; }
+                    inline bool operator!=(const const_iterator &other) const { return index != other.index; }
+
+                private:
+                    // Fields
+                    const persistent_array *owner;
+                    std::size_t index;
+                    mutable const array_node *leaf;
+                    mutable std::size_t leaf_start;
+                    mutable std::size_t leaf_end;
+            };
+
+            // Constructor
+            persistent_array() : offset(0), length(0) { }
+            persistent_array(const std::vector<value> &input);
+
+            // Methods
+            inline std::size_t size() const { return length; }
+            inline bool empty() const { return length == 0; }
+
+            // The index is not checked.
+            inline const value &operator[](std::size_t index) const
+            {
+                if (root->is_leaf())
+                {
+                    return root->values[offset + index];
+                }
+
+                std::size_t leaf_start;
+                auto leaf = find_leaf(offset + index, leaf_start);
+                return leaf->values[offset + index - leaf_start];
+            }
+
+            inline const_iterator begin() const { return const_iterator(this, 0); }
+            inline const_iterator end() const { return const_iterator(this, length); }
+            inline const_iterator cbegin() const { return begin(); }
+            inline const_iterator cend() const { return end(); }
+
+            persistent_array set(std::size_t index, const value &input) const;
+            persistent_array insert(std::size_t index, const value &input) const;
+            persistent_array insert(std::size_t index, const persistent_array &input) const;
+            persistent_array erase(std::size_t index) const;
+            persistent_array slice(std::size_t start, std::size_t count) const;
+            inline persistent_array push_back(const value &input) const { return insert(length, input); }
+
+            std::vector<value> to_vector() const;
+
+        private:
+            // Fields
+            array_node_ptr root;
+            std::size_t offset;
+            std::size_t length;
+
+            // Constructor
+            persistent_array(array_node_ptr root, std::size_t offset, std::size_t length) :
+                root(root), offset(offset), length(length) { }
+
+            // Methods
+            const array_node *find_leaf(std::size_t position, std::size_t &leaf_start) const;
+    };
+} // lysithea_vm
\ No newline at end of file
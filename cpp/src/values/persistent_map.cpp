@@ -0,0 +1,290 @@
+#include "persistent_map.hpp"
+
+#include <algorithm>
+#include <functional>
+
+namespace lysithea_vm
+{
+    namespace
+    {
+        const int bits_per_level = 5;
+        const int max_shift = static_cast<int>(sizeof(std::size_t) * 8);
+
+        inline int count_bits(std::uint32_t input)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            return __builtin_popcount(input);
+#else
+            auto result = 0;
+            for (; input; input &= input - 1)
+            {
+                result++;
+            }
+            return result;
+#endif
+        }
+
+        inline std::uint32_t get_bit(std::size_t hash, int shift)
+        {
+            return 1u << ((hash >> shift) & 31);
+        }
+
+        inline int get_index(std::uint32_t map, std::uint32_t bit)
+        {
+            return count_bits(map & (bit - 1));
+        }
+
+        inline bool same_key(const map_entry &entry, std::size_t hash, const std::string &key)
+        {
+            return entry.hash == hash && entry.key == key;
+        }
+
+        map_node_ptr merge_entries(const map_entry_ptr &first, const map_entry_ptr &second, int shift)
+        {
+            auto result = std::make_shared<map_node>();
+            if (shift >= max_shift)
+            {
+                result->entries.push_back(first);
+                result->entries.push_back(second);
+                return result;
+            }
+
+            auto first_bit = get_bit(first->hash, shift);
+            auto second_bit = get_bit(second->hash, shift);
+            if (first_bit == second_bit)
+            {
+                result->child_map = first_bit;
+                result->children.push_back(merge_entries(first, second, shift + bits_per_level));
+            }
+            else
+            {
+                result->entry_map = first_bit | second_bit;
+                result->entries.push_back(first_bit < second_bit ? first : second);
+                result->entries.push_back(first_bit < second_bit ? second : first);
+            }
+            return result;
+        }
+
+        map_node_ptr set_value(const map_node &node, const map_entry_ptr &entry, int shift, bool &added)
+        {
+            auto result = std::make_shared<map_node>(node);
+            if (shift >= max_shift)
+            {
+                for (auto &iter : result->entries)
+                {
+                    if (iter->key == entry->key)
+                    {
+                        iter = entry;
+                        return result;
+                    }
+                }
+
+                result->entries.push_back(entry);
+                added = true;
+                return result;
+            }
+
+            auto bit = get_bit(entry->hash, shift);
+            if (node.entry_map & bit)
+            {
+                auto index = get_index(node.entry_map, bit);
+                const auto &existing = node.entries[index];
+                if (same_key(*existing, entry->hash, entry->key))
+                {
+                    result->entries[index] = entry;
+                    return result;
+                }
+
+                // Both entries need to move down into a new child.
+                result->entry_map &= ~bit;
+                result->entries.erase(result->entries.begin() + index);
+                result->child_map |= bit;
+                result->children.insert(result->children.begin() + get_index(result->child_map, bit), merge_entries(existing, entry, shift + bits_per_level));
+                added = true;
+                return result;
+            }
+
+            if (node.child_map & bit)
+            {
+                auto index = get_index(node.child_map, bit);
+                result->children[index] = set_value(*node.children[index], entry, shift + bits_per_level, added);
+                return result;
+            }
+
+            result->entry_map |= bit;
+            result->entries.insert(result->entries.begin() + get_index(result->entry_map, bit), entry);
+            added = true;
+            return result;
+        }
+
+        // Returns the same node if the key wasn't found, or null if the node has nothing left in it.
+        map_node_ptr erase_value(const map_node_ptr &node, std::size_t hash, const std::string &key, int shift, bool &removed)
+        {
+            if (shift >= max_shift)
+            {
+                for (auto i = 0u; i < node->entries.size(); i++)
+                {
+                    if (node->entries[i]->key == key)
+                    {
+                        removed = true;
+                        if (node->entries.size() == 1)
+                        {
+                            return nullptr;
+                        }
+
+                        auto result = std::make_shared<map_node>(*node);
+                        result->entries.erase(result->entries.begin() + i);
+                        return result;
+                    }
+                }
+
+                return node;
+            }
+
+            auto bit = get_bit(hash, shift);
+            if (node->entry_map & bit)
+            {
+                auto index = get_index(node->entry_map, bit);
+                if (!same_key(*node->entries[index], hash, key))
+                {
+                    return node;
+                }
+
+                removed = true;
+                if (node->entries.size() == 1 && node->children.empty())
+                {
+                    return nullptr;
+                }
+
+                auto result = std::make_shared<map_node>(*node);
+                result->entry_map &= ~bit;
+                result->entries.erase(result->entries.begin() + index);
+                return result;
+            }
+
+            if (node->child_map & bit)
+            {
+                auto index = get_index(node->child_map, bit);
+                auto child = erase_value(node->children[index], hash, key, shift + bits_per_level, removed);
+                if (!removed)
+                {
+                    return node;
+                }
+
+                auto result = std::make_shared<map_node>(*node);
+                if (child && (child->entries.size() > 1 || !child->children.empty()))
+                {
+                    result->children[index] = child;
+                    return result;
+                }
+
+                result->child_map &= ~bit;
+                result->children.erase(result->children.begin() + index);
+
+                // A child with only one entry left can have that entry moved up into this node.
+                if (child)
+                {
+                    result->entry_map |= bit;
+                    result->entries.insert(result->entries.begin() + get_index(result->entry_map, bit), child->entries.front());
+                }
+
+                if (result->entries.empty() && result->children.empty())
+                {
+                    return nullptr;
+                }
+                return result;
+            }
+
+            return node;
+        }
+
+        void add_entries(const map_node &node, std::vector<const map_entry *> &result)
+        {
+            for (const auto &iter : node.entries)
+            {
+                result.push_back(iter.get());
+            }
+
+            for (const auto &iter : node.children)
+            {
+                add_entries(*iter, result);
+            }
+        }
+    }
+
+    const value *persistent_map::find(const std::string &key) const
+    {
+        auto hash = std::hash<std::string>()(key);
+        auto node = root.get();
+        for (auto shift = 0; node; shift += bits_per_level)
+        {
+            if (shift >= max_shift)
+            {
+                for (const auto &iter : node->entries)
+                {
+                    if (iter->key == key)
+                    {
+                        return &iter->value;
+                    }
+                }
+                return nullptr;
+            }
+
+            auto bit = get_bit(hash, shift);
+            if (node->entry_map & bit)
+            {
+                const auto &entry = *node->entries[get_index(node->entry_map, bit)];
+                return same_key(entry, hash, key) ? &entry.value : nullptr;
+            }
+
+            if (!(node->child_map & bit))
+            {
+                return nullptr;
+            }
+
+            node = node->children[get_index(node->child_map, bit)].get();
+        }
+
+        return nullptr;
+    }
+
+    persistent_map persistent_map::set(const std::string &key, const value &input) const
+    {
+        auto entry = std::make_shared<map_entry>(std::hash<std::string>()(key), key, input);
+        auto added = false;
+        auto new_root = set_value(root ? *root : map_node(), entry, 0, added);
+        return persistent_map(new_root, added ? count + 1 : count);
+    }
+
+    persistent_map persistent_map::erase(const std::string &key) const
+    {
+        if (!root)
+        {
+            return *this;
+        }
+
+        auto removed = false;
+        auto new_root = erase_value(root, std::hash<std::string>()(key), key, 0, removed);
+        return removed ? persistent_map(new_root, count - 1) : *this;
+    }
+
+    void persistent_map::get_entries(std::vector<const map_entry *> &result) const
+    {
+        if (root)
+        {
+            add_entries(*root, result);
+        }
+    }
+
+    std::vector<const map_entry *> persistent_map::sorted_entries() const
+    {
+        std::vector<const map_entry *> result;
+        result.reserve(count);
+        get_entries(result);
+        std::sort(result.begin(), result.end(), [](const map_entry *left, const map_entry *right)
+        {
+            return left->key < right->key;
+        });
+        return result;
+    }
+} // lysithea_vm
\ No newline at end of file
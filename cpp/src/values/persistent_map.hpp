@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./value.hpp"
+
+namespace lysithea_vm
+{
+    class map_node;
+    class map_entry;
+    using map_node_ptr = std::shared_ptr<const map_node>;
+    using map_entry_ptr = std::shared_ptr<const map_entry>;
+
+    class map_entry
+    {
+        public:
+            // Fields
+            std::size_t hash;
+            std::string key;
+            lysithea_vm::value value;
+
+            // Constructor
+            map_entry(std::size_t hash, const std::string &key, const lysithea_vm::value &value) : hash(hash), key(key), value(value) { }
+    };
+
+    // A node in a hash array mapped trie. Each level uses 5 bits of the hash to pick one of 32 positions, which is either
+    // an entry, a child node or empty. Once the hash has run out of bits the node just holds a list of the colliding entries.
+    class map_node
+    {
+        public:
+            // Fields
+            std::uint32_t entry_map;
+            std::uint32_t child_map;
+            std::vector<map_entry_ptr> entries;
+            std::vector<map_node_ptr> children;
+
+            // Constructor
+            map_node() : entry_map(0), child_map(0) { }
+    };
+
+    // An immutable string keyed map where changes return a new map that shares all but the changed path of nodes with the old one.
+    class persistent_map
+    {
+        public:
+            // Constructor
+            persistent_map() : count(0) { }
+
+            // Methods
+            inline std::size_t size() const { return count; }
+            inline bool empty() const { return count == 0; }
+
+            const value *find(const std::string &key) const;
+            persistent_map set(const std::string &key, const value &input) const;
+            persistent_map erase(const std::string &key) const;
+
+            // Entries are not in any particular order.
+            void get_entries(std::vector<const map_entry *> &result) const;
+            // Entries sorted by key.
+            std::vector<const map_entry *> sorted_entries() const;
+
+        private:
+            // Fields
+            map_node_ptr root;
+            std::size_t count;
+
+            // Constructor
+            persistent_map(map_node_ptr root, std::size_t count) : root(root), count(count) { }
+    };
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "string_builder_value.hpp"
+
+#include "./values.hpp"
+
+namespace lysithea_vm
+{
+    complex_ref<string_builder_value> string_builder_value::append(const value *begin, const value *end) const
+    {
+        std::string text;
+        for (auto iter = begin; iter != end; ++iter)
+        {
+            auto str = iter->get_complex<const string_value>();
+            if (str)
+            {
+                text.append(str->c_str(), str->size());
+            }
+            else
+            {
+                text += iter->to_string();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(buffer->lock);
+            if (buffer->data.size() == length)
+            {
+                buffer->data += text;
+                return make_complex<string_builder_value>(buffer, length + text.size());
+            }
+        }
+
+        auto copy = std::make_shared<string_builder_buffer>();
+        {
+            std::lock_guard<std::mutex> lock(buffer->lock);
+            copy->data.reserve(length + text.size());
+            copy->data.append(buffer->data, 0, length);
+        }
+        copy->data += text;
+        return make_complex<string_builder_value>(copy, copy->data.size());
+    }
+
+    int string_builder_value::compare_to(const complex_value *input) const
+    {
+        auto other = dynamic_cast<const string_builder_value *>(input);
+        if (!other)
+        {
+            return 1;
+        }
+
+        return to_string().compare(other->to_string());
+    }
+
+    std::string string_builder_value::to_string() const
+    {
+        std::lock_guard<std::mutex> lock(buffer->lock);
+        return buffer->data.substr(0, length);
+    }
+
+    bool string_builder_value::try_get(const std::string &key, value &result) const
+    {
+        if (key == "length")
+        {
+            result = value(length);
+            return true;
+        }
+
+        return false;
+    }
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "./complex_value.hpp"
+
+namespace lysithea_vm
+{
+    class string_builder_buffer
+    {
+        public:
+            // Fields
+            std::mutex lock;
+            std::string data;
+    };
+
+    // Like the other values a builder can't be changed, appending returns a new builder. Builders share a buffer and
+    // appending to the builder that holds all of the buffer adds to the end of it instead of copying it, so building
+    // up a string by appending to the last builder is linear. Appending to an older builder copies its part of the buffer.
+    class string_builder_value : public complex_value
+    {
+        public:
+            // Fields
+            const std::shared_ptr<string_builder_buffer> buffer;
+            const std::size_t length;
+
+            // Constructor
+            string_builder_value() : buffer(std::make_shared<string_builder_buffer>()), length(0) { }
+            string_builder_value(std::shared_ptr<string_builder_buffer> buffer, std::size_t length) : buffer(buffer), length(length) { }
+
+            // Methods
+            // Non string values are converted with to_string.
+            complex_ref<string_builder_value> append(const lysithea_vm::value *begin, const lysithea_vm::value *end) const;
+
+            virtual int compare_to(const complex_value *input) const;
+            virtual std::string to_string() const;
+
+            virtual std::string type_name() const
+            {
+                return "stringBuilder";
+            }
+
+            virtual bool is_object() const { return true; }
+            virtual std::vector<std::string> object_keys() const
+            {
+                std::vector<std::string> result;
+                result.push_back("length");
+                return result;
+            }
+            virtual bool try_get(const std::string &key, lysithea_vm::value &result) const;
+    };
+} // lysithea_vm
\ No newline at end of file
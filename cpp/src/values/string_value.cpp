@@ -1,18 +1,460 @@
 #include "string_value.hpp"
 
+#include <algorithm>
+#include <mutex>
+
 #include "./values.hpp"
+#include "../block_pool.hpp"
+#include "../vm_arena.hpp"
 #include "../virtual_machine.hpp"
 
 namespace lysithea_vm
 {
+    namespace
+    {
+        // Flattening is rare enough that one lock for all strings is fine, and it means a flatten can safely read the
+        // parts of any other string.
+        std::mutex &flatten_lock()
+        {
+            static std::mutex result;
+            return result;
+        }
+    }
+
+    // A string with the text stored after the value in one block from the block pool.
+    template <std::size_t Capacity>
+    class inline_string_value : public string_value
+    {
+        public:
+            // Constructor
+            inline_string_value(const char *input, std::size_t length) : string_value(buffer, length)
+            {
+                std::memcpy(buffer, input, length);
+                buffer[length] = '\0';
+            }
+
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+            // Methods
+            static void *operator new(std::size_t size)
+            {
+                return block_pool::allocate(size);
+            }
+            static void operator delete(void *ptr, std::size_t size)
+            {
+                block_pool::deallocate(ptr, size);
+            }
+#endif
+
+        private:
+            // Fields
+            char buffer[Capacity];
+    };
+
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+    // An inline string that gives its memory back to the arena it came from when it is deleted.
+    template <std::size_t Capacity>
+    class arena_string_value : public inline_string_value<Capacity>
+    {
+        public:
+            // Constructor
+            arena_string_value(const char *input, std::size_t length) : inline_string_value<Capacity>(input, length) { }
+
+            // Methods
+            static void *operator new(std::size_t size, vm_arena &arena)
+            {
+                return arena.allocate(size);
+            }
+            static void operator delete(void *ptr, vm_arena &arena)
+            {
+                vm_arena::deallocate(ptr);
+            }
+            static void operator delete(void *ptr)
+            {
+                vm_arena::deallocate(ptr);
+            }
+    };
+#endif
+
+    // The concatenation of two strings. Ropes are kept balanced by length, so joining two ropes only makes new nodes down
+    // the edge of the longer one instead of flattening it. Short strings appended to a rope are gathered in a short last
+    // part first, so building up a string a little at a time copies at most min_rope_length characters for each append
+    // and only joins into the balanced part once the short part is full. Prepending works the same way at the front.
+    class rope_string_value : public string_value
+    {
+        public:
+            // Constructor
+            rope_string_value(complex_ref<string_value> left, complex_ref<string_value> right) :
+                string_value(nullptr, left->size() + right->size()),
+                left(std::move(left)), right(std::move(right)),
+                depth(std::max(this->left->rope_depth(), this->right->rope_depth()) + 1) { }
+
+            // Methods
+            static complex_ref<string_value> join(const complex_ref<string_value> &left, const complex_ref<string_value> &right)
+            {
+                if (right->size() == 0)
+                {
+                    return left;
+                }
+                if (left->size() == 0)
+                {
+                    return right;
+                }
+
+                complex_ref<string_value> first, second;
+                if (right->size() < min_rope_length && try_get_parts(*left, first, second))
+                {
+                    if (second->size() >= min_rope_length)
+                    {
+                        return make_node(left, right);
+                    }
+                    if (second->size() + right->size() < min_rope_length)
+                    {
+                        return make_node(first, make_node(second, right));
+                    }
+                    return make_node(join_balanced(first, second), right);
+                }
+
+                if (left->size() < min_rope_length && try_get_parts(*right, first, second))
+                {
+                    if (first->size() >= min_rope_length)
+                    {
+                        return make_node(left, right);
+                    }
+                    if (left->size() + first->size() < min_rope_length)
+                    {
+                        return make_node(make_node(left, first), second);
+                    }
+                    return make_node(left, join_balanced(first, second));
+                }
+
+                return join_balanced(left, right);
+            }
+
+        private:
+            // Fields
+            mutable std::string flat;
+            mutable complex_ref<string_value> left;
+            mutable complex_ref<string_value> right;
+            int depth;
+
+            // Methods
+            virtual int rope_depth() const
+            {
+                return text.load(std::memory_order_acquire) ? 0 : depth;
+            }
+
+            virtual const char *flatten() const
+            {
+                // Free the parts after unlocking, which could free a lot of other strings.
+                complex_ref<string_value> old_left, old_right;
+                std::lock_guard<std::mutex> lock(flatten_lock());
+
+                auto result = text.load(std::memory_order_relaxed);
+                if (result)
+                {
+                    return result;
+                }
+
+                std::string output;
+                output.reserve(size());
+                append_to(output);
+
+                flat = std::move(output);
+                old_left.swap(left);
+                old_right.swap(right);
+                result = flat.c_str();
+                text.store(result, std::memory_order_release);
+                return result;
+            }
+
+            virtual void append_to(std::string &output) const
+            {
+                if (text.load(std::memory_order_relaxed))
+                {
+                    output += flat;
+                    return;
+                }
+
+                left->append_to(output);
+                right->append_to(output);
+            }
+
+            // A flattened rope has given up its parts and is treated like any other flat string.
+            static bool try_get_parts(const string_value &input, complex_ref<string_value> &left, complex_ref<string_value> &right)
+            {
+                // Only ropes that haven't been flattened have a depth.
+                if (input.rope_depth() == 0)
+                {
+                    return false;
+                }
+
+                auto rope = static_cast<const rope_string_value *>(&input);
+                std::lock_guard<std::mutex> lock(flatten_lock());
+                if (rope->text.load(std::memory_order_relaxed))
+                {
+                    return false;
+                }
+
+                left = rope->left;
+                right = rope->right;
+                return true;
+            }
+
+            static complex_ref<string_value> join_balanced(const complex_ref<string_value> &left, const complex_ref<string_value> &right)
+            {
+                if (is_heavier(*left, *right))
+                {
+                    return join_right(left, right);
+                }
+                if (is_heavier(*right, *left))
+                {
+                    return join_left(left, right);
+                }
+                return make_node(left, right);
+            }
+
+            static bool is_heavier(const string_value &left, const string_value &right)
+            {
+                return left.size() > 3 * right.size();
+            }
+
+            static complex_ref<string_value> make_node(const complex_ref<string_value> &left, const complex_ref<string_value> &right)
+            {
+                // Short pieces at the ends are joined into one string, so appending one character at a time copies at most
+                // min_rope_length characters each time.
+                auto total = left->size() + right->size();
+                if (total < min_rope_length)
+                {
+                    std::string result;
+                    result.reserve(total);
+                    result.append(left->c_str(), left->size());
+                    result.append(right->c_str(), right->size());
+                    return make(std::move(result));
+                }
+
+                // Balancing should keep ropes shallow, this is only so flattening and freeing never has to recurse too far.
+                if (left->rope_depth() >= max_rope_depth)
+                {
+                    left->flatten();
+                }
+                if (right->rope_depth() >= max_rope_depth)
+                {
+                    right->flatten();
+                }
+
+                return make_complex<rope_string_value>(left, right);
+            }
+
+            // Joins a much lighter string onto the end of a rope by going down its right edge, rotating on the way back up
+            // if the right side has become too heavy.
+            static complex_ref<string_value> join_right(const complex_ref<string_value> &left, const complex_ref<string_value> &right)
+            {
+                complex_ref<string_value> left_left, left_right;
+                if (!try_get_parts(*left, left_left, left_right))
+                {
+                    return make_node(left, right);
+                }
+
+                auto joined = is_heavier(*left_right, *right) ? join_right(left_right, right) : make_node(left_right, right);
+                if (!is_heavier(*joined, *left_left))
+                {
+                    return make_node(left_left, joined);
+                }
+
+                complex_ref<string_value> middle, outer;
+                if (!try_get_parts(*joined, middle, outer))
+                {
+                    return make_node(left_left, joined);
+                }
+
+                complex_ref<string_value> middle_left, middle_right;
+                if (is_heavier(*middle, *outer) && try_get_parts(*middle, middle_left, middle_right))
+                {
+                    return make_node(make_node(left_left, middle_left), make_node(middle_right, outer));
+                }
+                return make_node(make_node(left_left, middle), outer);
+            }
+
+            // The same as join_right for a much lighter string in front of a rope.
+            static complex_ref<string_value> join_left(const complex_ref<string_value> &left, const complex_ref<string_value> &right)
+            {
+                complex_ref<string_value> right_left, right_right;
+                if (!try_get_parts(*right, right_left, right_right))
+                {
+                    return make_node(left, right);
+                }
+
+                auto joined = is_heavier(*right_left, *left) ? join_left(left, right_left) : make_node(left, right_left);
+                if (!is_heavier(*joined, *right_right))
+                {
+                    return make_node(joined, right_right);
+                }
+
+                complex_ref<string_value> outer, middle;
+                if (!try_get_parts(*joined, outer, middle))
+                {
+                    return make_node(joined, right_right);
+                }
+
+                complex_ref<string_value> middle_left, middle_right;
+                if (is_heavier(*middle, *outer) && try_get_parts(*middle, middle_left, middle_right))
+                {
+                    return make_node(make_node(outer, middle_left), make_node(middle_right, right_right));
+                }
+                return make_node(outer, make_node(middle, right_right));
+            }
+    };
+
+    namespace
+    {
+        template <std::size_t Capacity>
+        complex_ref<string_value> make_inline(const char *input, std::size_t length)
+        {
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+            return make_complex<inline_string_value<Capacity>>(input, length);
+#else
+            return std::allocate_shared<inline_string_value<Capacity>>(pool_allocator<inline_string_value<Capacity>>(), input, length);
+#endif
+        }
+
+        template <std::size_t Capacity>
+        complex_ref<string_value> make_in_arena(vm_arena &arena, const char *input, std::size_t length)
+        {
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+            return complex_ref<string_value>(new (arena) arena_string_value<Capacity>(input, length));
+#else
+            return std::allocate_shared<inline_string_value<Capacity>>(arena_allocator<inline_string_value<Capacity>>(arena), input, length);
+#endif
+        }
+
+        complex_ref<string_value> make_in_arena(vm_arena &arena, const char *input, std::size_t length)
+        {
+            if (length < 16)
+            {
+                return make_in_arena<16>(arena, input, length);
+            }
+            if (length < 32)
+            {
+                return make_in_arena<32>(arena, input, length);
+            }
+            if (length < 64)
+            {
+                return make_in_arena<64>(arena, input, length);
+            }
+            return make_in_arena<string_value::max_inline_length>(arena, input, length);
+        }
+    }
+
+    std::atomic<bool> string_value::inline_enabled(true);
+
     bool string_value::try_get(const std::string &key, lysithea_vm::value &result) const
     {
         if (key == "length")
         {
-            result = value(data.size());
+            result = value(length);
             return true;
         }
 
         return false;
     }
+
+    complex_ref<string_value> string_value::make(const char *input, std::size_t length)
+    {
+        if (!inline_enabled.load(std::memory_order_relaxed))
+        {
+            return make_complex<string_value>(std::string(input, length));
+        }
+
+        if (length < 16)
+        {
+            return make_inline<16>(input, length);
+        }
+        if (length < 32)
+        {
+            return make_inline<32>(input, length);
+        }
+        if (length < 64)
+        {
+            return make_inline<64>(input, length);
+        }
+        if (length < max_inline_length)
+        {
+            return make_inline<max_inline_length>(input, length);
+        }
+
+        return make_complex<string_value>(std::string(input, length));
+    }
+
+    complex_ref<string_value> string_value::make(std::string &&input)
+    {
+        if (input.size() < max_inline_length && inline_enabled.load(std::memory_order_relaxed))
+        {
+            return make(input.data(), input.size());
+        }
+
+        return make_complex<string_value>(std::move(input));
+    }
+
+    value string_value::concat(const value *begin, const value *end, vm_arena *arena)
+    {
+        // Short concatenations of only strings are common enough to be done without any temporaries.
+        std::size_t total = 0;
+        auto only_strings = true;
+        for (auto iter = begin; iter != end; ++iter)
+        {
+            auto part = iter->get_complex_raw();
+            if (!part || !part->is_string())
+            {
+                only_strings = false;
+                break;
+            }
+            total += static_cast<const string_value *>(part)->length;
+        }
+
+        if (only_strings && total < max_inline_length)
+        {
+            char buffer[max_inline_length];
+            auto position = buffer;
+            for (auto iter = begin; iter != end; ++iter)
+            {
+                auto part = static_cast<const string_value *>(iter->get_complex_raw());
+                std::memcpy(position, part->c_str(), part->length);
+                position += part->length;
+            }
+            return value(arena && inline_enabled.load(std::memory_order_relaxed) ? make_in_arena(*arena, buffer, total) : make(buffer, total));
+        }
+
+        std::vector<complex_ref<string_value>> parts;
+        parts.reserve(end - begin);
+
+        total = 0;
+        for (auto iter = begin; iter != end; ++iter)
+        {
+            auto part = iter->get_complex<string_value>();
+            if (!part)
+            {
+                part = make(iter->to_string());
+            }
+            total += part->length;
+            parts.emplace_back(std::move(part));
+        }
+
+        if (total < min_rope_length)
+        {
+            std::string result;
+            result.reserve(total);
+            for (const auto &iter : parts)
+            {
+                result.append(iter->c_str(), iter->length);
+            }
+            return value(make(std::move(result)));
+        }
+
+        auto result = parts[0];
+        for (auto i = 1u; i < parts.size(); i++)
+        {
+            result = rope_string_value::join(result, parts[i]);
+        }
+        return value(result);
+    }
 } // lysithea_vm
\ No newline at end of file
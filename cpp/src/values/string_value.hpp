@@ -1,24 +1,51 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <cstring>
+#include <vector>
 
 #include "./complex_value.hpp"
 
 namespace lysithea_vm
 {
+    class vm_arena;
+
+    // Strings made with string_value::make keep short text inline in a pooled block with the rest of the value, longer
+    // text is kept in a std::string. A long concatenation keeps the strings it was made from and is only flattened the
+    // first time the text is read, the length is always known.
     class string_value : public complex_value
     {
         public:
             // Fields
-            std::string data;
+            // Concatenations shorter than this are flattened straight away.
+            static const std::size_t min_rope_length = 256;
+            // Ropes are kept balanced so they stay far shallower than this, parts nested deeper are still flattened
+            // when concatenated so flattening and freeing a string never has to recurse too far.
+            static const int max_rope_depth = 256;
+            // Text shorter than this is kept inline.
+            static const std::size_t max_inline_length = 128;
+            // Can be turned off to put all text in a std::string, for comparing against in benchmarks.
+            static std::atomic<bool> inline_enabled;
 
             // Constructor
-            string_value(const std::string &data) : data(data) { }
-            string_value(const char *data) : data(data) { }
+            string_value(const std::string &data) : data(data), text(this->data.c_str()), length(this->data.size()) { }
+            string_value(std::string &&data) : data(std::move(data)), text(this->data.c_str()), length(this->data.size()) { }
+            string_value(const char *data) : data(data), text(this->data.c_str()), length(this->data.size()) { }
 
             // Methods
+            inline std::size_t size() const { return length; }
+            inline const char *c_str() const
+            {
+                auto result = text.load(std::memory_order_acquire);
+                if (!result)
+                {
+                    result = flatten();
+                }
+                return result;
+            }
+
             virtual bool is_string() const { return true; }
             virtual int compare_to(const complex_value *input) const
             {
@@ -28,12 +55,12 @@ namespace lysithea_vm
                     return 1;
                 }
 
-                return strcmp(data.c_str(), other->data.c_str());
+                return strcmp(c_str(), other->c_str());
             }
 
             virtual std::string to_string() const
             {
-                return data;
+                return std::string(c_str(), length);
             }
 
             virtual std::string type_name() const
@@ -50,5 +77,33 @@ namespace lysithea_vm
                 return result;
             }
             virtual bool try_get(const std::string &key, lysithea_vm::value &result) const;
+
+            static complex_ref<string_value> make(const char *input, std::size_t length);
+            static complex_ref<string_value> make(std::string &&input);
+            inline static complex_ref<string_value> make(const std::string &input)
+            {
+                return make(input.data(), input.size());
+            }
+
+            // Non string values are converted with to_string. Short results are put in the arena if one is given.
+            static lysithea_vm::value concat(const lysithea_vm::value *begin, const lysithea_vm::value *end, vm_arena *arena = nullptr);
+
+        protected:
+            // Constructor
+            // The text can be null for a string that needs flattening.
+            string_value(const char *text, std::size_t length) : text(text), length(length) { }
+
+        private:
+            // Fields
+            std::string data;
+            mutable std::atomic<const char *> text;
+            std::size_t length;
+
+            // Methods
+            virtual int rope_depth() const { return 0; }
+            virtual const char *flatten() const { return text.load(std::memory_order_acquire); }
+            virtual void append_to(std::string &output) const { output.append(text.load(std::memory_order_relaxed), length); }
+
+            friend class rope_string_value;
     };
 } // lysithea_vm
\ No newline at end of file
@@ -1,18 +1,19 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <sstream>
 
+#include "./complex_value.hpp"
 #include "./string_value.hpp"
 #include "./builtin_function_value.hpp"
 #include "../utils.hpp"
 
 namespace lysithea_vm
 {
-    class complex_value;
-
-    using complex_ptr = std::shared_ptr<complex_value>;
+    using complex_ptr = complex_ref<complex_value>;
 
     enum class value_type
     {
@@ -24,8 +25,17 @@ namespace lysithea_vm
         public:
             // Fields
             value_type type;
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+            union
+            {
+                double number;
+                complex_value *data;
+                std::uint64_t bits = 0;
+            };
+#else
             double number;
             complex_ptr data;
+#endif
 
             // Constructor
             value() : type(value_type::undefined) { }
@@ -34,9 +44,45 @@ namespace lysithea_vm
             value(unsigned int input) : type(value_type::number), number(static_cast<double>(input)) { }
             value(double input) : type(value_type::number), number(input) { }
             value(std::size_t input) : type(value_type::number), number(static_cast<double>(input)) { }
-            value(const char * input) : type(value_type::complex), data(std::make_shared<string_value>(input)) { }
-            value(const std::string &input) : type(value_type::complex), data(std::make_shared<string_value>(input)) { }
-            value(complex_ptr input) : type(value_type::complex), data(input) { }
+            value(const char * input) : type(value_type::complex), data(to_data(string_value::make(input, std::strlen(input)))) { }
+            value(const std::string &input) : type(value_type::complex), data(to_data(string_value::make(input))) { }
+            value(std::string &&input) : type(value_type::complex), data(to_data(string_value::make(std::move(input)))) { }
+            value(complex_ptr input) : type(value_type::complex), data(to_data(std::move(input))) { }
+
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+            value(const value &other) : type(other.type), bits(other.bits)
+            {
+                add_ref();
+            }
+            value(value &&other) noexcept : type(other.type), bits(other.bits)
+            {
+                other.type = value_type::undefined;
+            }
+            ~value()
+            {
+                release();
+            }
+
+            value &operator=(const value &other)
+            {
+                other.add_ref();
+                release();
+                type = other.type;
+                bits = other.bits;
+                return *this;
+            }
+            value &operator=(value &&other) noexcept
+            {
+                if (this != &other)
+                {
+                    release();
+                    type = other.type;
+                    bits = other.bits;
+                    other.type = value_type::undefined;
+                }
+                return *this;
+            }
+#endif
 
             // Methods
             inline bool is_bool() const
@@ -64,7 +110,7 @@ namespace lysithea_vm
             {
                 if (is_complex())
                 {
-                    return get_complex()->is_function();
+                    return complex_data()->is_function();
                 }
                 return false;
             }
@@ -73,7 +119,7 @@ namespace lysithea_vm
             {
                 if (is_complex())
                 {
-                    return get_complex()->is_string();
+                    return complex_data()->is_string();
                 }
                 return false;
             }
@@ -82,7 +128,7 @@ namespace lysithea_vm
             {
                 if (is_complex())
                 {
-                    return get_complex()->is_array();
+                    return complex_data()->is_array();
                 }
                 return false;
             }
@@ -91,7 +137,7 @@ namespace lysithea_vm
             {
                 if (is_complex())
                 {
-                    return get_complex()->is_object();
+                    return complex_data()->is_object();
                 }
                 return false;
             }
@@ -125,15 +171,25 @@ namespace lysithea_vm
             {
                 if (is_complex())
                 {
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+                    return complex_ptr(data);
+#else
                     return data;
+#endif
                 }
                 return nullptr;
             }
 
             template <typename T>
-            inline std::shared_ptr<T> get_complex() const
+            inline complex_ref<T> get_complex() const
             {
-                return std::dynamic_pointer_cast<T>(get_complex());
+                return complex_cast<T>(get_complex());
+            }
+
+            // Doesn't add a reference, so it is only valid for as long as this value is.
+            inline const complex_value *get_complex_raw() const
+            {
+                return is_complex() ? complex_data() : nullptr;
             }
 
             int compare_to(const value &other) const
@@ -153,7 +209,7 @@ namespace lysithea_vm
                     case value_type::number:
                         return compare(get_number(), other.get_number());
                     case value_type::complex:
-                        return get_complex()->compare_to(other.get_complex().get());
+                        return complex_data()->compare_to(other.complex_data());
                     default: break;
                 }
 
@@ -173,7 +229,7 @@ namespace lysithea_vm
                         ss << std::noshowpoint << get_number();
                         return ss.str();
                     }
-                    case value_type::complex: return get_complex()->to_string();
+                    case value_type::complex: return complex_data()->to_string();
                     default: break;
                 }
 
@@ -189,7 +245,7 @@ namespace lysithea_vm
                         return "bool";
                     case value_type::number: return "number";
                     case value_type::null: return "null";
-                    case value_type::complex: return get_complex()->type_name();
+                    case value_type::complex: return complex_data()->type_name();
                     default: break;
                 }
 
@@ -198,7 +254,7 @@ namespace lysithea_vm
 
             inline static value make_builtin(builtin_function_callback input)
             {
-                return value(std::make_shared<builtin_function_value>(input));
+                return value(make_complex<builtin_function_value>(input));
             }
 
             inline static value make_null()
@@ -214,5 +270,47 @@ namespace lysithea_vm
         private:
             // Constructor
             value(value_type type) : type(type) { }
+
+            // Methods
+            inline complex_value *complex_data() const
+            {
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+                return data;
+#else
+                return data.get();
+#endif
+            }
+
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+            inline void add_ref() const
+            {
+                if (type == value_type::complex && data != nullptr)
+                {
+                    data->add_ref();
+                }
+            }
+
+            inline void release() const
+            {
+                if (type == value_type::complex && data != nullptr)
+                {
+                    data->release();
+                }
+            }
+
+            inline static complex_value *to_data(complex_ptr input)
+            {
+                return input.detach();
+            }
+#else
+            inline static complex_ptr to_data(complex_ptr input)
+            {
+                return input;
+            }
+#endif
     };
+
+#ifdef LYSITHEA_VM_COMPACT_VALUE
+    static_assert(sizeof(value) <= 16, "Compact value is expected to fit in 16 bytes");
+#endif
 } // lysithea_vm
\ No newline at end of file
@@ -4,36 +4,78 @@
 #include "./array_value.hpp"
 #include "./object_value.hpp"
 #include "./string_value.hpp"
+#include "../inline_cache.hpp"
+
+#include <typeinfo>
 
 namespace lysithea_vm
 {
-    bool try_get_property(value current, const array_value &properties, value &result)
+    namespace
     {
-        for (const auto &iter : properties.data)
+        bool try_get_property_from(value current, const array_value &properties, std::size_t start, value &result)
         {
-            int index;
-            if (current.is_array() && try_parse_index(iter, index))
+            for (auto i = start; i < properties.data.size(); i++)
             {
-                if (!current.get_complex()->try_get(index, current))
+                const auto &iter = properties.data[i];
+                int index;
+                if (current.is_array() && try_parse_index(iter, index))
                 {
-                    return false;
+                    if (!current.get_complex()->try_get(index, current))
+                    {
+                        return false;
+                    }
                 }
-            }
-            else if (current.is_object())
-            {
-                if (!current.get_complex()->try_get(iter.to_string(), current))
+                else if (current.is_object())
+                {
+                    if (!current.get_complex()->try_get(iter.to_string(), current))
+                    {
+                        return false;
+                    }
+                }
+                else
                 {
                     return false;
                 }
             }
-            else
+
+            result = current;
+            return true;
+        }
+    }
+
+    bool try_get_property(value current, const array_value &properties, value &result)
+    {
+        return try_get_property_from(current, properties, 0, result);
+    }
+
+    bool try_get_property(value current, const array_value &properties, const inline_cache &cache, value &result)
+    {
+        // Only plain objects that have a shape can use the cache, anything else that acts like an object goes the slow way.
+        auto complex = current.get_complex_raw();
+        if (properties.data.empty() || !complex || typeid(*complex) != typeid(object_value))
+        {
+            return try_get_property_from(current, properties, 0, result);
+        }
+
+        auto object = static_cast<const object_value *>(complex);
+        if (!object->shape)
+        {
+            return try_get_property_from(current, properties, 0, result);
+        }
+
+        int slot;
+        if (!cache.try_get(object->shape->id, slot))
+        {
+            slot = object->shape->find_slot(properties.data[0].to_string());
+            if (slot < 0)
             {
                 return false;
             }
+
+            cache.update(object->shape->id, slot);
         }
 
-        result = current;
-        return true;
+        return try_get_property_from(object->values[slot], properties, 1, result);
     }
 
     bool try_parse_index(value input, int &result)
@@ -49,7 +91,7 @@ namespace lysithea_vm
         {
             try
             {
-                result = std::stoi(is_string->data);
+                result = std::stoi(is_string->to_string());
                 return result >= 0;
             }
             catch (std::exception &exp)
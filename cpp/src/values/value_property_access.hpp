@@ -6,7 +6,10 @@ namespace lysithea_vm
 {
     class value;
     class array_value;
+    class inline_cache;
 
     bool try_get_property(value current, const array_value &properties, value &result);
+    // The same but the first property of an object is looked up through the code line's cache.
+    bool try_get_property(value current, const array_value &properties, const inline_cache &cache, value &result);
     bool try_parse_index(value input, int &result);
 } // namespace lysithea_vm
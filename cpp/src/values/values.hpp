@@ -6,4 +6,5 @@
 #include "./builtin_function_value.hpp"
 #include "./function_value.hpp"
 #include "./object_value.hpp"
-#include "./string_value.hpp"
\ No newline at end of file
+#include "./string_value.hpp"
+#include "./string_builder_value.hpp"
\ No newline at end of file
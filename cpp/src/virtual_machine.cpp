@@ -3,431 +3,877 @@
 #include <cmath>
 #include <iostream>
 
+#include "./vm_fiber.hpp"
 #include "./values/value_property_access.hpp"
 #include "./values/object_value.hpp"
-#include "./standard_library/standard_array_library.hpp"
 #include "./utils.hpp"
 #include "./errors/virtual_machine_error.hpp"
 #include "./errors/error_common.hpp"
 
 namespace lysithea_vm
 {
-    std::shared_ptr<const array_value> virtual_machine::empty_args(std::make_shared<const array_value>(true));
-
     virtual_machine::virtual_machine(int stack_size) :
-        stack(stack_size), stack_trace(stack_size), program_counter(0), running(false), paused(false),
+        stack(stack_size), stack_trace(stack_size), program_counter(0), locals_offset(0), budget_left(0), callers_mask(0), running(false), paused(false),
         global_scope(std::make_shared<scope>())
     {
         current_scope = global_scope;
     }
 
+    int virtual_machine::stack_size_for(const script &input, int max_call_depth)
+    {
+        return std::max(1, input.max_stack_depth) * max_call_depth;
+    }
+
     void virtual_machine::reset()
     {
         program_counter = 0;
+        locals_offset = 0;
         global_scope = std::make_shared<scope>();
         current_scope = global_scope;
         stack.clear();
-        stack_trace.clear();
+        clear_stack_trace();
+        locals.clear();
         running = false;
         paused = false;
+        last_error = nullptr;
+        waiting_on = nullptr;
+
+        if (arena)
+        {
+            arena->reset();
+        }
     }
 
     void virtual_machine::change_to_script(std::shared_ptr<script> script)
     {
         program_counter = 0;
+        locals_offset = 0;
         stack.clear();
-        stack_trace.clear();
+        clear_stack_trace();
+        locals.clear();
 
         builtin_scope = script->builtin_scope;
         current_code = script->code;
+        check_stack_space();
     }
 
-    void virtual_machine::execute(std::shared_ptr<script> script)
+    void virtual_machine::start(std::shared_ptr<script> script)
     {
         change_to_script(script);
 
         running = true;
         paused = false;
+        last_error = nullptr;
+        waiting_on = nullptr;
+    }
+
+    void virtual_machine::execute(std::shared_ptr<script> script)
+    {
+        start(script);
+        run();
+    }
 
-        while (running && !paused)
+    void virtual_machine::run()
+    {
+        if (running && try_finish_waiting() && !paused)
         {
-            step();
+            run_loop<false, false>();
         }
     }
 
-    void virtual_machine::step()
+    run_status virtual_machine::run_for(std::int64_t instruction_budget)
     {
-        if (program_counter >= current_code->code.size())
+        if (!running)
         {
-            if (!try_return())
+            return run_status::completed;
+        }
+
+        budget_left = instruction_budget;
+        try
+        {
+            if (!try_finish_waiting() || paused)
             {
-                running = false;
+                return run_status::paused;
             }
-            return;
+            run_loop<false, true>();
+        }
+        catch (...)
+        {
+            running = false;
+            last_error = std::current_exception();
+            return run_status::error;
+        }
+
+        if (!running)
+        {
+            return run_status::completed;
+        }
+        return paused ? run_status::paused : run_status::budget_exhausted;
+    }
+
+    run_status virtual_machine::resume(vm_fiber &fiber, std::int64_t instruction_budget)
+    {
+        if (running)
+        {
+            throw std::runtime_error("Unable to resume fiber, the VM is already running");
+        }
+        if (fiber.finished)
+        {
+            return run_status::completed;
         }
 
-        const auto &code_line = current_code->code[program_counter++];
+        load_fiber(fiber);
+        auto status = run_for(instruction_budget);
+        save_fiber(fiber);
+        return status;
+    }
 
-        switch (code_line.op)
+    run_status virtual_machine::run_until(std::chrono::steady_clock::time_point deadline)
+    {
+        // Reading the clock at every safe point would cost more than most of the instructions between them.
+        for (;;)
         {
-            default:
+            auto status = run_for(deadline_check_interval);
+            if (status != run_status::budget_exhausted || std::chrono::steady_clock::now() >= deadline)
             {
-                throw virtual_machine_error(create_stack_trace(), "Unknown operator");
+                return status;
             }
-            case vm_operator::push:
+        }
+    }
+
+    void virtual_machine::step()
+    {
+        run_loop<true, false>();
+    }
+
+    void virtual_machine::wait_for(std::shared_ptr<async_operation> operation)
+    {
+        if (operation->is_complete())
+        {
+            operation->apply(*this);
+            return;
+        }
+
+        waiting_on = std::move(operation);
+        paused = true;
+    }
+
+    bool virtual_machine::try_finish_waiting()
+    {
+        if (!waiting_on)
+        {
+            return true;
+        }
+        if (!waiting_on->is_complete())
+        {
+            return false;
+        }
+
+        auto operation = std::move(waiting_on);
+        waiting_on = nullptr;
+        paused = false;
+        operation->apply(*this);
+        return true;
+    }
+
+// Use computed goto dispatch where it's supported, the switch is kept as the portable fallback.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(LYSITHEA_VM_SWITCH_DISPATCH)
+#define LYSITHEA_VM_COMPUTED_GOTO
+#endif
+
+#ifdef LYSITHEA_VM_COMPUTED_GOTO
+#define VM_CASE(op_name) op_##op_name
+#define VM_DEFAULT op_unknown
+#define VM_NEXT() goto next_line
+#else
+#define VM_CASE(op_name) case vm_operator::op_name
+#define VM_DEFAULT default
+#define VM_NEXT() break
+#endif
+
+// Calls and returns can change the current code, so it has to be reloaded after them.
+// Only safe points check if the VM has been stopped or paused, or has used up its instruction budget.
+#define VM_SHOULD_STOP() (!running || paused || (budgeted && budget_left <= 0))
+
+#define VM_SAFE_POINT() \
+    { \
+        code_data = current_code->code.data(); \
+        code_size = static_cast<int>(current_code->code.size()); \
+        check_stack_space(); \
+        check_sample(); \
+        if (VM_SHOULD_STOP()) { return; } \
+        VM_NEXT(); \
+    }
+
+#define VM_JUMP(target) \
+    { \
+        auto is_backwards = (target) < program_counter; \
+        program_counter = (target); \
+        if (is_backwards) \
+        { \
+            check_stack_space(); \
+            check_sample(); \
+            if (VM_SHOULD_STOP()) { return; } \
+        } \
+        VM_NEXT(); \
+    }
+
+// Superinstructions read the lines they were fused from directly after the current line.
+#define VM_COMPARE_JUMP_FALSE(comparison) \
+    { \
+        auto right = get_operator_arg(*code_line); \
+        auto left = pop_stack(); \
+        if (!(left.compare_to(right) comparison 0)) \
+        { \
+            VM_JUMP(code_line[1].index); \
+        } \
+        program_counter++; \
+        VM_NEXT(); \
+    }
+
+    template <bool single_step, bool budgeted>
+    void virtual_machine::run_loop()
+    {
+#ifdef LYSITHEA_VM_COMPUTED_GOTO
+        // Has to be in the same order as the vm_operator enum.
+        static const void *dispatch_table[] =
+        {
+            &&op_unknown, &&op_push, &&op_to_argument, &&op_call, &&op_call_direct, &&op_call_return,
+            &&op_get_property, &&op_get, &&op_set, &&op_define, &&op_get_local, &&op_set_local,
+            &&op_define_local, &&op_jump, &&op_jump_true, &&op_jump_false, &&op_string_concat,
+            &&op_greater_than, &&op_greater_than_equals, &&op_equals, &&op_not_equals, &&op_less_than,
+            &&op_less_than_equals, &&op_op_not, &&op_op_and, &&op_op_or, &&op_add, &&op_sub,
+            &&op_multiply, &&op_divide, &&op_inc, &&op_dec, &&op_unary_negative, &&op_inc_local,
+            &&op_dec_local, &&op_make_array, &&op_make_object, &&op_less_than_jump_false,
+            &&op_less_than_equals_jump_false, &&op_equals_jump_false, &&op_not_equals_jump_false,
+            &&op_greater_than_jump_false, &&op_greater_than_equals_jump_false, &&op_add_local,
+            &&op_get_property_call
+        };
+        static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) == static_cast<int>(vm_operator::get_property_call) + 1, "Dispatch table does not match operators");
+#endif
+
+#ifdef LYSITHEA_VM_PROFILER
+        instruction_profiler::run_scope profiler_scope(profiler);
+#endif
+
+        auto code_data = current_code->code.data();
+        auto code_size = static_cast<int>(current_code->code.size());
+        const lysithea_vm::code_line *code_line;
+
+        if (!single_step)
+        {
+            // The host could have changed the current code while the VM was paused.
+            check_stack_space();
+        }
+
+        for (;;)
+        {
+            if (program_counter >= code_size)
             {
-                if (!code_line.value.is_undefined())
+                if (!try_return())
                 {
-                    stack.push(code_line.value);
+                    running = false;
+                    if (arena)
+                    {
+                        arena->reset();
+                    }
+                    return;
                 }
-                else
+
+                check_stack_space();
+                check_sample();
+                if (single_step || VM_SHOULD_STOP())
                 {
-                    throw virtual_machine_error(create_stack_trace(), "Push needs an input");
+                    return;
                 }
-                break;
+
+                code_data = current_code->code.data();
+                code_size = static_cast<int>(current_code->code.size());
+                continue;
             }
-            case vm_operator::to_argument:
-            {
-                auto top = get_operator_arg<array_value>(code_line);
-                if (!top)
-                {
-                    throw virtual_machine_error(create_stack_trace(), std::string("Unable to convert input to argument: ") + top->to_string());
-                }
 
-                push_stack(std::make_shared<array_value>(top->data, true));
-                break;
+            code_line = &code_data[program_counter++];
+            if (budgeted)
+            {
+                budget_left--;
             }
-            case vm_operator::get:
+#ifdef LYSITHEA_VM_PROFILER
+            profiler.record_line(current_code, program_counter - 1, code_line->op);
+#endif
+
+#ifdef LYSITHEA_VM_COMPUTED_GOTO
+            goto *dispatch_table[static_cast<int>(code_line->op)];
+#else
+            switch (code_line->op)
+#endif
             {
-                auto key = get_operator_arg(code_line);
-                auto is_string = key.get_complex<string_value>();
-                if (!is_string)
+                VM_DEFAULT:
                 {
-                    throw virtual_machine_error(create_stack_trace(), std::string("Unable to get value, input needs to be a string: ") + key.to_string());
+                    throw virtual_machine_error(create_stack_trace(), "Unknown operator");
                 }
-
-                value found_value;
-                if (current_scope->try_get_key(is_string->data, found_value) ||
-                    (builtin_scope && builtin_scope->try_get_key(is_string->data, found_value)))
+                VM_CASE(push):
                 {
-                    push_stack(found_value);
+                    if (!code_line->value.is_undefined())
+                    {
+                        push_operand(code_line->value);
+                    }
+                    else
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Push needs an input");
+                    }
+                    VM_NEXT();
                 }
-                else
+                VM_CASE(to_argument):
                 {
-                    throw virtual_machine_error(create_stack_trace(), std::string("Unable to find value to get: ") + key.to_string());
+                    auto top = get_operator_arg<array_value>(*code_line);
+                    if (!top)
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Unable to convert input to argument, input needs to be an array");
+                    }
+
+                    push_operand(array_value::make_value(top->data, true));
+                    VM_NEXT();
                 }
-                break;
-            }
-            case vm_operator::get_property:
-            {
-                auto key = get_operator_arg<array_value>(code_line);
-                if (!key)
+                VM_CASE(get):
                 {
-                    throw virtual_machine_error(create_stack_trace(), std::string("Unable to get property, input needs to be an array: ") + key->to_string());
+                    if (code_line->index >= 0)
+                    {
+                        push_operand(get_variable(*code_line));
+                        VM_NEXT();
+                    }
+
+                    auto key = get_operator_arg(*code_line);
+                    auto is_string = key.get_complex<string_value>();
+                    if (!is_string)
+                    {
+                        throw virtual_machine_error(create_stack_trace(), std::string("Unable to get value, input needs to be a string: ") + key.to_string());
+                    }
+
+                    // A name that was never interned can't have been defined, so there is no need to add it to the table.
+                    auto name = is_string->to_string();
+                    symbol found;
+                    if (!symbol::try_find(name, found))
+                    {
+                        throw virtual_machine_error(create_stack_trace(), std::string("Unable to find value to get: ") + name);
+                    }
+                    push_operand(get_variable(found));
+                    VM_NEXT();
                 }
+                VM_CASE(get_local):
+                {
+                    const auto &local = locals[locals_offset + code_line->index];
+                    if (!local.is_undefined())
+                    {
+                        push_operand(local);
+                    }
+                    else
+                    {
+                        // Not defined in this call yet so it could still be defined further up.
+                        push_operand(get_variable(local_symbol(*code_line)));
+                    }
+                    VM_NEXT();
+                }
+                VM_CASE(get_property):
+                {
+                    auto key = get_operator_arg<array_value>(*code_line);
+                    if (!key)
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Unable to get property, input needs to be an array");
+                    }
 
-                auto top = pop_stack();
-                value found;
-                if (try_get_property(top, *key, found))
+                    auto top = pop_stack();
+                    value found;
+                    if (try_get_property(top, *key, code_line->cache, found))
+                    {
+                        push_operand(found);
+                    }
+                    else
+                    {
+                        throw virtual_machine_error(create_stack_trace(), std::string("Unable to get property: ") + key->to_string());
+                    }
+
+                    VM_NEXT();
+                }
+                VM_CASE(define):
                 {
-                    push_stack(found);
+                    auto key = get_operator_symbol(*code_line);
+                    auto value = pop_stack();
+                    current_scope->try_define(key, value);
+                    VM_NEXT();
                 }
-                else
+                VM_CASE(set):
                 {
-                    throw virtual_machine_error(create_stack_trace(), std::string("Unable to get property: ") + key->to_string());
+                    auto key = get_operator_symbol(*code_line);
+                    auto value = pop_stack();
+                    if (!try_set_variable(key, value))
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Unable to set variable that has not been defined: " + key.to_string());
+                    }
+                    VM_NEXT();
                 }
-
-                break;
-            }
-            case vm_operator::define:
-            {
-                auto key = get_operator_arg(code_line);
-                auto value = pop_stack();
-                current_scope->try_define(key.to_string(), value);
-                break;
-            }
-            case vm_operator::set:
-            {
-                auto key = get_operator_arg(code_line);
-                auto value = pop_stack();
-                if (!current_scope->try_set(key.to_string(), value))
+                VM_CASE(define_local):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "Unable to set variable that has not been defined: " + key.to_string());
+                    locals[locals_offset + code_line->index] = pop_stack();
+                    VM_NEXT();
                 }
-                break;
-            }
-            case vm_operator::jump_false:
-            {
-                const auto label = get_operator_arg(code_line);
-                auto top = pop_stack();
-                if (top.is_false())
+                VM_CASE(set_local):
                 {
-                    jump(label.to_string());
+                    auto value = pop_stack();
+                    auto &local = locals[locals_offset + code_line->index];
+                    if (!local.is_undefined())
+                    {
+                        local = value;
+                    }
+                    else if (!try_set_variable(local_symbol(*code_line), value))
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Unable to set variable that has not been defined: " + code_line->value.to_string());
+                    }
+                    VM_NEXT();
                 }
-                break;
-            }
-            case vm_operator::jump_true:
-            {
-                const auto label = get_operator_arg(code_line);
-                auto top = pop_stack();
-                if (top.is_true())
+                VM_CASE(jump_false):
                 {
-                    jump(label.to_string());
+                    if (code_line->index >= 0)
+                    {
+                        if (pop_stack().is_false())
+                        {
+                            VM_JUMP(code_line->index);
+                        }
+                        VM_NEXT();
+                    }
+
+                    const auto label = get_operator_arg(*code_line);
+                    auto top = pop_stack();
+                    if (top.is_false())
+                    {
+                        jump(label.to_string());
+                        VM_SAFE_POINT();
+                    }
+                    VM_NEXT();
                 }
-                break;
-            }
-            case vm_operator::jump:
-            {
-                const auto label = get_operator_arg(code_line);
-                jump(label.to_string());
-                break;
-            }
-            case vm_operator::call_return:
-            {
-                call_return();
-                break;
-            }
-            case vm_operator::call:
-            {
-                if (!code_line.value.is_number())
+                VM_CASE(jump_true):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "Call needs a num args code line input");
+                    if (code_line->index >= 0)
+                    {
+                        if (pop_stack().is_true())
+                        {
+                            VM_JUMP(code_line->index);
+                        }
+                        VM_NEXT();
+                    }
+
+                    const auto label = get_operator_arg(*code_line);
+                    auto top = pop_stack();
+                    if (top.is_true())
+                    {
+                        jump(label.to_string());
+                        VM_SAFE_POINT();
+                    }
+                    VM_NEXT();
                 }
+                VM_CASE(jump):
+                {
+                    if (code_line->index >= 0)
+                    {
+                        VM_JUMP(code_line->index);
+                    }
 
-                auto top = pop_stack();
-                if (top.is_function())
+                    const auto label = get_operator_arg(*code_line);
+                    jump(label.to_string());
+                    VM_SAFE_POINT();
+                }
+                VM_CASE(call_return):
                 {
-                    call_function(*top.get_complex(), code_line.value.get_int(), true);
+                    call_return();
+                    VM_SAFE_POINT();
                 }
-                else
+                VM_CASE(call):
                 {
+                    if (!code_line->value.is_number())
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Call needs a num args code line input");
+                    }
+
+                    auto top = pop_stack();
+                    if (top.is_function())
+                    {
+                        call_function(*top.get_complex_raw(), code_line->value.get_int(), true);
+                        VM_SAFE_POINT();
+                    }
+
                     throw virtual_machine_error(create_stack_trace(), "Call needs a function to run");
                 }
-                break;
-            }
-            case vm_operator::call_direct:
-            {
-                auto error = false;
-                if (!code_line.value.is_array())
+                VM_CASE(call_direct):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "Call direct needs an array input");
+                    auto error = false;
+                    if (!code_line->value.is_array())
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Call direct needs an array input");
+                    }
+
+                    // Read through the code line without copying, copying a reference is atomic once there are other threads.
+                    auto array_input = static_cast<const array_value *>(code_line->value.get_complex_raw());
+                    if (array_input->data.size() != 2 ||
+                        !array_input->data[0].is_function())
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Call direct needs two inputs of func and number");
+                    }
+
+                    const auto &num_args = array_input->data[1];
+                    if (!num_args.is_number())
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Call direct needs two inputs of func and number");
+                    }
+
+                    call_function(*array_input->data[0].get_complex_raw(), num_args.get_int(), true);
+                    VM_SAFE_POINT();
                 }
 
-                auto array_input = code_line.value.get_complex<const array_value>();
-                if (array_input->data.size() != 2 ||
-                    !array_input->data[0].is_function())
+                // Misc Operator
+                VM_CASE(string_concat):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "Call direct needs two inputs of func and number");
+                    if (!code_line->value.is_number())
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "StringConcat operator needs the number of args to concat");
+                    }
+
+                    auto args = get_args(code_line->value.get_int());
+                    auto result = string_value::concat(args.cbegin(), args.cend(), arena.get());
+                    pop_args(args);
+                    push_operand(std::move(result));
+                    VM_NEXT();
                 }
 
-                auto num_args = array_input->data[1];
-                if (!num_args.is_number())
+                // Math Operators
+                VM_CASE(add):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "Call direct needs two inputs of func and number");
+                    push_operand(get_operator_num(*code_line) + pop_stack_number());
+                    VM_NEXT();
                 }
 
-                call_function(*array_input->data[0].get_complex(), num_args.get_int(), true);
-                break;
-            }
+                VM_CASE(sub):
+                {
+                    auto right = get_operator_num(*code_line);
+                    auto left = pop_stack_number();
+                    push_operand(left - right);
+                    VM_NEXT();
+                }
 
-            // Misc Operator
-            case vm_operator::string_concat:
-            {
-                if (!code_line.value.is_number())
+                VM_CASE(unary_negative):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "StringConcat operator needs the number of args to concat");
+                    push_operand(-pop_stack_number());
+                    VM_NEXT();
                 }
 
-                auto args = get_args(code_line.value.get_int());
-                std::stringstream ss;
-                for (auto iter : args->data)
+                VM_CASE(multiply):
                 {
-                    ss << iter.to_string();
+                    push_operand(get_operator_num(*code_line) * pop_stack_number());
+                    VM_NEXT();
                 }
-                push_stack(ss.str());
-                break;
-            }
 
-            // Math Operators
-            case vm_operator::add:
-            {
-                push_stack(get_operator_num(code_line) + pop_stack_number());
-                break;
-            }
+                VM_CASE(divide):
+                {
+                    auto right = get_operator_num(*code_line);
+                    auto left = pop_stack_number();
+                    push_operand(left / right);
+                    VM_NEXT();
+                }
 
-            case vm_operator::sub:
-            {
-                auto right = get_operator_num(code_line);
-                auto left = pop_stack_number();
-                push_stack(left - right);
-                break;
-            }
+                VM_CASE(inc):
+                {
+                    if (!code_line->value.is_complex())
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Inc operator needs code line variable");
+                    }
 
-            case vm_operator::unary_negative:
-            {
-                push_stack(-pop_stack_number());
-                break;
-            }
+                    add_to_variable(get_operator_symbol(*code_line), 1.0);
+                    VM_NEXT();
+                }
 
-            case vm_operator::multiply:
-            {
-                push_stack(get_operator_num(code_line) * pop_stack_number());
-                break;
-            }
+                VM_CASE(dec):
+                {
+                    if (!code_line->value.is_complex())
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Dec operator needs code line variable");
+                    }
 
-            case vm_operator::divide:
-            {
-                auto right = get_operator_num(code_line);
-                auto left = pop_stack_number();
-                push_stack(left / right);
-                break;
-            }
+                    add_to_variable(get_operator_symbol(*code_line), -1.0);
+                    VM_NEXT();
+                }
 
-            case vm_operator::inc:
-            {
-                if (!code_line.value.is_complex())
+                VM_CASE(inc_local):
+                VM_CASE(dec_local):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "Inc operator needs code line variable");
+                    auto amount = code_line->op == vm_operator::inc_local ? 1.0 : -1.0;
+                    auto &local = locals[locals_offset + code_line->index];
+                    if (local.is_number())
+                    {
+                        local = value(local.get_number() + amount);
+                    }
+                    else
+                    {
+                        add_to_variable(local_symbol(*code_line), amount);
+                    }
+                    VM_NEXT();
                 }
 
-                auto key = code_line.value.to_string();
-                double found_value;
-                if (!current_scope->try_get_number(key, found_value))
+                // Comparison Operators
+                VM_CASE(less_than):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "Inc operator could not find variable or was not a number");
+                    auto right = get_operator_arg(*code_line);
+                    auto left = pop_stack();
+                    push_operand(left.compare_to(right) < 0);
+                    VM_NEXT();
+                }
+                VM_CASE(less_than_equals):
+                {
+                    auto right = get_operator_arg(*code_line);
+                    auto left = pop_stack();
+                    push_operand(left.compare_to(right) <= 0);
+                    VM_NEXT();
+                }
+                VM_CASE(equals):
+                {
+                    auto right = get_operator_arg(*code_line);
+                    auto left = pop_stack();
+                    push_operand(left.compare_to(right) == 0);
+                    VM_NEXT();
+                }
+                VM_CASE(not_equals):
+                {
+                    auto right = get_operator_arg(*code_line);
+                    auto left = pop_stack();
+                    push_operand(left.compare_to(right) != 0);
+                    VM_NEXT();
+                }
+                VM_CASE(greater_than):
+                {
+                    auto right = get_operator_arg(*code_line);
+                    auto left = pop_stack();
+                    push_operand(left.compare_to(right) > 0);
+                    VM_NEXT();
+                }
+                VM_CASE(greater_than_equals):
+                {
+                    auto right = get_operator_arg(*code_line);
+                    auto left = pop_stack();
+                    push_operand(left.compare_to(right) >= 0);
+                    VM_NEXT();
                 }
-                current_scope->try_set(key, value(found_value + 1.0));
-                break;
-            }
 
-            case vm_operator::dec:
-            {
-                if (!code_line.value.is_complex())
+                // Boolean Operators
+                VM_CASE(op_and):
+                {
+                    push_operand(get_operator_bool(*code_line) && pop_stack_bool());
+                    VM_NEXT();
+                }
+                VM_CASE(op_or):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "Dec operator needs code line variable");
+                    push_operand(get_operator_bool(*code_line) || pop_stack_bool());
+                    VM_NEXT();
+                }
+                VM_CASE(op_not):
+                {
+                    push_operand(!pop_stack_bool());
+                    VM_NEXT();
                 }
 
-                auto key = code_line.value.to_string();
-                double found_value;
-                if (!current_scope->try_get_number(key, found_value))
+                // Value Create
+                VM_CASE(make_array):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "Dec operator could not find variable or was not a number");
+                    if (!code_line->value.is_number())
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "MakeArray operator needs the number of args to pop");
+                    }
+
+                    auto args = get_args(code_line->value.get_int());
+                    auto result = array_value::make_value(args.to_array());
+                    pop_args(args);
+                    push_operand(std::move(result));
+                    VM_NEXT();
                 }
-                current_scope->try_set(key, value(found_value - 1.0));
-                break;
-            }
+                VM_CASE(make_object):
+                {
+                    if (!code_line->value.is_number())
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "MakeObject operator needs the number of args to pop");
+                    }
 
-            // Comparison Operators
-            case vm_operator::less_than:
-            {
-                auto right = get_operator_arg(code_line);
-                auto left = pop_stack();
-                push_stack(left.compare_to(right) < 0);
-                break;
-            }
-            case vm_operator::less_than_equals:
-            {
-                auto right = get_operator_arg(code_line);
-                auto left = pop_stack();
-                push_stack(left.compare_to(right) <= 0);
-                break;
-            }
-            case vm_operator::equals:
-            {
-                auto right = get_operator_arg(code_line);
-                auto left = pop_stack();
-                push_stack(left.compare_to(right) == 0);
-                break;
-            }
-            case vm_operator::not_equals:
-            {
-                auto right = get_operator_arg(code_line);
-                auto left = pop_stack();
-                push_stack(left.compare_to(right) != 0);
-                break;
-            }
-            case vm_operator::greater_than:
-            {
-                auto right = get_operator_arg(code_line);
-                auto left = pop_stack();
-                push_stack(left.compare_to(right) > 0);
-                break;
-            }
-            case vm_operator::greater_than_equals:
-            {
-                auto right = get_operator_arg(code_line);
-                auto left = pop_stack();
-                push_stack(left.compare_to(right) >= 0);
-                break;
-            }
+                    auto args = get_args(code_line->value.get_int());
+                    auto result = object_value::join(args);
+                    pop_args(args);
+                    push_operand(std::move(result));
+                    VM_NEXT();
+                }
 
-            // Boolean Operators
-            case vm_operator::op_and:
-            {
-                push_stack(get_operator_bool(code_line) && pop_stack_bool());
-                break;
-            }
-            case vm_operator::op_or:
-            {
-                push_stack(get_operator_bool(code_line) || pop_stack_bool());
-                break;
-            }
-            case vm_operator::op_not:
-            {
-                push_stack(!pop_stack_bool());
-                break;
-            }
+                // Superinstructions
+                VM_CASE(less_than_jump_false): VM_COMPARE_JUMP_FALSE(<)
+                VM_CASE(less_than_equals_jump_false): VM_COMPARE_JUMP_FALSE(<=)
+                VM_CASE(equals_jump_false): VM_COMPARE_JUMP_FALSE(==)
+                VM_CASE(not_equals_jump_false): VM_COMPARE_JUMP_FALSE(!=)
+                VM_CASE(greater_than_jump_false): VM_COMPARE_JUMP_FALSE(>)
+                VM_CASE(greater_than_equals_jump_false): VM_COMPARE_JUMP_FALSE(>=)
 
-            // Value Create
-            case vm_operator::make_array:
-            {
-                if (!code_line.value.is_number())
+                VM_CASE(add_local):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "MakeArray operator needs the number of args to pop");
+                    auto &local = locals[locals_offset + code_line->index];
+                    if (local.is_number())
+                    {
+                        const auto &math_line = code_line[1];
+                        auto amount = math_line.value.get_number();
+                        local = value(math_line.op == vm_operator::sub ? local.get_number() - amount : local.get_number() + amount);
+                        program_counter += 2;
+                        VM_NEXT();
+                    }
+
+                    // Otherwise behave like the get_local and let the rest of the lines run as normal.
+                    push_operand(!local.is_undefined() ? local : get_variable(local_symbol(*code_line)));
+                    VM_NEXT();
                 }
 
-                auto args = get_args(code_line.value.get_int());
-                push_stack(array_value::make_value(args->data));
-                break;
-            }
-            case vm_operator::make_object:
-            {
-                if (!code_line.value.is_number())
+                VM_CASE(get_property_call):
                 {
-                    throw virtual_machine_error(create_stack_trace(), "MakeObject operator needs the number of args to pop");
+                    auto key = code_line->value.get_complex<const array_value>();
+                    auto top = pop_stack();
+                    value found;
+                    if (!try_get_property(top, *key, code_line->cache, found))
+                    {
+                        throw virtual_machine_error(create_stack_trace(), std::string("Unable to get property: ") + key->to_string());
+                    }
+
+                    // Skip over the call line, the function is called straight away instead of going through the stack.
+                    program_counter++;
+                    if (!found.is_function())
+                    {
+                        throw virtual_machine_error(create_stack_trace(), "Call needs a function to run");
+                    }
+
+                    call_function(*found.get_complex_raw(), code_line[1].value.get_int(), true);
+                    VM_SAFE_POINT();
                 }
+            }
 
-                auto args = get_args(code_line.value.get_int());
-                push_stack(object_value::join(*args));
-                break;
+#ifdef LYSITHEA_VM_COMPUTED_GOTO
+        next_line:
+#endif
+            if (single_step)
+            {
+                return;
+            }
+        }
+    }
+
+#undef VM_CASE
+#undef VM_DEFAULT
+#undef VM_NEXT
+#undef VM_SHOULD_STOP
+#undef VM_SAFE_POINT
+#undef VM_JUMP
+#undef VM_COMPARE_JUMP_FALSE
+
+    void virtual_machine::load_fiber(vm_fiber &fiber)
+    {
+        stack.clear();
+        clear_stack_trace();
+
+        builtin_scope = fiber.builtin_scope;
+        current_code = std::move(fiber.code);
+        current_scope = fiber.current_scope ? std::move(fiber.current_scope) : global_scope;
+        program_counter = fiber.program_counter;
+        locals_offset = fiber.locals_offset;
+        locals.swap(fiber.locals);
+        waiting_on = std::move(fiber.waiting_on);
+
+        for (auto &iter : fiber.frames)
+        {
+            push_stack_trace(std::move(iter));
+        }
+        for (auto &iter : fiber.stack)
+        {
+            push_stack(std::move(iter));
+        }
+        fiber.frames.clear();
+        fiber.stack.clear();
+
+        running = true;
+        paused = false;
+        last_error = nullptr;
+    }
+
+    void virtual_machine::save_fiber(vm_fiber &fiber)
+    {
+        fiber.finished = !running;
+        if (fiber.finished)
+        {
+            // Let go of everything now rather than when the fiber is destroyed.
+            fiber.builtin_scope = nullptr;
+            fiber.current_scope = nullptr;
+            std::vector<scope_frame>().swap(fiber.frames);
+            std::vector<value>().swap(fiber.stack);
+            std::vector<value>().swap(fiber.locals);
+            locals.clear();
+        }
+        else
+        {
+            fiber.code = std::move(current_code);
+            fiber.current_scope = std::move(current_scope);
+            fiber.program_counter = program_counter;
+            fiber.locals_offset = locals_offset;
+            fiber.waiting_on = std::move(waiting_on);
+
+            fiber.frames.reserve(stack_trace.stack_size());
+            for (auto i = 0; i < stack_trace.stack_size(); i++)
+            {
+                fiber.frames.emplace_back(std::move(stack_trace.at(i)));
+            }
+            fiber.stack.reserve(stack.stack_size());
+            for (auto i = 0; i < stack.stack_size(); i++)
+            {
+                fiber.stack.emplace_back(std::move(stack.at(i)));
             }
+
+            // The VM keeps the fiber's old vector, which is empty.
+            locals.swap(fiber.locals);
         }
+
+        stack.clear();
+        clear_stack_trace();
+        current_code = nullptr;
+        current_scope = global_scope;
+        running = false;
+        paused = false;
     }
 
-    std::shared_ptr<const array_value> virtual_machine::get_args(int num_args)
+    arguments_view virtual_machine::get_args(int num_args)
     {
         if (num_args == 0)
         {
-            array_vector empty;
-            return empty_args;
+            return arguments_view();
         }
 
+        if (num_args < 0 || num_args > stack.stack_size())
+        {
+            throw std::runtime_error("Unable to pop stack, empty stack");
+        }
+
+        auto args = stack.top_data(num_args);
         auto has_arguments = false;
-        array_vector temp(num_args);
         for (auto i = 0; i < num_args; i++)
         {
-            auto value = pop_stack();
-            auto is_arg = value.get_complex<const array_value>();
+            auto is_arg = args[i].get_complex<const array_value>();
             if (is_arg && is_arg->is_arguments_value)
             {
                 has_arguments = true;
+                break;
             }
-            temp[num_args - i - 1] = value;
         }
 
         if (has_arguments)
         {
-            array_vector combined;
+            // Spread any arguments values out onto the stack so they can be viewed like any other argument.
+            array_vector temp(args, args + num_args);
+            stack.pop_n(num_args);
+
+            auto combined_count = 0;
             for (const auto &iter : temp)
             {
                 auto is_arg = iter.get_complex<const array_value>();
@@ -435,19 +881,33 @@ namespace lysithea_vm
                 {
                     for (const auto &arg_iter : is_arg->data)
                     {
-                        combined.push_back(arg_iter);
+                        push_stack(arg_iter);
                     }
+                    combined_count += static_cast<int>(is_arg->data.size());
                 }
                 else
                 {
-                    combined.push_back(iter);
+                    push_stack(iter);
+                    combined_count++;
                 }
             }
 
-            return std::make_shared<const array_value>(combined, true);
+            return arguments_view(stack.top_data(combined_count), combined_count);
+        }
+
+        return arguments_view(args, num_args);
+    }
+
+    void virtual_machine::pop_args(const arguments_view &args)
+    {
+        if (args.empty())
+        {
+            return;
         }
 
-        return std::make_shared<const array_value>(temp, true);
+        // Anything pushed by the call sits above the arguments so remove them from underneath it.
+        auto index = static_cast<int>(args.begin() - stack.top_data(stack.stack_size()));
+        stack.erase(index, args.size());
     }
 
     void virtual_machine::jump(const std::string &label)
@@ -461,6 +921,145 @@ namespace lysithea_vm
         program_counter = find->second;
     }
 
+    bool virtual_machine::try_get_variable(const std::string &key, value &result) const
+    {
+        symbol found;
+        return symbol::try_find(key, found) && try_get_variable(found, result);
+    }
+
+    bool virtual_machine::try_get_variable(symbol key, value &result) const
+    {
+        scope *lookup_scope;
+        auto slot = find_local_slot(key, lookup_scope);
+        if (slot >= 0)
+        {
+            result = locals[slot];
+            return true;
+        }
+
+        return lookup_scope->try_get_key(key, result);
+    }
+
+    bool virtual_machine::try_set_variable(const std::string &key, value input)
+    {
+        symbol found;
+        return symbol::try_find(key, found) && try_set_variable(found, input);
+    }
+
+    bool virtual_machine::try_set_variable(symbol key, value input)
+    {
+        scope *lookup_scope;
+        auto slot = find_local_slot(key, lookup_scope);
+        if (slot >= 0)
+        {
+            locals[slot] = input;
+            return true;
+        }
+
+        return lookup_scope->try_set(key, input);
+    }
+
+    value virtual_machine::get_variable(symbol key)
+    {
+        value found_value;
+        if (try_get_variable(key, found_value) ||
+            (builtin_scope && builtin_scope->try_get_key(key, found_value)))
+        {
+            return found_value;
+        }
+
+        throw virtual_machine_error(create_stack_trace(), std::string("Unable to find value to get: ") + key.to_string());
+    }
+
+    value virtual_machine::get_variable(const lysithea_vm::code_line &line)
+    {
+        // Locals are always checked first as the callers on the stack can change with every call, the callers are only gone
+        // through if one of them might have the key.
+        symbol key(line.index);
+        scope *lookup_scope;
+        auto slot = find_local_slot(key, lookup_scope);
+        if (slot >= 0)
+        {
+            return locals[slot];
+        }
+
+        if (lookup_scope != current_scope.get())
+        {
+            return *lookup_scope->find_binding(key);
+        }
+
+        auto builtin_id = builtin_scope ? builtin_scope->id : 0;
+        auto version = current_scope->keys_version() + (builtin_scope ? builtin_scope->keys_version() : 0);
+        auto binding = line.cached_binding.try_get(current_scope->id, builtin_id, version);
+        if (binding)
+        {
+            return *binding;
+        }
+
+        binding = current_scope->find_binding(key);
+        if (!binding && builtin_scope)
+        {
+            binding = builtin_scope->find_binding(key);
+        }
+        if (!binding)
+        {
+            throw virtual_machine_error(create_stack_trace(), std::string("Unable to find value to get: ") + key.to_string());
+        }
+
+        line.cached_binding.update(current_scope->id, builtin_id, version, binding);
+        return *binding;
+    }
+
+    void virtual_machine::add_to_variable(symbol key, double amount)
+    {
+        value found_value;
+        if (!try_get_variable(key, found_value) || !found_value.is_number())
+        {
+            throw virtual_machine_error(create_stack_trace(), amount > 0.0 ?
+                "Inc operator could not find variable or was not a number" :
+                "Dec operator could not find variable or was not a number");
+        }
+
+        try_set_variable(key, value(found_value.get_number() + amount));
+    }
+
+    int virtual_machine::find_local_slot(symbol key, scope *&lookup_scope) const
+    {
+        // Calls can see the variables of the functions that called them. Going up the stack each function's locals are checked
+        // and then the scope it made for its own defines, if it has one, which is the order a scope for every call would give.
+        lookup_scope = current_scope.get();
+
+        auto code = current_code.get();
+        auto offset = locals_offset;
+        auto frame_scope = current_scope.get();
+        for (auto i = stack_trace.stack_size() - 1; ; i--)
+        {
+            auto index = code->local_index(key);
+            if (index >= 0 && !locals[offset + index].is_undefined())
+            {
+                return offset + index;
+            }
+
+            // The outermost frame's scope is still part of the current scope, so it is left for the caller to look in.
+            // The same goes for the current scope when none of the callers can have the key.
+            if (i < 0 || !(callers_mask & function::local_mask_bit(key)))
+            {
+                return -1;
+            }
+
+            if (code->needs_scope && frame_scope->values.find(key) != frame_scope->values.cend())
+            {
+                lookup_scope = frame_scope;
+                return -1;
+            }
+
+            const auto &frame = stack_trace.at(i);
+            code = frame.code.get();
+            offset = frame.locals_offset;
+            frame_scope = frame.frame_scope.get();
+        }
+    }
+
     void virtual_machine::call_function(const complex_value &value, int num_args, bool push_to_stack_trace)
     {
         if (!value.is_function())
@@ -469,41 +1068,52 @@ namespace lysithea_vm
         }
         auto args = get_args(num_args);
         value.invoke(*this, args, push_to_stack_trace);
+        pop_args(args);
     }
 
-    void virtual_machine::execute_function(std::shared_ptr<function> code, std::shared_ptr<const array_value> args, bool push_to_stack_trace)
+    void virtual_machine::execute_function(std::shared_ptr<function> code, const arguments_view &args, bool push_to_stack_trace)
     {
+        // Once there is more than one thread every shared_ptr copy is an atomic operation, so calls and returns move them where they can.
         if (push_to_stack_trace)
         {
-            push_stack_trace(scope_frame(program_counter, current_code, current_scope));
+            push_stack_trace(scope_frame(program_counter, locals_offset, current_code, current_scope));
         }
 
-        current_code = code;
-        current_scope = std::make_shared<scope>(current_scope);
+        current_code = std::move(code);
+        const auto &called = *current_code;
+        if (called.needs_scope)
+        {
+            current_scope = arena ?
+                std::allocate_shared<scope>(arena_allocator<scope>(*arena), current_scope, arena) :
+                std::make_shared<scope>(current_scope);
+        }
         program_counter = 0;
 
-        auto num_called_args = std::min(args->data.size(), code->parameters.size());
+        locals_offset = static_cast<int>(locals.size());
+        locals.resize(locals_offset + called.locals.size());
+
+        auto num_called_args = std::min(args.size(), static_cast<int>(called.parameters.size()));
         auto i = 0;
         for (; i < num_called_args; i++)
         {
-            const auto &arg_name = code->parameters[i];
+            const auto &arg_name = called.parameters[i];
             auto is_unpack = starts_with_unpack(arg_name);
             if (is_unpack)
             {
-                current_scope->try_define(arg_name.substr(3), standard_array_library::sublist(args->data, i, -1));
+                locals[locals_offset + i] = array_value::make_value(array_vector(args.begin() + i, args.end()));
                 i++;
                 break;
             }
-            current_scope->try_define(arg_name, args->data[i]);
+            locals[locals_offset + i] = args[i];
         }
 
-        if (i < code->parameters.size())
+        if (i < called.parameters.size())
         {
-            const auto &arg_name = code->parameters[i];
+            const auto &arg_name = called.parameters[i];
             auto is_unpack = starts_with_unpack(arg_name);
             if (is_unpack)
             {
-                current_scope->try_define(arg_name.substr(3), array_value::empty);
+                locals[locals_offset + i] = array_value::empty;
             }
             else
             {
@@ -520,9 +1130,12 @@ namespace lysithea_vm
             return false;
         }
 
-        current_code = top.code;
-        current_scope = top.frame_scope;
+        current_code = std::move(top.code);
+        current_scope = std::move(top.frame_scope);
+        callers_mask = top.callers_mask;
         program_counter = top.line_counter;
+        locals_offset = top.locals_offset;
+        locals.resize(locals_offset + current_code->locals.size());
         return true;
     }
 
@@ -536,11 +1149,10 @@ namespace lysithea_vm
 
     void virtual_machine::print_stack_debug()
     {
-        const auto &data = stack.stack_data();
-        std::cout << "Stack size: " << data.size() << "\n";
-        for (const auto &iter : data)
+        std::cout << "Stack size: " << stack.stack_size() << "\n";
+        for (auto i = 0; i < stack.stack_size(); i++)
         {
-            std::cout << "- " << iter.to_string() << "\n";
+            std::cout << "- " << stack.at(i).to_string() << "\n";
         }
     }
 
@@ -553,15 +1165,29 @@ namespace lysithea_vm
         }
     }
 
+    void virtual_machine::take_sample()
+    {
+        std::vector<sample_frame> frames;
+        frames.reserve(stack_trace.stack_size() + 1);
+        for (auto i = 0; i < stack_trace.stack_size(); i++)
+        {
+            const auto &stack_frame = stack_trace.at(i);
+            frames.emplace_back(stack_frame.code.get(), stack_frame.line_counter - 1);
+        }
+        // Straight after a call the program counter is still at the start of the new function.
+        frames.emplace_back(current_code.get(), std::max(0, program_counter - 1));
+
+        sampler->add_sample(frames);
+    }
+
     std::vector<std::string> virtual_machine::create_stack_trace()
     {
         std::vector<std::string> result;
 
         result.emplace_back(debug_scope_line(*current_code, program_counter - 1));
-        const auto &stack_data = stack_trace.stack_data();
         for (auto i = stack_trace.stack_size() - 1; i >= 0; i--)
         {
-            const auto &stack_frame = stack_data[i];
+            const auto &stack_frame = stack_trace.at(i);
             result.emplace_back(debug_scope_line(*stack_frame.code, stack_frame.line_counter - 1));
         }
 
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <exception>
 #include <functional>
+#include <limits>
 #include <string>
 #include <memory>
 #include <stdexcept>
@@ -11,24 +15,59 @@
 #include "script.hpp"
 #include "function.hpp"
 #include "fixed_stack.hpp"
+#include "sampling_profiler.hpp"
+#include "vm_arena.hpp"
+#include "async_builtin.hpp"
+#ifdef LYSITHEA_VM_PROFILER
+#include "instruction_profiler.hpp"
+#endif
 #include "./values/value.hpp"
 #include "./values/complex_value.hpp"
 #include "./values/array_value.hpp"
 #include "./values/string_value.hpp"
+#include "./values/arguments_view.hpp"
 
 namespace lysithea_vm
 {
+    // With a verified stack the operand pushes made by instructions are not checked individually,
+    // instead the VM checks there is space for each function's max stack depth at safe points.
+#ifdef LYSITHEA_VM_VERIFIED_STACK
+    using operand_stack_bounds = unchecked_stack_bounds;
+#else
+    using operand_stack_bounds = checked_stack_bounds;
+#endif
+
+    enum class run_status
+    {
+        // The script has finished, or the VM was not running.
+        completed,
+        // Stopped at a safe point with the script still running, calling run_for or run_until again will carry on from there.
+        budget_exhausted,
+        // A builtin paused the VM, it needs to be unpaused, or the async operation it is waiting on completed, before it
+        // will run again.
+        paused,
+        // The script threw an exception, which is kept in last_error.
+        error
+    };
+
+    class vm_fiber;
+    class snapshot_writer;
+    class snapshot_reader;
+
     class scope_frame
     {
         public:
             // Fields
             int line_counter;
+            int locals_offset;
             std::shared_ptr<function> code;
             std::shared_ptr<scope> frame_scope;
+            // The VM's callers_mask from before this frame was pushed, it goes back to this when the frame is popped.
+            std::uint64_t callers_mask;
 
             // Constructor
-            scope_frame() : line_counter(0), code(nullptr), frame_scope(nullptr) { }
-            scope_frame(int line_counter, std::shared_ptr<function> code, std::shared_ptr<scope> frame_scope) : line_counter(line_counter), code(code), frame_scope(frame_scope) { }
+            scope_frame() : line_counter(0), locals_offset(0), code(nullptr), frame_scope(nullptr), callers_mask(0) { }
+            scope_frame(int line_counter, int locals_offset, std::shared_ptr<function> code, std::shared_ptr<scope> frame_scope) : line_counter(line_counter), locals_offset(locals_offset), code(std::move(code)), frame_scope(std::move(frame_scope)), callers_mask(0) { }
 
             // Methods
     };
@@ -43,23 +82,62 @@ namespace lysithea_vm
             std::shared_ptr<function> current_code;
             std::shared_ptr<scope> current_scope;
             std::shared_ptr<scope> global_scope;
+#ifdef LYSITHEA_VM_PROFILER
+            instruction_profiler profiler;
+#endif
+            // Optional, can be shared between VMs but only one of them will take each sample.
+            std::shared_ptr<sampling_profiler> sampler;
+            // Optional, used for the scopes of function calls and for concatenated strings. Should only be used by one VM at a time.
+            std::shared_ptr<vm_arena> arena;
+            // Set when run_for or run_until stop because of an exception.
+            std::exception_ptr last_error;
+            // Set while the VM is paused by an async builtin. Once the operation is complete the next run, run_for or resume
+            // uses its result and carries on.
+            std::shared_ptr<async_operation> waiting_on;
+
+            // How many instructions run_until runs between checking the time.
+            static const int deadline_check_interval = 1024;
 
             // Constructor
             virtual_machine(int stackSize);
 
             // Methods
+            static int stack_size_for(const script &input, int max_call_depth);
+
             void reset();
             void change_to_script(std::shared_ptr<script> input);
+            // Gets ready to run the script without running any of it, for use with run_for and run_until.
+            void start(std::shared_ptr<script> input);
             void execute(std::shared_ptr<script> input);
+            void run();
+            // Runs until the script finishes or is paused, or until it has used up the instruction budget. The budget is only
+            // checked at calls, returns and backward jumps, so it can go over by the length of a straight run of code
+            // or the time taken by a builtin.
+            run_status run_for(std::int64_t instruction_budget);
+            // Same as run_for but with a time limit, the time is checked every deadline_check_interval instructions.
+            run_status run_until(std::chrono::steady_clock::time_point deadline);
+            // Runs the fiber like run_for, then saves its state back into the fiber. The VM can't be in the middle of running
+            // anything else. A paused fiber is unpaused first,
+            // unless it is waiting on an async operation that isn't complete.
+            run_status resume(vm_fiber &fiber, std::int64_t instruction_budget = std::numeric_limits<std::int64_t>::max());
             void step();
             void jump(const std::string &label);
+            // Pauses the VM until the operation is complete, or uses its result straight away if it already is.
+            void wait_for(std::shared_ptr<async_operation> operation);
+
+            // Variable methods
+            bool try_get_variable(symbol key, value &result) const;
+            bool try_get_variable(const std::string &key, value &result) const;
+            bool try_set_variable(symbol key, value input);
+            bool try_set_variable(const std::string &key, value input);
 
             // Function methods
-            std::shared_ptr<const array_value> get_args(int num_args);
+            arguments_view get_args(int num_args);
+            void pop_args(const arguments_view &args);
             void call_function(const complex_value &value, int num_args, bool push_to_stack_trace);
             bool try_return();
             void call_return();
-            void execute_function(std::shared_ptr<function> func, std::shared_ptr<const array_value> args, bool push_to_stack_trace);
+            void execute_function(std::shared_ptr<function> func, const arguments_view &args, bool push_to_stack_trace);
 
             // Stack methods
             inline void push_stack_trace(const scope_frame &frame)
@@ -68,10 +146,26 @@ namespace lysithea_vm
                 {
                     throw std::runtime_error("Unable to push to stack trace, stack full");
                 }
+                add_caller(stack_trace.peek());
+            }
+
+            inline void push_stack_trace(scope_frame &&frame)
+            {
+                if (!stack_trace.push(std::move(frame)))
+                {
+                    throw std::runtime_error("Unable to push to stack trace, stack full");
+                }
+                add_caller(stack_trace.peek());
+            }
+
+            inline void clear_stack_trace()
+            {
+                stack_trace.clear();
+                callers_mask = 0;
             }
 
             template <typename T>
-            inline std::shared_ptr<T> pop_stack()
+            inline complex_ref<T> pop_stack()
             {
                 value result;
                 if (!stack.pop(result))
@@ -79,7 +173,7 @@ namespace lysithea_vm
                     throw std::runtime_error("Unable to pop stack, empty stack");
                 }
 
-                auto casted = std::dynamic_pointer_cast<T>(result);
+                auto casted = result.get_complex<T>();
                 if (!casted)
                 {
                     throw std::bad_cast();
@@ -144,38 +238,38 @@ namespace lysithea_vm
 
             inline void push_stack(const char *input)
             {
-                push_stack(value(std::make_shared<string_value>(input)));
+                push_stack(value(input));
             }
 
             inline void push_stack(const std::string &input)
             {
-                push_stack(std::make_shared<string_value>(input));
+                push_stack(value(input));
             }
 
+            // Pushes from builtins and the host are not part of the verified stack depth so they are always checked.
             inline void push_stack(value input)
             {
-                if (!stack.push(input))
+                if (stack.stack_size() >= stack.capacity() || !stack.push(std::move(input)))
                 {
                     throw std::runtime_error("Unable to push stack, stack full");
                 }
             }
 
-            inline void push_stack(std::shared_ptr<complex_value> input)
+            inline void push_stack(complex_ptr input)
             {
-                if (!stack.push(input))
+                if (stack.stack_size() >= stack.capacity() || !stack.push(value(std::move(input))))
                 {
                     throw std::runtime_error("Unable to push stack, stack full");
                 }
             }
 
-            inline value peek_stack() const
+            inline const value &peek_stack() const
             {
-                value result;
-                if (!stack.peek(result))
+                if (stack.empty())
                 {
                     throw std::runtime_error("Unable to peek stack, empty stack");
                 }
-                return result;
+                return stack.peek();
             }
 
             void print_stack_debug();
@@ -183,14 +277,65 @@ namespace lysithea_vm
 
         private:
             // Fields
-            fixed_stack<lysithea_vm::value> stack;
+            fixed_stack<lysithea_vm::value, operand_stack_bounds> stack;
             fixed_stack<scope_frame> stack_trace;
-
-            static std::shared_ptr<const array_value> empty_args;
+            std::vector<lysithea_vm::value> locals;
 
             int program_counter;
+            int locals_offset;
+            std::int64_t budget_left;
+            // The local_mask_bit of every local in the functions on the stack trace, or every bit if any of them besides the
+            // outermost has its own scope. Looking up a key only has to go through the callers when its bit is set.
+            std::uint64_t callers_mask;
 
             // Methods
+            template <bool single_step, bool budgeted>
+            void run_loop();
+
+            inline void add_caller(scope_frame &frame)
+            {
+                frame.callers_mask = callers_mask;
+                callers_mask |= frame.code->locals_mask;
+                if (frame.code->needs_scope && stack_trace.stack_size() > 1)
+                {
+                    callers_mask = ~0ull;
+                }
+            }
+
+            // Returns false if the VM is still waiting on an async operation.
+            bool try_finish_waiting();
+
+            void load_fiber(vm_fiber &fiber);
+            void save_fiber(vm_fiber &fiber);
+
+            inline void push_operand(value input)
+            {
+                if (!stack.push(std::move(input)))
+                {
+                    throw std::runtime_error("Unable to push stack, stack full");
+                }
+            }
+
+            inline void check_stack_space()
+            {
+#ifdef LYSITHEA_VM_VERIFIED_STACK
+                if (stack.stack_size() + current_code->max_stack_depth > stack.capacity())
+                {
+                    throw std::runtime_error("Unable to push stack, stack full");
+                }
+#endif
+            }
+
+            inline void check_sample()
+            {
+                if (sampler && sampler->sample_requested())
+                {
+                    take_sample();
+                }
+            }
+
+            void take_sample();
+
             inline value get_operator_arg(const code_line &input)
             {
                 if (!input.value.is_undefined())
@@ -202,32 +347,29 @@ namespace lysithea_vm
             }
 
             template <typename T>
-            inline const T *get_operator_arg(const code_line &input)
+            inline complex_ref<const T> get_operator_arg(const code_line &input)
             {
-                auto result = input.value;
-                if (input.value.is_undefined())
+                if (!input.value.is_undefined())
                 {
-                    result = pop_stack();
+                    return input.value.get_complex<const T>();
                 }
 
-                if (result.is_complex())
-                {
-                    return dynamic_cast<const T *>(result.get_complex().get());
-                }
-                return nullptr;
+                return pop_stack().get_complex<const T>();
             }
 
             inline double get_operator_num(const code_line &input)
             {
-                auto result = input.value;
                 if (input.value.is_undefined())
                 {
-                    result = pop_stack();
+                    auto result = pop_stack();
+                    if (result.is_number())
+                    {
+                        return result.get_number();
+                    }
                 }
-
-                if (result.is_number())
+                else if (input.value.is_number())
                 {
-                    return result.get_number();
+                    return input.value.get_number();
                 }
 
                 throw std::runtime_error("Unable to get number argument");
@@ -235,21 +377,50 @@ namespace lysithea_vm
 
             inline bool get_operator_bool(const code_line &input)
             {
-                auto result = input.value;
                 if (input.value.is_undefined())
                 {
-                    result = pop_stack();
+                    auto result = pop_stack();
+                    if (result.is_bool())
+                    {
+                        return result.get_bool();
+                    }
                 }
-
-                if (result.is_bool())
+                else if (input.value.is_bool())
                 {
-                    return result.get_bool();
+                    return input.value.get_bool();
                 }
 
                 throw std::runtime_error("Unable to get boolean argument");
             }
 
+            // The name of a local slot, for when it hasn't been set in this call and the lookup falls back to the name.
+            inline symbol local_symbol(const code_line &input) const
+            {
+                return current_code->local_symbols[input.index];
+            }
+
+            inline symbol get_operator_symbol(const code_line &input)
+            {
+                if (input.index >= 0)
+                {
+                    return symbol(input.index);
+                }
+
+                return symbol::intern(get_operator_arg(input).to_string());
+            }
+
+            value get_variable(symbol key);
+            // Same as above for a get line with a symbol, lookups outside of the locals go through the line's cache.
+            value get_variable(const code_line &line);
+            void add_to_variable(symbol key, double amount);
+
+            // Returns the slot in the locals for the key, or -1 with the scope to look the key up in.
+            int find_local_slot(symbol key, scope *&lookup_scope) const;
+
             std::vector<std::string> create_stack_trace();
             static std::string debug_scope_line(const function &func, int line);
+
+            friend class snapshot_writer;
+            friend class snapshot_reader;
     };
 } // lysithea_vm
\ No newline at end of file
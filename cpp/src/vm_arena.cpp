@@ -0,0 +1,161 @@
+#include "vm_arena.hpp"
+
+#include <atomic>
+#include <new>
+
+#ifdef __GLIBCXX__
+#include <ext/atomicity.h>
+#endif
+
+namespace lysithea_vm
+{
+    class arena_chunk
+    {
+        public:
+            // Fields
+            static const std::size_t alignment = 16;
+            // Rounded up so that every allocation stays aligned.
+            static const std::size_t header_size;
+
+            // One for each allocation that hasn't been freed, plus one while the arena is still using the chunk.
+            // With libstdc++ this skips the atomic instructions while the program only has a single thread.
+#ifdef __GLIBCXX__
+            _Atomic_word references;
+#else
+            std::atomic<int> references;
+#endif
+            std::size_t used;
+            std::size_t capacity;
+
+            // Constructor
+            arena_chunk(std::size_t capacity) : references(1), used(0), capacity(capacity) { }
+
+            // Methods
+            inline char *start()
+            {
+                return reinterpret_cast<char *>(this) + header_size;
+            }
+
+            inline void add_ref()
+            {
+#ifdef __GLIBCXX__
+                __gnu_cxx::__atomic_add_dispatch(&references, 1);
+#else
+                references.fetch_add(1, std::memory_order_relaxed);
+#endif
+            }
+
+            inline void release()
+            {
+#ifdef __GLIBCXX__
+                if (__gnu_cxx::__exchange_and_add_dispatch(&references, -1) == 1)
+#else
+                if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+#endif
+                {
+                    this->~arena_chunk();
+                    ::operator delete(this);
+                }
+            }
+
+            // Only the arena's reference is left, so nothing else can be using the chunk.
+            inline bool is_empty() const
+            {
+#ifdef __GLIBCXX__
+                return __atomic_load_n(&references, __ATOMIC_ACQUIRE) == 1;
+#else
+                return references.load(std::memory_order_acquire) == 1;
+#endif
+            }
+
+            static arena_chunk *create(std::size_t capacity)
+            {
+                auto memory = ::operator new(header_size + capacity);
+                return new (memory) arena_chunk(capacity);
+            }
+
+    };
+
+    const std::size_t arena_chunk::header_size = (sizeof(arena_chunk) + arena_chunk::alignment - 1) / arena_chunk::alignment * arena_chunk::alignment;
+
+    namespace
+    {
+        // Each allocation starts with a pointer back to its chunk, padded to keep the alignment.
+        const std::size_t allocation_header_size = arena_chunk::alignment;
+
+        inline std::size_t round_up(std::size_t size)
+        {
+            return (size + arena_chunk::alignment - 1) / arena_chunk::alignment * arena_chunk::alignment;
+        }
+
+        inline void *place(arena_chunk *chunk, std::size_t size)
+        {
+            auto result = chunk->start() + chunk->used;
+            chunk->used += allocation_header_size + size;
+            chunk->add_ref();
+
+            *reinterpret_cast<arena_chunk **>(result) = chunk;
+            return result + allocation_header_size;
+        }
+    }
+
+    vm_arena::~vm_arena()
+    {
+        release_current();
+    }
+
+    void *vm_arena::allocate(std::size_t size)
+    {
+        size = round_up(size);
+        if (size > max_allocation_size)
+        {
+            // A chunk just for this which is freed along with it.
+            auto chunk = arena_chunk::create(allocation_header_size + size);
+            auto result = place(chunk, size);
+            chunk->release();
+            return result;
+        }
+
+        if (current && current->used + allocation_header_size + size > current->capacity)
+        {
+            if (current->is_empty())
+            {
+                current->used = 0;
+            }
+            else
+            {
+                release_current();
+            }
+        }
+
+        if (!current)
+        {
+            current = arena_chunk::create(chunk_size);
+        }
+
+        return place(current, size);
+    }
+
+    void vm_arena::deallocate(void *ptr)
+    {
+        auto header = static_cast<char *>(ptr) - allocation_header_size;
+        (*reinterpret_cast<arena_chunk **>(header))->release();
+    }
+
+    void vm_arena::reset()
+    {
+        if (current && current->is_empty())
+        {
+            current->used = 0;
+        }
+    }
+
+    void vm_arena::release_current()
+    {
+        if (current)
+        {
+            current->release();
+            current = nullptr;
+        }
+    }
+} // lysithea_vm
\ No newline at end of file
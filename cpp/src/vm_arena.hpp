@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace lysithea_vm
+{
+    class arena_chunk;
+
+    // A bump allocator for the short lived scopes and strings made while a VM is running. Freeing only decrements a count
+    // on the chunk the memory came from, and the arena starts again from the beginning of its chunk when everything in it
+    // has been freed. Anything that outlives the execution, such as a string stored in a global or a scope kept by the host,
+    // keeps its chunk alive until it is freed, so it is always safe but a few long lived values can hold onto a lot of memory.
+    // Allocating is not thread safe, but memory can be freed from any thread and after the arena has been destroyed.
+    class vm_arena
+    {
+        public:
+            // Fields
+            static const std::size_t chunk_size = 64 * 1024;
+            // Anything bigger than this gets a chunk of its own.
+            static const std::size_t max_allocation_size = chunk_size / 8;
+
+            // Constructor
+            vm_arena() : current(nullptr) { }
+            ~vm_arena();
+            vm_arena(const vm_arena &other) = delete;
+            vm_arena &operator=(const vm_arena &other) = delete;
+
+            // Methods
+            void *allocate(std::size_t size);
+            static void deallocate(void *ptr);
+
+            // Called when the VM finishes executing or is reset.
+            void reset();
+
+        private:
+            // Fields
+            arena_chunk *current;
+
+            // Methods
+            void release_current();
+    };
+
+    // Lets std::allocate_shared put the control block and the object in the arena.
+    template <typename T>
+    class arena_allocator
+    {
+        public:
+            // Types
+            using value_type = T;
+
+            // Fields
+            vm_arena *arena;
+
+            // Constructor
+            arena_allocator(vm_arena &arena) : arena(&arena) { }
+            template <typename U>
+            arena_allocator(const arena_allocator<U> &other) : arena(other.arena) { }
+
+            // Methods
+            inline T *allocate(std::size_t count)
+            {
+                return static_cast<T *>(arena->allocate(count * sizeof(T)));
+            }
+            inline void deallocate(T *ptr, std::size_t)
+            {
+                vm_arena::deallocate(ptr);
+            }
+    };
+
+    template <typename T, typename U>
+    inline bool operator==(const arena_allocator<T> &left, const arena_allocator<U> &right) { return left.arena == right.arena; }
+    template <typename T, typename U>
+    inline bool operator!=(const arena_allocator<T> &left, const arena_allocator<U> &right) { return left.arena != right.arena; }
+
+    // For containers that keep allocating after they are made, like the maps in a scope. Without an arena it uses the heap.
+    // It keeps the arena alive so that a container that outlives the VM can still grow.
+    template <typename T>
+    class shared_arena_allocator
+    {
+        public:
+            // Types
+            using value_type = T;
+
+            // Fields
+            std::shared_ptr<vm_arena> arena;
+
+            // Constructor
+            shared_arena_allocator() { }
+            shared_arena_allocator(std::shared_ptr<vm_arena> arena) : arena(arena) { }
+            shared_arena_allocator(const shared_arena_allocator &other) : arena(other.arena) { }
+            template <typename U>
+            shared_arena_allocator(const shared_arena_allocator<U> &other) : arena(other.arena) { }
+
+            // Methods
+            inline T *allocate(std::size_t count)
+            {
+                if (arena)
+                {
+                    return static_cast<T *>(arena->allocate(count * sizeof(T)));
+                }
+                return static_cast<T *>(::operator new(count * sizeof(T)));
+            }
+            inline void deallocate(T *ptr, std::size_t)
+            {
+                if (arena)
+                {
+                    vm_arena::deallocate(ptr);
+                }
+                else
+                {
+                    ::operator delete(ptr);
+                }
+            }
+
+            // Copies of a container could be used from any thread so they go on the heap.
+            inline shared_arena_allocator select_on_container_copy_construction() const
+            {
+                return shared_arena_allocator();
+            }
+    };
+
+    template <typename T, typename U>
+    inline bool operator==(const shared_arena_allocator<T> &left, const shared_arena_allocator<U> &right) { return left.arena == right.arena; }
+    template <typename T, typename U>
+    inline bool operator!=(const shared_arena_allocator<T> &left, const shared_arena_allocator<U> &right) { return left.arena != right.arena; }
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "virtual_machine.hpp"
+
+namespace lysithea_vm
+{
+    // The execution state of one script, so that lots of suspended scripts can take turns on a single VM. A fiber only keeps
+    // what is needed to carry on: the current function, scope and program counter, the call frames, its part of the
+    // operand stack and its local variables. A suspended fiber is a little over a hundred bytes plus a few values for each
+    // call it is in the middle of.
+    //
+    // Create a fiber for a script, then call virtual_machine::resume with it until it completes. A builtin can suspend the
+    // fiber it is running in by pausing the VM, and the next resume carries on after the builtin. Destroying the fiber
+    // frees everything it was holding, it doesn't need to have finished.
+    //
+    // Fibers share the VM's global scope unless they are given their own scope, so fibers running the same script
+    // should be given their own scope if the script defines any variables at the top level.
+    class vm_fiber
+    {
+        public:
+            // Constructor
+            vm_fiber(std::shared_ptr<script> input, std::shared_ptr<scope> fiber_scope = nullptr) :
+                builtin_scope(input->builtin_scope), code(input->code), current_scope(fiber_scope), program_counter(0),
+                locals_offset(0), finished(false) { }
+
+            vm_fiber(const vm_fiber &other) = delete;
+            vm_fiber &operator=(const vm_fiber &other) = delete;
+
+            // Methods
+            inline bool is_finished() const { return finished; }
+            // The async operation the fiber is waiting on, if any.
+            inline const std::shared_ptr<async_operation> &get_waiting_on() const { return waiting_on; }
+
+        private:
+            // Fields
+            std::shared_ptr<const scope> builtin_scope;
+            std::shared_ptr<function> code;
+            // Null until the first resume if the fiber is using the VM's global scope.
+            std::shared_ptr<scope> current_scope;
+            int program_counter;
+            int locals_offset;
+            bool finished;
+            std::shared_ptr<async_operation> waiting_on;
+
+            std::vector<scope_frame> frames;
+            std::vector<value> stack;
+            std::vector<value> locals;
+
+            friend class virtual_machine;
+    };
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "vm_pool.hpp"
+
+namespace lysithea_vm
+{
+    pooled_vm &pooled_vm::operator=(pooled_vm &&other)
+    {
+        if (this != &other)
+        {
+            release();
+            pool = other.pool;
+            vm = other.vm;
+            other.pool = nullptr;
+            other.vm = nullptr;
+        }
+        return *this;
+    }
+
+    void pooled_vm::release()
+    {
+        if (vm)
+        {
+            pool->give_back(vm);
+            pool = nullptr;
+            vm = nullptr;
+        }
+    }
+
+    vm_pool::vm_pool(std::size_t num_vms, int stack_size, bool use_arenas) : stack_size(stack_size)
+    {
+        vms.reserve(num_vms);
+        available.reserve(num_vms);
+        for (std::size_t i = 0; i < num_vms; i++)
+        {
+            std::unique_ptr<virtual_machine> vm(new virtual_machine(stack_size));
+            if (use_arenas)
+            {
+                vm->arena = std::make_shared<vm_arena>();
+            }
+
+            available.push_back(vm.get());
+            vms.emplace_back(std::move(vm));
+        }
+    }
+
+    pooled_vm vm_pool::acquire()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        vm_returned.wait(guard, [this]() { return !available.empty(); });
+
+        auto result = available.back();
+        available.pop_back();
+        return pooled_vm(this, result);
+    }
+
+    pooled_vm vm_pool::try_acquire()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (available.empty())
+        {
+            return pooled_vm();
+        }
+
+        auto result = available.back();
+        available.pop_back();
+        return pooled_vm(this, result);
+    }
+
+    void vm_pool::execute(std::shared_ptr<script> input)
+    {
+        auto vm = acquire();
+        vm->execute(input);
+    }
+
+    std::size_t vm_pool::num_available() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return available.size();
+    }
+
+    void vm_pool::give_back(virtual_machine *vm)
+    {
+        // Reset outside of the lock, this frees anything left on the stack and the old global scope.
+        vm->reset();
+        vm->current_code = nullptr;
+        vm->builtin_scope = nullptr;
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            available.push_back(vm);
+        }
+        vm_returned.notify_one();
+    }
+} // lysithea_vm
\ No newline at end of file
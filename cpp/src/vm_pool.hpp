@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "virtual_machine.hpp"
+
+namespace lysithea_vm
+{
+    class vm_pool;
+
+    // A VM checked out of a pool, the VM is reset and given back to the pool when this is destroyed or released.
+    class pooled_vm
+    {
+        public:
+            // Constructor
+            pooled_vm() : pool(nullptr), vm(nullptr) { }
+            pooled_vm(vm_pool *pool, virtual_machine *vm) : pool(pool), vm(vm) { }
+            pooled_vm(pooled_vm &&other) : pool(other.pool), vm(other.vm)
+            {
+                other.pool = nullptr;
+                other.vm = nullptr;
+            }
+            ~pooled_vm() { release(); }
+
+            pooled_vm(const pooled_vm &other) = delete;
+            pooled_vm &operator=(const pooled_vm &other) = delete;
+            pooled_vm &operator=(pooled_vm &&other);
+
+            // Methods
+            inline virtual_machine *get() const { return vm; }
+            inline virtual_machine *operator->() const { return vm; }
+            inline virtual_machine &operator*() const { return *vm; }
+            inline explicit operator bool() const { return vm != nullptr; }
+
+            void release();
+
+        private:
+            // Fields
+            vm_pool *pool;
+            virtual_machine *vm;
+    };
+
+    // Owns a fixed number of VMs that worker threads can check out to run scripts. Any number of VMs can execute the
+    // same script at the same time, but each VM should only be used by the thread that checked it out.
+    // The pool has to outlive the VMs checked out of it.
+    class vm_pool
+    {
+        public:
+            // Fields
+            const int stack_size;
+
+            // Constructor
+            // Each VM gets its own arena if use_arenas is set.
+            vm_pool(std::size_t num_vms, int stack_size, bool use_arenas = true);
+
+            vm_pool(const vm_pool &other) = delete;
+            vm_pool &operator=(const vm_pool &other) = delete;
+
+            // Methods
+            // Waits until a VM is free.
+            pooled_vm acquire();
+            // Returns an empty pooled_vm if none are free.
+            pooled_vm try_acquire();
+
+            // Checks out a VM and executes the script with it, the VM is given back even if the script throws.
+            void execute(std::shared_ptr<script> input);
+
+            inline std::size_t size() const { return vms.size(); }
+            std::size_t num_available() const;
+
+        private:
+            // Fields
+            std::vector<std::unique_ptr<virtual_machine>> vms;
+            std::vector<virtual_machine *> available;
+            mutable std::mutex lock;
+            std::condition_variable vm_returned;
+
+            // Methods
+            void give_back(virtual_machine *vm);
+
+            friend class pooled_vm;
+    };
+} // lysithea_vm
\ No newline at end of file
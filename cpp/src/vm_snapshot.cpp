@@ -0,0 +1,705 @@
+#include "vm_snapshot.hpp"
+
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+
+#include "./binary_io.hpp"
+#include "./function.hpp"
+#include "./assembler/bytecode.hpp"
+#include "./values/array_value.hpp"
+#include "./values/object_value.hpp"
+#include "./values/string_value.hpp"
+#include "./values/variable_value.hpp"
+#include "./values/function_value.hpp"
+#include "./values/builtin_function_value.hpp"
+#include "./values/string_builder_value.hpp"
+
+namespace lysithea_vm
+{
+    const std::uint32_t vm_snapshot::version = 1;
+
+    static const char snapshot_magic[4] = { 'L', 'Y', 'S', 'S' };
+    static const std::uint8_t flag_running = 1;
+    static const std::uint8_t flag_paused = 2;
+
+    enum class snapshot_value_type : std::uint8_t
+    {
+        undefined, null, is_true, is_false, number, string, variable, array, object, function, builtin, string_builder,
+        // A value from the script's code or constants.
+        script_value,
+        // A value that has already been saved in this snapshot.
+        reference
+    };
+
+    // Snapshots refer to the script's functions and values by index, so they can only be restored with the same code.
+    static std::uint64_t script_hash(const script &input)
+    {
+        try
+        {
+            return content_hash(bytecode::save_script(input, false));
+        }
+        catch (const bytecode_error &error)
+        {
+            throw snapshot_error("Unable to save script for snapshot: " + error.message);
+        }
+    }
+
+    // The functions and complex values in a script in the order they are found, which is the same for every copy of the script.
+    class script_index
+    {
+        public:
+            // Fields
+            std::vector<function_ptr> functions;
+            std::unordered_map<const function *, int> function_ids;
+            std::vector<value> values;
+            std::unordered_map<const complex_value *, int> value_ids;
+
+            // Constructor
+            script_index(const script &input)
+            {
+                add_function(input.code);
+                for (const auto &iter : sorted_scope_values(*input.constants))
+                {
+                    add_value(iter.second);
+                }
+            }
+
+        private:
+            // Methods
+            void add_function(const function_ptr &input)
+            {
+                if (function_ids.find(input.get()) != function_ids.end())
+                {
+                    return;
+                }
+
+                function_ids[input.get()] = static_cast<int>(functions.size());
+                functions.push_back(input);
+
+                for (const auto &line : input->code)
+                {
+                    add_value(line.value);
+                }
+            }
+
+            void add_value(const value &input)
+            {
+                auto raw = input.get_complex_raw();
+                if (!raw || value_ids.find(raw) != value_ids.end())
+                {
+                    return;
+                }
+
+                value_ids[raw] = static_cast<int>(values.size());
+                values.push_back(input);
+
+                auto func = input.get_complex<const function_value>();
+                if (func)
+                {
+                    add_function(func->data);
+                    return;
+                }
+
+                auto array = input.get_complex<const array_value>();
+                if (array)
+                {
+                    for (const auto &iter : array->data)
+                    {
+                        add_value(iter);
+                    }
+                    return;
+                }
+
+                auto object = input.get_complex<const object_value>();
+                if (object)
+                {
+                    object->for_each([&](const std::string &, const value &item)
+                    {
+                        add_value(item);
+                    });
+                }
+            }
+    };
+
+    class snapshot_writer : public binary_writer
+    {
+        public:
+            // Constructor
+            snapshot_writer(const virtual_machine &vm, const script &input) :
+                vm(vm), input(input), index(input), builtin_paths(find_builtin_paths(*input.builtin_scope)) { }
+
+            // Methods
+            void write_snapshot()
+            {
+                if (vm.waiting_on)
+                {
+                    throw snapshot_error("Unable to save a VM that is waiting on an async builtin");
+                }
+
+                add_scope(vm.global_scope);
+                add_scope(vm.current_scope);
+                for (auto i = 0; i < vm.stack_trace.stack_size(); i++)
+                {
+                    add_scope(vm.stack_trace.at(i).frame_scope);
+                }
+
+                output.insert(output.end(), snapshot_magic, snapshot_magic + sizeof(snapshot_magic));
+                write_u32(vm_snapshot::version);
+                write_u64(script_hash(input));
+
+                write_u8((vm.running ? flag_running : 0) | (vm.paused ? flag_paused : 0));
+                write_i32(vm.program_counter);
+                write_i32(vm.locals_offset);
+                write_function_id(vm.current_code.get());
+
+                write_u32(static_cast<std::uint32_t>(scopes.size()));
+                for (auto iter : scopes)
+                {
+                    write_scope(*iter);
+                }
+                write_i32(scope_ids.at(vm.global_scope.get()));
+                write_i32(scope_ids.at(vm.current_scope.get()));
+
+                write_u32(static_cast<std::uint32_t>(vm.stack_trace.stack_size()));
+                for (auto i = 0; i < vm.stack_trace.stack_size(); i++)
+                {
+                    const auto &frame = vm.stack_trace.at(i);
+                    write_i32(frame.line_counter);
+                    write_i32(frame.locals_offset);
+                    write_function_id(frame.code.get());
+                    write_i32(scope_ids.at(frame.frame_scope.get()));
+                }
+
+                write_u32(static_cast<std::uint32_t>(vm.stack.stack_size()));
+                for (auto i = 0; i < vm.stack.stack_size(); i++)
+                {
+                    write_value(vm.stack.at(i));
+                }
+
+                write_u32(static_cast<std::uint32_t>(vm.locals.size()));
+                for (const auto &iter : vm.locals)
+                {
+                    write_value(iter);
+                }
+            }
+
+        private:
+            // Fields
+            const virtual_machine &vm;
+            const script &input;
+            const script_index index;
+            const std::unordered_map<const complex_value *, std::string> builtin_paths;
+
+            // Parents always come before the scopes that use them.
+            std::vector<const scope *> scopes;
+            std::unordered_map<const scope *, int> scope_ids;
+            std::unordered_map<const complex_value *, int> value_ids;
+            std::unordered_map<const string_builder_buffer *, int> buffer_ids;
+
+            // Methods
+            void add_scope(const std::shared_ptr<scope> &input)
+            {
+                if (!input || scope_ids.find(input.get()) != scope_ids.end())
+                {
+                    return;
+                }
+
+                add_scope(input->parent);
+                scope_ids[input.get()] = static_cast<int>(scopes.size());
+                scopes.push_back(input.get());
+            }
+
+            void write_scope(const scope &input)
+            {
+                write_i32(input.parent ? scope_ids.at(input.parent.get()) : -1);
+
+                auto values = sorted_scope_values(input);
+                write_u32(static_cast<std::uint32_t>(values.size()));
+                for (const auto &iter : values)
+                {
+                    write_string(iter.first);
+                    write_u8(input.is_constant(iter.first) ? 1 : 0);
+                    write_value(iter.second);
+                }
+            }
+
+            void write_function_id(const function *input)
+            {
+                if (!input)
+                {
+                    write_i32(-1);
+                    return;
+                }
+
+                auto find = index.function_ids.find(input);
+                if (find == index.function_ids.end())
+                {
+                    throw snapshot_error("Unable to save function that is not part of the script: " + input->name);
+                }
+                write_i32(find->second);
+            }
+
+            void write_value(const value &input, int depth = 0)
+            {
+                if (depth > max_value_depth)
+                {
+                    throw snapshot_error("Values are nested too deeply to save in a snapshot");
+                }
+
+                if (input.is_undefined())
+                {
+                    write_type(snapshot_value_type::undefined);
+                    return;
+                }
+                if (input.is_null())
+                {
+                    write_type(snapshot_value_type::null);
+                    return;
+                }
+                if (input.is_bool())
+                {
+                    write_type(input.get_bool() ? snapshot_value_type::is_true : snapshot_value_type::is_false);
+                    return;
+                }
+                if (input.is_number())
+                {
+                    write_type(snapshot_value_type::number);
+                    write_f64(input.get_number());
+                    return;
+                }
+
+                auto raw = input.get_complex_raw();
+                auto find_script = index.value_ids.find(raw);
+                if (find_script != index.value_ids.end())
+                {
+                    write_type(snapshot_value_type::script_value);
+                    write_i32(find_script->second);
+                    return;
+                }
+
+                auto find_saved = value_ids.find(raw);
+                if (find_saved != value_ids.end())
+                {
+                    write_type(snapshot_value_type::reference);
+                    write_i32(find_saved->second);
+                    return;
+                }
+
+                // The id is taken before any nested values so that the reader numbers them the same way.
+                auto id = static_cast<int>(value_ids.size());
+                value_ids[raw] = id;
+
+                auto str = input.get_complex<const string_value>();
+                if (str)
+                {
+                    write_type(snapshot_value_type::string);
+                    write_string(str->to_string());
+                    return;
+                }
+
+                auto variable = input.get_complex<const variable_value>();
+                if (variable)
+                {
+                    write_type(snapshot_value_type::variable);
+                    write_string(variable->data);
+                    return;
+                }
+
+                auto array = input.get_complex<const array_value>();
+                if (array)
+                {
+                    write_type(snapshot_value_type::array);
+                    write_u8(array->is_arguments_value ? 1 : 0);
+                    write_u32(static_cast<std::uint32_t>(array->data.size()));
+                    for (const auto &iter : array->data)
+                    {
+                        write_value(iter, depth + 1);
+                    }
+                    return;
+                }
+
+                auto object = input.get_complex<const object_value>();
+                if (object)
+                {
+                    write_type(snapshot_value_type::object);
+                    write_u32(static_cast<std::uint32_t>(object->size()));
+                    object->for_each([&](const std::string &key, const value &item)
+                    {
+                        write_string(key);
+                        write_value(item, depth + 1);
+                    });
+                    return;
+                }
+
+                auto func = input.get_complex<const function_value>();
+                if (func)
+                {
+                    write_type(snapshot_value_type::function);
+                    write_function_id(func->data.get());
+                    return;
+                }
+
+                auto builtin = input.get_complex<const builtin_function_value>();
+                if (builtin)
+                {
+                    auto find = builtin_paths.find(builtin.get());
+                    if (find == builtin_paths.end())
+                    {
+                        throw snapshot_error("Unable to save builtin function that is not in the builtin scope");
+                    }
+
+                    write_type(snapshot_value_type::builtin);
+                    write_string(find->second);
+                    return;
+                }
+
+                auto builder = input.get_complex<const string_builder_value>();
+                if (builder)
+                {
+                    write_type(snapshot_value_type::string_builder);
+                    write_u32(static_cast<std::uint32_t>(builder->length));
+
+                    // Builders made by appending share a buffer, which is only saved with the first one.
+                    auto find = buffer_ids.find(builder->buffer.get());
+                    if (find != buffer_ids.end())
+                    {
+                        write_i32(find->second);
+                        return;
+                    }
+
+                    write_i32(-1);
+                    buffer_ids.emplace(builder->buffer.get(), static_cast<int>(buffer_ids.size()));
+                    std::lock_guard<std::mutex> guard(builder->buffer->lock);
+                    write_string(builder->buffer->data);
+                    return;
+                }
+
+                throw snapshot_error("Unable to save value of type: " + input.type_name());
+            }
+
+            inline void write_type(snapshot_value_type input)
+            {
+                write_u8(static_cast<std::uint8_t>(input));
+            }
+    };
+
+    class snapshot_reader : public binary_reader<snapshot_error>
+    {
+        public:
+            // Constructor
+            snapshot_reader(const std::uint8_t *data, std::size_t size, std::shared_ptr<script> input) :
+                binary_reader(data, size, "snapshot"), input(input), index(*input) { }
+
+            // Methods
+            void read_snapshot(virtual_machine &vm)
+            {
+                if (remaining() < sizeof(snapshot_magic) || std::memcmp(position, snapshot_magic, sizeof(snapshot_magic)) != 0)
+                {
+                    throw snapshot_error("Input is not a lysithea snapshot");
+                }
+                position += sizeof(snapshot_magic);
+
+                auto file_version = read_u32();
+                if (file_version != vm_snapshot::version)
+                {
+                    throw snapshot_error("Unsupported snapshot version: " + std::to_string(file_version));
+                }
+
+                if (read_u64() != script_hash(*input))
+                {
+                    throw snapshot_error("Snapshot was saved from a different script");
+                }
+
+                auto flags = read_u8();
+                auto program_counter = read_i32();
+                auto locals_offset = read_i32();
+                auto current_code = read_function();
+
+                auto num_scopes = read_count();
+                for (auto i = 0u; i < num_scopes; i++)
+                {
+                    read_scope();
+                }
+                auto global_scope = read_scope_id();
+                auto current_scope = read_scope_id();
+
+                std::vector<scope_frame> frames;
+                auto num_frames = read_count();
+                for (auto i = 0u; i < num_frames; i++)
+                {
+                    auto line_counter = read_i32();
+                    auto frame_locals_offset = read_i32();
+                    auto code = read_function();
+                    auto frame_scope = read_scope_id();
+                    if (!code)
+                    {
+                        throw snapshot_error("Invalid call frame in snapshot");
+                    }
+                    frames.emplace_back(line_counter, frame_locals_offset, std::move(code), std::move(frame_scope));
+                }
+
+                std::vector<value> stack;
+                auto stack_size = read_count();
+                for (auto i = 0u; i < stack_size; i++)
+                {
+                    stack.push_back(read_value());
+                }
+
+                std::vector<value> locals;
+                auto num_locals = read_count();
+                for (auto i = 0u; i < num_locals; i++)
+                {
+                    locals.push_back(read_value());
+                }
+
+                // Everything is checked before the VM is changed, so a bad snapshot leaves the VM as it was.
+                check_position(current_code, program_counter, locals_offset, locals.size());
+                for (const auto &iter : frames)
+                {
+                    check_position(iter.code, iter.line_counter, iter.locals_offset, locals.size());
+                }
+                if (static_cast<int>(stack.size()) > vm.stack.capacity() || static_cast<int>(frames.size()) > vm.stack_trace.capacity())
+                {
+                    throw snapshot_error("The VM's stack is too small for the snapshot");
+                }
+
+                vm.stack.clear();
+                vm.clear_stack_trace();
+                for (auto &iter : frames)
+                {
+                    vm.push_stack_trace(std::move(iter));
+                }
+                for (auto &iter : stack)
+                {
+                    vm.push_stack(std::move(iter));
+                }
+                vm.locals.swap(locals);
+
+                vm.builtin_scope = input->builtin_scope;
+                vm.current_code = std::move(current_code);
+                vm.global_scope = std::move(global_scope);
+                vm.current_scope = std::move(current_scope);
+                vm.program_counter = program_counter;
+                vm.locals_offset = locals_offset;
+                vm.running = (flags & flag_running) != 0;
+                vm.paused = (flags & flag_paused) != 0;
+                vm.last_error = nullptr;
+                vm.waiting_on = nullptr;
+
+                if (vm.running && vm.current_code)
+                {
+                    vm.check_stack_space();
+                }
+            }
+
+        private:
+            // Fields
+            const std::shared_ptr<script> input;
+            const script_index index;
+
+            std::vector<std::shared_ptr<scope>> scopes;
+            std::vector<value> values;
+            std::vector<std::shared_ptr<string_builder_buffer>> buffers;
+
+            // Methods
+            void read_scope()
+            {
+                auto parent_id = read_i32();
+                if (parent_id < -1 || parent_id >= static_cast<int>(scopes.size()))
+                {
+                    throw snapshot_error("Invalid scope in snapshot");
+                }
+
+                auto result = std::make_shared<scope>(parent_id >= 0 ? scopes[parent_id] : nullptr);
+                auto count = read_count();
+                for (auto i = 0u; i < count; i++)
+                {
+                    auto key = symbol::intern(read_string());
+                    auto is_constant = read_u8() != 0;
+                    result->try_define(key, read_value());
+                    if (is_constant)
+                    {
+                        result->set_constant(key);
+                    }
+                }
+
+                scopes.push_back(result);
+            }
+
+            std::shared_ptr<scope> read_scope_id()
+            {
+                auto id = read_i32();
+                if (id < 0 || id >= static_cast<int>(scopes.size()))
+                {
+                    throw snapshot_error("Invalid scope in snapshot");
+                }
+                return scopes[id];
+            }
+
+            function_ptr read_function()
+            {
+                auto id = read_i32();
+                if (id == -1)
+                {
+                    return nullptr;
+                }
+                if (id < 0 || id >= static_cast<int>(index.functions.size()))
+                {
+                    throw snapshot_error("Invalid function in snapshot");
+                }
+                return index.functions[id];
+            }
+
+            static void check_position(const function_ptr &code, int line, int locals_offset, std::size_t num_locals)
+            {
+                auto code_size = code ? static_cast<int>(code->code.size()) : 0;
+                auto code_locals = code ? code->locals.size() : 0;
+                if (line < 0 || line > code_size || locals_offset < 0 || locals_offset + code_locals > num_locals)
+                {
+                    throw snapshot_error("Invalid position in snapshot");
+                }
+            }
+
+            value read_value(int depth = 0)
+            {
+                check_value_depth(depth);
+                auto type = static_cast<snapshot_value_type>(read_u8());
+                switch (type)
+                {
+                    case snapshot_value_type::undefined: return value();
+                    case snapshot_value_type::null: return value::make_null();
+                    case snapshot_value_type::is_true: return value(true);
+                    case snapshot_value_type::is_false: return value(false);
+                    case snapshot_value_type::number: return value(read_f64());
+                    case snapshot_value_type::script_value:
+                    {
+                        auto id = read_i32();
+                        if (id < 0 || id >= static_cast<int>(index.values.size()))
+                        {
+                            throw snapshot_error("Invalid script value in snapshot");
+                        }
+                        return index.values[id];
+                    }
+                    case snapshot_value_type::reference:
+                    {
+                        auto id = read_i32();
+                        if (id < 0 || id >= static_cast<int>(values.size()) || values[id].is_undefined())
+                        {
+                            throw snapshot_error("Invalid value reference in snapshot");
+                        }
+                        return values[id];
+                    }
+                    default: break;
+                }
+
+                // Same as the writer, the id is taken before reading any nested values.
+                auto id = values.size();
+                values.emplace_back();
+                auto result = read_complex_value(type, depth);
+                values[id] = result;
+                return result;
+            }
+
+            value read_complex_value(snapshot_value_type type, int depth)
+            {
+                switch (type)
+                {
+                    case snapshot_value_type::string: return value(read_string());
+                    case snapshot_value_type::variable: return value(make_complex<variable_value>(read_string()));
+                    case snapshot_value_type::array:
+                    {
+                        auto is_arguments_value = read_u8() != 0;
+                        array_vector data;
+                        auto count = read_count();
+                        for (auto i = 0u; i < count; i++)
+                        {
+                            data.push_back(read_value(depth + 1));
+                        }
+                        return array_value::make_value(data, is_arguments_value);
+                    }
+                    case snapshot_value_type::object:
+                    {
+                        object_map data;
+                        auto count = read_count();
+                        for (auto i = 0u; i < count; i++)
+                        {
+                            auto key = read_string();
+                            data[key] = read_value(depth + 1);
+                        }
+                        return object_value::make_value(data);
+                    }
+                    case snapshot_value_type::function:
+                    {
+                        auto func = read_function();
+                        if (!func)
+                        {
+                            throw snapshot_error("Invalid function in snapshot");
+                        }
+                        return value(make_complex<function_value>(func));
+                    }
+                    case snapshot_value_type::builtin:
+                    {
+                        auto path = read_string();
+                        value result;
+                        if (!try_find_builtin(*input->builtin_scope, path, result))
+                        {
+                            throw snapshot_error("Unable to find builtin function: " + path);
+                        }
+                        return result;
+                    }
+                    case snapshot_value_type::string_builder:
+                    {
+                        auto length = read_u32();
+                        auto buffer_id = read_i32();
+                        std::shared_ptr<string_builder_buffer> buffer;
+                        if (buffer_id == -1)
+                        {
+                            buffer = std::make_shared<string_builder_buffer>();
+                            buffer->data = read_string();
+                            buffers.push_back(buffer);
+                        }
+                        else if (buffer_id >= 0 && buffer_id < static_cast<int>(buffers.size()))
+                        {
+                            buffer = buffers[buffer_id];
+                        }
+
+                        if (!buffer || length > buffer->data.size())
+                        {
+                            throw snapshot_error("Invalid string builder in snapshot");
+                        }
+                        return value(make_complex<string_builder_value>(buffer, length));
+                    }
+                    default: break;
+                }
+
+                throw snapshot_error("Unknown value type in snapshot");
+            }
+    };
+
+    std::vector<std::uint8_t> vm_snapshot::save(const virtual_machine &vm, const script &input)
+    {
+        snapshot_writer writer(vm, input);
+        writer.write_snapshot();
+        return writer.output;
+    }
+
+    void vm_snapshot::save(const virtual_machine &vm, const script &input, std::ostream &output)
+    {
+        auto data = save(vm, input);
+        output.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+
+    void vm_snapshot::restore(virtual_machine &vm, std::shared_ptr<script> input, const void *data, std::size_t size)
+    {
+        snapshot_reader reader(static_cast<const std::uint8_t *>(data), size, input);
+        reader.read_snapshot(vm);
+    }
+
+    void vm_snapshot::restore(virtual_machine &vm, std::shared_ptr<script> input, std::istream &input_stream)
+    {
+        std::vector<char> data((std::istreambuf_iterator<char>(input_stream)), std::istreambuf_iterator<char>());
+        restore(vm, input, data.data(), data.size());
+    }
+} // lysithea_vm
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <memory>
+#include <vector>
+
+#include "./virtual_machine.hpp"
+#include "./errors/snapshot_error.hpp"
+
+namespace lysithea_vm
+{
+    // Saves the execution state of a VM in a binary format so it can be carried on later, in another VM or another process.
+    // A snapshot has the operand stack, call frames, local variables, the current function and position and every scope
+    // they use, including the global scope. Functions and any values that are part of the script are saved as an index
+    // into the script, so a snapshot has to be restored with the same script, either the same one parsed again or loaded
+    // from bytecode. A hash of the script's bytecode is saved in the snapshot to check this. Values shared by several parts of the state are only saved once and are still shared when restored.
+    //
+    // The VM should be stopped between instructions, such as after a builtin has paused it or run_for has returned.
+    // A VM waiting on an async builtin can't be saved.
+    class vm_snapshot
+    {
+        public:
+            // Fields
+            static const std::uint32_t version;
+
+            // Methods
+            static std::vector<std::uint8_t> save(const virtual_machine &vm, const script &input);
+            static void save(const virtual_machine &vm, const script &input, std::ostream &output);
+
+            // Replaces the state of the VM with the snapshot. The builtin scope is taken from the script.
+            static void restore(virtual_machine &vm, std::shared_ptr<script> input, const void *data, std::size_t size);
+            static void restore(virtual_machine &vm, std::shared_ptr<script> input, std::istream &input_stream);
+    };
+} // lysithea_vm
\ No newline at end of file
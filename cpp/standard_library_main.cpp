@@ -29,7 +29,7 @@ int main()
 
     auto script = assembler.parse_from_stream(filename, input_file);
 
-    lysithea_vm::virtual_machine vm(32);
+    lysithea_vm::virtual_machine vm(lysithea_vm::virtual_machine::stack_size_for(*script, 32));
 
     try
     {
@@ -0,0 +1,99 @@
+#include <iostream>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+
+#include "src/assembler/assembler.hpp"
+#include "src/errors/virtual_machine_error.hpp"
+#include "src/standard_library/standard_library.hpp"
+#include "src/values/values.hpp"
+#include "src/virtual_machine.hpp"
+
+// Counts every heap allocation made through new, which includes std::shared_ptr and std::string.
+std::atomic<std::size_t> allocation_count(0);
+
+void *operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    auto result = std::malloc(size > 0 ? size : 1);
+    if (!result)
+    {
+        throw std::bad_alloc();
+    }
+    return result;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+// Runs the whole script and returns how many allocations it made for each call to testString.
+double run_benchmark(const char *filename, bool inline_strings)
+{
+    std::ifstream input_file;
+    input_file.open(filename);
+    if (!input_file)
+    {
+        throw std::runtime_error("Could not find file to open!");
+    }
+
+    // Set before parsing so the script's own strings are made the same way.
+    lysithea_vm::string_value::inline_enabled = inline_strings;
+
+    lysithea_vm::assembler assembler;
+    lysithea_vm::standard_library::add_to_scope(assembler.builtin_scope);
+
+    auto script = assembler.parse_from_stream(filename, input_file);
+
+    lysithea_vm::virtual_machine vm(lysithea_vm::virtual_machine::stack_size_for(*script, 16));
+
+    auto start_count = allocation_count.load();
+    auto start = std::chrono::steady_clock::now();
+    vm.execute(script);
+    auto end = std::chrono::steady_clock::now();
+    auto allocations = allocation_count.load() - start_count;
+
+    // The script loops until i reaches the number of times it has called testString.
+    double calls = 0;
+    vm.global_scope->try_get_number("i", calls);
+
+    std::cout << (inline_strings ? "Inline strings\n" : "Baseline, every string in a std::string\n");
+    std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms\n";
+    std::cout << "Allocations: " << allocations << "\n";
+    auto per_call = calls > 0 ? allocations / calls : 0;
+    std::cout << "Allocations per call: " << per_call << "\n";
+    return per_call;
+}
+
+int main()
+{
+    const char *filename = "../../examples/benchmark1.lys";
+
+    try
+    {
+        auto baseline = run_benchmark(filename, false);
+        auto inline_strings = run_benchmark(filename, true);
+
+        std::cout << "Allocations per call saved: " << (baseline - inline_strings) << "\n";
+    }
+    catch (const lysithea_vm::virtual_machine_error &exp)
+    {
+        std::cerr << exp.what() << "\n";
+        for (const auto &line : exp.stack_trace)
+        {
+            std::cerr << line << "\n";
+        }
+    }
+    catch (const std::exception &exp)
+    {
+        std::cerr << "Error: " << exp.what() << "\n";
+        return -1;
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include <iostream>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "src/assembler/assembler.hpp"
+#include "src/errors/virtual_machine_error.hpp"
+#include "src/standard_library/standard_library.hpp"
+#include "src/values/values.hpp"
+#include "src/virtual_machine.hpp"
+#include "src/vm_pool.hpp"
+
+// A small instance of the perfTest script, like something run once per NPC each tick.
+const char *script_text =
+    "(function step ()\n"
+    "    (return (+ (rand) (rand)))\n"
+    ")\n"
+    "(function main ()\n"
+    "    (define total 0)\n"
+    "    (define counter 0)\n"
+    "    (loop (< counter 1000)\n"
+    "        (+= total (step))\n"
+    "        (++ counter)\n"
+    "    )\n"
+    "    (define state (object.set {\"type\" \"npc\"} \"name\" ($ \"npc \" counter)))\n"
+    "    (set state (object.set state \"total\" total))\n"
+    "    (result (object.get state \"total\"))\n"
+    ")\n"
+    "(main)\n";
+
+const int num_instances = 20000;
+
+std::atomic<double> result_total(0);
+
+std::shared_ptr<lysithea_vm::scope> create_custom_scope()
+{
+    auto result = std::make_shared<lysithea_vm::scope>();
+
+    // Builtins are shared by every VM, so any state they use has to be safe to use from each worker thread.
+    result->try_set_constant("rand", [](lysithea_vm::virtual_machine &vm, const lysithea_vm::arguments_view &args) -> void
+    {
+        thread_local std::mt19937 random(std::random_device{}());
+        thread_local std::uniform_real_distribution<double> dist(0.0, 1.0);
+        vm.push_stack(dist(random));
+    });
+
+    result->try_set_constant("result", [](lysithea_vm::virtual_machine &vm, const lysithea_vm::arguments_view &args) -> void
+    {
+        auto current = result_total.load(std::memory_order_relaxed);
+        while (!result_total.compare_exchange_weak(current, current + args.get_number(0), std::memory_order_relaxed)) { }
+    });
+
+    return result;
+}
+
+double run_instances(lysithea_vm::vm_pool &pool, std::shared_ptr<lysithea_vm::script> script, int num_threads)
+{
+    std::atomic<int> remaining(num_instances);
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < num_threads; i++)
+    {
+        workers.emplace_back([&]()
+        {
+            while (remaining.fetch_sub(1, std::memory_order_relaxed) > 0)
+            {
+                try
+                {
+                    pool.execute(script);
+                }
+                catch (const lysithea_vm::virtual_machine_error &exp)
+                {
+                    std::cerr << exp.what() << "\n";
+                }
+            }
+        });
+    }
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main()
+{
+    lysithea_vm::assembler assembler;
+    lysithea_vm::standard_library::add_to_scope(assembler.builtin_scope);
+    assembler.builtin_scope.combine_scope(*create_custom_scope());
+
+    std::stringstream input(script_text);
+    auto script = assembler.parse_from_stream("vmPoolBenchmark", input);
+
+    std::vector<int> thread_counts { 1, 2, 4 };
+    auto hardware_threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (hardware_threads > 4)
+    {
+        thread_counts.push_back(hardware_threads);
+    }
+
+    std::cout << "Instances: " << num_instances << ", hardware threads: " << hardware_threads << "\n";
+    for (auto num_threads : thread_counts)
+    {
+        lysithea_vm::vm_pool pool(num_threads, lysithea_vm::virtual_machine::stack_size_for(*script, 16));
+
+        result_total.store(0);
+        auto seconds = run_instances(pool, script, num_threads);
+
+        std::cout << num_threads << " threads: " << static_cast<int>(seconds * 1000) << "ms, "
+            << static_cast<int>(num_instances / seconds) << " instances/s, average result "
+            << result_total.load() / num_instances << "\n";
+    }
+
+    return 0;
+}
\ No newline at end of file